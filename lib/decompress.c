@@ -1,7 +1,7 @@
 /*
  * decompress.c: decompression abstraction layer
  *
- * Copyright (C) 2007, 2008 Colin Watson.
+ * Copyright (C) 2007, 2008, 2013 Colin Watson.
  *
  * This file is part of man-db.
  *
@@ -31,12 +31,25 @@
 #include <sys/stat.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <errno.h>
+#include <ctype.h>
 
 #ifdef HAVE_LIBZ
 #  include "zlib.h"
 #endif /* HAVE_LIBZ */
 
+#ifdef HAVE_LIBZSTD
+#  include "zstd.h"
+#endif /* HAVE_LIBZSTD */
+
+#include "xalloc.h"
+
+#include "gettext.h"
+#define _(String) gettext (String)
+
 #include "manconfig.h"
+
+#include "error.h"
 #include "comp_src.h"
 #include "pipeline.h"
 #include "decompress.h"
@@ -64,24 +77,296 @@ static void decompress_zlib (void *data ATTRIBUTE_UNUSED)
 	return;
 }
 
+static void compress_zlib (void *data)
+{
+	int level = *(int *) data;
+	char mode[] = "wb9";
+	gzFile zlibfile;
+
+	/* close_cat_stream only throws the cat page away if we exit
+	 * non-zero, so every failure here must be fatal.
+	 */
+	mode[2] = '0' + level;
+	zlibfile = gzdopen (dup (STDOUT_FILENO), mode);
+	if (!zlibfile)
+		error (FATAL, errno, "zlib");
+
+	for (;;) {
+		char buffer[4096];
+		size_t r = fread (buffer, 1, 4096, stdin);
+		if (r == 0)
+			break;
+		if (gzwrite (zlibfile, buffer, (unsigned) r) < (int) r) {
+			int errnum;
+			const char *msg = gzerror (zlibfile, &errnum);
+			error (FATAL, errnum == Z_ERRNO ? errno : 0,
+			       "zlib: %s", msg);
+		}
+	}
+	if (ferror (stdin))
+		error (FATAL, errno, "zlib");
+
+	if (gzclose (zlibfile) != Z_OK)
+		error (FATAL, errno, "zlib");
+	return;
+}
+
+/* If COMPRESSOR is a gzip invocation that zlib can stand in for, return
+ * the compression level it asks for; otherwise return 0.
+ */
+static int gzip_level (const char *compressor)
+{
+	char *args = xstrdup (compressor);
+	char *word, *base;
+	int level = 6;
+
+	word = strtok (args, " \t");
+	if (!word)
+		goto unknown;
+	base = strrchr (word, '/');
+	if (!STREQ (base ? base + 1 : word, "gzip"))
+		goto unknown;
+
+	while ((word = strtok (NULL, " \t")) != NULL) {
+		const char *c;
+
+		if (STREQ (word, "--best"))
+			level = 9;
+		else if (STREQ (word, "--fast"))
+			level = 1;
+		else if (STREQ (word, "--stdout") || STREQ (word, "--no-name"))
+			continue;
+		else if (word[0] == '-' && word[1] && word[1] != '-') {
+			for (c = word + 1; *c; ++c) {
+				if (*c >= '1' && *c <= '9')
+					level = *c - '0';
+				else if (!strchr ("cnq", *c))
+					goto unknown;
+			}
+		} else
+			goto unknown;
+	}
+
+	free (args);
+	return level;
+
+unknown:
+	free (args);
+	return 0;
+}
+
+#endif /* HAVE_LIBZ */
+
+#ifdef HAVE_LIBZSTD
+
+static void decompress_zstd (void *data ATTRIBUTE_UNUSED)
+{
+	ZSTD_DStream *dstream;
+	size_t inbuf_size = ZSTD_DStreamInSize ();
+	size_t outbuf_size = ZSTD_DStreamOutSize ();
+	char *inbuf, *outbuf;
+	size_t ret = 0;
+
+	/* This runs as a function command in its own process, so any
+	 * failure must show up in its exit status; otherwise a corrupt or
+	 * truncated page would be silently formatted as far as it goes.
+	 */
+	dstream = ZSTD_createDStream ();
+	if (!dstream)
+		xalloc_die ();
+	ret = ZSTD_initDStream (dstream);
+	if (ZSTD_isError (ret))
+		error (FATAL, 0, "zstd: %s", ZSTD_getErrorName (ret));
+	inbuf = xmalloc (inbuf_size);
+	outbuf = xmalloc (outbuf_size);
+
+	for (;;) {
+		size_t r = fread (inbuf, 1, inbuf_size, stdin);
+		ZSTD_inBuffer in = { inbuf, r, 0 };
+		if (r == 0)
+			break;
+		while (in.pos < in.size) {
+			ZSTD_outBuffer out = { outbuf, outbuf_size, 0 };
+
+			ret = ZSTD_decompressStream (dstream, &out, &in);
+			if (ZSTD_isError (ret))
+				error (FATAL, 0, "zstd: %s",
+				       ZSTD_getErrorName (ret));
+			if (fwrite (outbuf, 1, out.pos, stdout) < out.pos)
+				error (FATAL, errno,
+				       _("can't write to standard output"));
+		}
+	}
+	if (ferror (stdin))
+		error (FATAL, errno, "zstd");
+	/* A non-zero hint at end of input means the last frame was cut off. */
+	if (ret != 0)
+		error (FATAL, 0, "zstd: %s", _("unexpected end of input"));
+
+	free (outbuf);
+	free (inbuf);
+	ZSTD_freeDStream (dstream);
+	return;
+}
+
+static void compress_zstd (void *data)
+{
+	int level = *(int *) data;
+	ZSTD_CStream *cstream;
+	size_t inbuf_size = ZSTD_CStreamInSize ();
+	size_t outbuf_size = ZSTD_CStreamOutSize ();
+	char *inbuf, *outbuf;
+	size_t ret;
+
+	cstream = ZSTD_createCStream ();
+	if (!cstream)
+		xalloc_die ();
+	ret = ZSTD_initCStream (cstream, level);
+	if (ZSTD_isError (ret))
+		error (FATAL, 0, "zstd: %s", ZSTD_getErrorName (ret));
+	inbuf = xmalloc (inbuf_size);
+	outbuf = xmalloc (outbuf_size);
+
+	/* As with compress_zlib, failures must show up in our exit status. */
+	for (;;) {
+		size_t r = fread (inbuf, 1, inbuf_size, stdin);
+		ZSTD_inBuffer in = { inbuf, r, 0 };
+		if (r == 0)
+			break;
+		while (in.pos < in.size) {
+			ZSTD_outBuffer out = { outbuf, outbuf_size, 0 };
+
+			ret = ZSTD_compressStream (cstream, &out, &in);
+			if (ZSTD_isError (ret))
+				error (FATAL, 0, "zstd: %s",
+				       ZSTD_getErrorName (ret));
+			if (fwrite (outbuf, 1, out.pos, stdout) < out.pos)
+				error (FATAL, errno,
+				       _("can't write to standard output"));
+		}
+	}
+	if (ferror (stdin))
+		error (FATAL, errno, "zstd");
+
+	do {
+		ZSTD_outBuffer out = { outbuf, outbuf_size, 0 };
+
+		ret = ZSTD_endStream (cstream, &out);
+		if (ZSTD_isError (ret))
+			error (FATAL, 0, "zstd: %s", ZSTD_getErrorName (ret));
+		if (fwrite (outbuf, 1, out.pos, stdout) < out.pos)
+			error (FATAL, errno,
+			       _("can't write to standard output"));
+	} while (ret != 0);
+	if (fflush (stdout) != 0)
+		error (FATAL, errno, _("can't write to standard output"));
+
+	free (outbuf);
+	free (inbuf);
+	ZSTD_freeCStream (cstream);
+	return;
+}
+
+/* If COMPRESSOR is a zstd invocation that libzstd can stand in for,
+ * return the compression level it asks for; otherwise return 0.
+ */
+static int zstd_level (const char *compressor)
+{
+	char *args = xstrdup (compressor);
+	char *word, *base;
+	int level = 3;
+
+	word = strtok (args, " \t");
+	if (!word)
+		goto unknown;
+	base = strrchr (word, '/');
+	if (!STREQ (base ? base + 1 : word, "zstd"))
+		goto unknown;
+
+	while ((word = strtok (NULL, " \t")) != NULL) {
+		const char *c;
+
+		if (STREQ (word, "--stdout") || STREQ (word, "--quiet") ||
+		    STREQ (word, "--no-progress"))
+			continue;
+		else if (word[0] == '-' && word[1] && word[1] != '-') {
+			for (c = word + 1; *c; ++c) {
+				if (CTYPE (isdigit, *c)) {
+					level = atoi (c);
+					while (CTYPE (isdigit, c[1]))
+						++c;
+				} else if (!strchr ("cq", *c))
+					goto unknown;
+			}
+		} else
+			goto unknown;
+	}
+
+	if (level < 1 || level > ZSTD_maxCLevel ())
+		goto unknown;
+	free (args);
+	return level;
+
+unknown:
+	free (args);
+	return 0;
+}
+
+#endif /* HAVE_LIBZSTD */
+
+pipecmd *compress_command (const char *compressor)
+{
+#ifdef HAVE_LIBZ
+	int level = gzip_level (compressor);
+#endif /* HAVE_LIBZ */
+#ifdef HAVE_LIBZSTD
+	int zlevel = zstd_level (compressor);
+#endif /* HAVE_LIBZSTD */
+
+#ifdef HAVE_LIBZ
+	if (level) {
+		int *data = xmalloc (sizeof *data);
+		*data = level;
+		debug ("compressing in-process with zlib, level %d\n",
+		       level);
+		return pipecmd_new_function (compressor, &compress_zlib,
+					     &free, data);
+	}
 #endif /* HAVE_LIBZ */
 
+#ifdef HAVE_LIBZSTD
+	if (zlevel) {
+		int *data = xmalloc (sizeof *data);
+		*data = zlevel;
+		debug ("compressing in-process with zstd, level %d\n",
+		       zlevel);
+		return pipecmd_new_function (compressor, &compress_zstd,
+					     &free, data);
+	}
+#endif /* HAVE_LIBZSTD */
+
+	return pipecmd_new_argstr (compressor);
+}
+
 pipeline *decompress_open (const char *filename)
 {
 	pipecmd *cmd;
 	pipeline *p;
 	struct stat st;
-#ifdef HAVE_LIBZ
+#if defined(HAVE_LIBZ) || defined(HAVE_LIBZSTD)
 	size_t filename_len;
-#endif /* HAVE_LIBZ */
+#endif /* HAVE_LIBZ || HAVE_LIBZSTD */
 	char *ext;
 	struct compression *comp;
 
 	if (stat (filename, &st) < 0 || S_ISDIR (st.st_mode))
 		return NULL;
 
-#ifdef HAVE_LIBZ
+#if defined(HAVE_LIBZ) || defined(HAVE_LIBZSTD)
 	filename_len = strlen (filename);
+#endif /* HAVE_LIBZ || HAVE_LIBZSTD */
+
+#ifdef HAVE_LIBZ
 	if (filename_len > 3 && STREQ (filename + filename_len - 3, ".gz")) {
 		/* informational only; no shell quoting concerns */
 		char *name = appendstr (NULL, "zcat < ", filename, NULL);
@@ -93,6 +378,18 @@ pipeline *decompress_open (const char *filename)
 	}
 #endif /* HAVE_LIBZ */
 
+#ifdef HAVE_LIBZSTD
+	if (filename_len > 4 && STREQ (filename + filename_len - 4, ".zst")) {
+		/* informational only; no shell quoting concerns */
+		char *name = appendstr (NULL, "zstdcat < ", filename, NULL);
+		cmd = pipecmd_new_function (name, &decompress_zstd, NULL,
+					    NULL);
+		free (name);
+		p = pipeline_new_commands (cmd, NULL);
+		goto got_pipeline;
+	}
+#endif /* HAVE_LIBZSTD */
+
 	ext = strrchr (filename, '.');
 	if (ext) {
 		++ext;
@@ -1,7 +1,7 @@
 /*
  * decompress.h: interface to decompression abstraction layer
  *
- * Copyright (C) 2007 Colin Watson.
+ * Copyright (C) 2007, 2013 Colin Watson.
  *
  * This file is part of man-db.
  *
@@ -37,4 +37,11 @@ pipeline *decompress_open (const char *filename);
  */
 pipeline *decompress_fdopen (int fd);
 
+/* Return a command that compresses its standard input to its standard
+ * output as COMPRESSOR would.  Where COMPRESSOR is a gzip invocation and
+ * zlib is available, this is done in-process at the same compression
+ * level rather than by running gzip.
+ */
+pipecmd *compress_command (const char *compressor);
+
 #endif /* MAN_DECOMPRESS_H */
@@ -1,8 +1,8 @@
 /*
  * encodings.c: locale and encoding handling for man
  *
- * Copyright (C) 2003, 2004, 2005, 2006, 2007, 2008, 2009, 2010, 2011
- *               Colin Watson.
+ * Copyright (C) 2003, 2004, 2005, 2006, 2007, 2008, 2009, 2010, 2011,
+ *               2013 Colin Watson.
  *
  * This file is part of man-db.
  *
@@ -898,3 +898,94 @@ char *check_preprocessor_encoding (pipeline *p)
 
 	return pp_encoding;
 }
+
+/* Work out which encoding a page can be passed on in without any
+ * conversion, a block at a time as it is read: "ASCII" if it contains only
+ * 7-bit bytes, "UTF-8" if it is valid UTF-8, or NULL otherwise.  NULL is
+ * also the answer if the page has a .so request, since the encoding of the
+ * formatted text then depends on other files.
+ */
+void encoding_check_init (struct encoding_check *check)
+{
+	check->ascii = 1;
+	check->utf8 = 1;
+	check->has_so = 0;
+	check->need = 0;
+	check->lo = 0x80;
+	check->hi = 0xBF;
+	check->line_state = 0;
+}
+
+void encoding_check_feed (struct encoding_check *check, const char *block,
+			  size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len && !check->has_so; ++i) {
+		unsigned char c = (unsigned char) block[i];
+
+		if (c == '\n')
+			check->line_state = 0;
+		else if (check->line_state == 0 && (c == '.' || c == '\''))
+			check->line_state = 1;
+		else if (check->line_state == 1 && (c == ' ' || c == '\t'))
+			;
+		else if (check->line_state == 1 && c == 's')
+			check->line_state = 2;
+		else if (check->line_state == 2 && c == 'o') {
+			check->has_so = 1;
+			check->line_state = -1;
+		} else
+			check->line_state = -1;
+
+		if (c < 0x80) {
+			if (check->need)
+				check->utf8 = 0;
+			continue;
+		}
+		check->ascii = 0;
+		if (!check->utf8)
+			continue;
+		if (check->need) {
+			if (c < check->lo || c > check->hi)
+				check->utf8 = 0;
+			--check->need;
+			check->lo = 0x80;
+			check->hi = 0xBF;
+		} else if (c >= 0xC2 && c <= 0xDF)
+			check->need = 1;
+		else if (c >= 0xE0 && c <= 0xEF) {
+			check->need = 2;
+			if (c == 0xE0)
+				check->lo = 0xA0;	/* overlong */
+			else if (c == 0xED)
+				check->hi = 0x9F;	/* surrogates */
+		} else if (c >= 0xF0 && c <= 0xF4) {
+			check->need = 3;
+			if (c == 0xF0)
+				check->lo = 0x90;	/* overlong */
+			else if (c == 0xF4)
+				check->hi = 0x8F;	/* > U+10FFFF */
+		} else
+			check->utf8 = 0;
+	}
+}
+
+/* Return non-zero if no more data can change the answer. */
+int encoding_check_done (const struct encoding_check *check)
+{
+	return check->has_so || (!check->ascii && !check->utf8);
+}
+
+/* Return the answer once the whole page has been fed in. */
+const char *encoding_check_result (const struct encoding_check *check)
+{
+	if (check->has_so)
+		return NULL;
+	else if (check->ascii)
+		return "ASCII";
+	else if (check->utf8 && !check->need)
+		return "UTF-8";
+	else
+		return NULL;
+}
@@ -35,3 +35,18 @@ const char *get_output_encoding (const char *device);
 const char *get_less_charset (const char *locale_charset);
 const char *get_jless_charset (const char *locale_charset);
 char *check_preprocessor_encoding (struct pipeline *p);
+
+struct encoding_check {
+	int ascii, utf8, has_so;
+	int need;			/* continuation bytes still needed */
+	unsigned char lo, hi;		/* range of the next one */
+	int line_state;			/* 0 at start of line, 1 after a
+					 * control character, 2 after "s",
+					 * -1 elsewhere */
+};
+
+void encoding_check_init (struct encoding_check *check);
+void encoding_check_feed (struct encoding_check *check, const char *block,
+			  size_t len);
+int encoding_check_done (const struct encoding_check *check);
+const char *encoding_check_result (const struct encoding_check *check);
@@ -93,7 +93,8 @@ struct nlist *hashtable_lookup_structure (const struct hashtable *ht,
 	struct nlist *np;
 
 	for (np = ht->hashtab[hash (s, len)]; np; np = np->next) {
-		if (strncmp (s, np->name, len) == 0)
+		if (strncmp (s, np->name, len) == 0 &&
+		    strlen (np->name) <= len)
 			return np;
 	}
 	return NULL;
@@ -2,7 +2,7 @@
  * security.c: Routines to aid secure uid operations 
  *  
  * Copyright (C) 1994, 1995 Graeme W. Wilford. (Wilf.)
- * Copyright (C) 2001, 2003, 2004, 2007, 2010, 2011 Colin Watson.
+ * Copyright (C) 2001, 2003, 2004, 2007, 2010, 2011, 2013 Colin Watson.
  *
  * This file is part of man-db.
  *
@@ -150,6 +150,21 @@ void regain_effective_privs (void)
 #endif /* SECURE_MAN_UID */
 }
 
+/* Drop privileges for good, in a process that will never need them again.
+ * Any later drop_effective_privs and regain_effective_privs calls are then
+ * no-ops.
+ */
+void drop_privs_permanently (void)
+{
+#ifdef SECURE_MAN_UID
+	debug ("drop_privs_permanently()\n");
+	if (idpriv_drop ())
+		gripe_set_euid ();
+	uid = euid = ruid;
+	priv_drop_count = 0;
+#endif /* SECURE_MAN_UID */
+}
+
 #ifdef SECURE_MAN_UID
 void do_system_drop_privs_child (void *data)
 {
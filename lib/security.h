@@ -27,6 +27,7 @@
 /* security.c */
 extern void drop_effective_privs (void);
 extern void regain_effective_privs (void);
+extern void drop_privs_permanently (void);
 extern int do_system_drop_privs (struct pipeline *p);
 extern void init_security (void);
 extern int running_setuid (void);
@@ -0,0 +1,119 @@
+/*
+ * stats.c: performance statistics
+ *
+ * Copyright (C) 2013 Colin Watson.
+ *
+ * This file is part of man-db.
+ *
+ * man-db is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * man-db is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with man-db; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Counters are always kept, since they cost next to nothing.  Timing
+ * needs a couple of system calls at every change of phase, so it is only
+ * done once stats_start() has been called.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <string.h>
+#include <time.h>
+#include <sys/time.h>
+
+#include "stats.h"
+
+unsigned long stats_count[STATS_COUNTERS];
+
+static int timing;
+static enum stats_phase current = STATS_OTHER;
+static double wall[STATS_PHASES], cpu[STATS_PHASES];
+static struct timeval last_wall;
+static clock_t last_cpu;
+
+static const char * const phase_names[STATS_PHASES] = {
+	"other", "scan", "ult_src", "find_name", "dbstore", "purge",
+	"straycats", "reorganize"
+};
+
+static const char * const counter_names[STATS_COUNTERS] = {
+	"files", "whatis_hits", "whatis_misses", "pipelines",
+	"bytes_decompressed", "db_fetches", "db_stores"
+};
+
+/* Charge the time since the last change of phase to the current one. */
+static void charge (void)
+{
+	struct timeval now_wall;
+	clock_t now_cpu;
+
+	gettimeofday (&now_wall, NULL);
+	now_cpu = clock ();
+	wall[current] += (now_wall.tv_sec - last_wall.tv_sec) +
+			 (now_wall.tv_usec - last_wall.tv_usec) / 1e6;
+	cpu[current] += (double) (now_cpu - last_cpu) / CLOCKS_PER_SEC;
+	last_wall = now_wall;
+	last_cpu = now_cpu;
+}
+
+void stats_start (void)
+{
+	timing = 1;
+	gettimeofday (&last_wall, NULL);
+	last_cpu = clock ();
+}
+
+/* Start charging time to PHASE, and return the phase to go back to. */
+enum stats_phase stats_enter (enum stats_phase phase)
+{
+	enum stats_phase previous = current;
+
+	if (timing && phase != current) {
+		charge ();
+		current = phase;
+	}
+	return previous;
+}
+
+void stats_get (struct stats *stats)
+{
+	if (timing)
+		charge ();
+	memcpy (stats->wall, wall, sizeof wall);
+	memcpy (stats->cpu, cpu, sizeof cpu);
+	memcpy (stats->count, stats_count, sizeof stats_count);
+}
+
+/* Leave in STATS only what has happened since SINCE. */
+void stats_sub (struct stats *stats, const struct stats *since)
+{
+	int i;
+
+	for (i = 0; i < STATS_PHASES; ++i) {
+		stats->wall[i] -= since->wall[i];
+		stats->cpu[i] -= since->cpu[i];
+	}
+	for (i = 0; i < STATS_COUNTERS; ++i)
+		stats->count[i] -= since->count[i];
+}
+
+const char *stats_phase_name (enum stats_phase phase)
+{
+	return phase_names[phase];
+}
+
+const char *stats_counter_name (enum stats_counter counter)
+{
+	return counter_names[counter];
+}
@@ -0,0 +1,66 @@
+/*
+ * stats.h: interface to performance statistics
+ *
+ * Copyright (C) 2013 Colin Watson.
+ *
+ * This file is part of man-db.
+ *
+ * man-db is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * man-db is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with man-db; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* Time is charged to one phase at a time; entering a phase suspends the
+ * one it was entered from.
+ */
+enum stats_phase {
+	STATS_OTHER,		/* anything not covered below */
+	STATS_SCAN,		/* looking through directories for pages */
+	STATS_ULT_SRC,		/* following links to pages' sources */
+	STATS_FIND_NAME,	/* reading pages for their NAME sections */
+	STATS_DBSTORE,		/* storing and deleting database entries */
+	STATS_PURGE,		/* purging entries for missing pages */
+	STATS_STRAYCATS,	/* looking for stray cats */
+	STATS_REORGANIZE,	/* reorganizing databases */
+	STATS_PHASES
+};
+
+enum stats_counter {
+	STATS_FILES,			/* files examined */
+	STATS_WHATIS_HITS,		/* whatis found in the cache */
+	STATS_WHATIS_MISSES,		/* whatis read from the page */
+	STATS_PIPELINES,		/* subprocesses started */
+	STATS_BYTES_DECOMPRESSED,	/* read from decompressors */
+	STATS_DB_FETCHES,
+	STATS_DB_STORES,
+	STATS_COUNTERS
+};
+
+struct stats {
+	double wall[STATS_PHASES];	/* seconds */
+	double cpu[STATS_PHASES];	/* seconds, not including children */
+	unsigned long count[STATS_COUNTERS];
+};
+
+/* stats.c */
+extern unsigned long stats_count[STATS_COUNTERS];
+
+#define STATS_ADD(counter, n)	(stats_count[counter] += (n))
+
+extern void stats_start (void);
+extern enum stats_phase stats_enter (enum stats_phase phase);
+#define stats_leave(previous)	((void) stats_enter (previous))
+extern void stats_get (struct stats *stats);
+extern void stats_sub (struct stats *stats, const struct stats *since);
+extern const char *stats_phase_name (enum stats_phase phase);
+extern const char *stats_counter_name (enum stats_counter counter);
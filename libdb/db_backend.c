@@ -0,0 +1,240 @@
+/*
+ * db_backend.c: choose and dispatch to a database storage backend.
+ *
+ * Copyright (C) 2013 Colin Watson.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* Every backend provides the same set of operations through a struct
+ * mydbm_backend, and each open database remembers the backend it was
+ * opened with.  The default is the backend for the library man-db was
+ * built against; DB_BACKEND in man_db.conf may select another one.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <string.h>
+#include <stdlib.h>
+
+#include "gettext.h"
+#define _(String) gettext (String)
+
+#include "manconfig.h"
+
+#include "error.h"
+#include "stats.h"
+
+#include "mydbm.h"
+
+static const struct mydbm_backend * const backends[] = {
+#ifdef GDBM
+	&gdbm_backend,
+#endif /* GDBM */
+#ifdef NDBM
+	&ndbm_backend,
+#endif /* NDBM */
+#ifdef BTREE
+	&btree_backend,
+#endif /* BTREE */
+	&sst_backend,
+	NULL
+};
+
+#if defined(GDBM)
+#  define DEFAULT_BACKEND	gdbm_backend
+#elif defined(NDBM)
+#  define DEFAULT_BACKEND	ndbm_backend
+#else /* BTREE */
+#  define DEFAULT_BACKEND	btree_backend
+#endif
+
+const struct mydbm_backend *mydbm_backend = &DEFAULT_BACKEND;
+
+struct mydbm_cursor {
+	MYDBM_FILE db;
+	void *handle;		/* the backend's own cursor, if any */
+	datum key;		/* otherwise, the last key returned */
+	int started;
+};
+
+/* Use the backend called NAME for databases opened from now on.  NULL
+ * leaves the current choice alone.
+ */
+void mydbm_select_backend (const char *name)
+{
+	const struct mydbm_backend * const *backend;
+
+	if (!name)
+		return;
+
+	for (backend = backends; *backend; ++backend) {
+		if (STREQ ((*backend)->name, name)) {
+			mydbm_backend = *backend;
+			debug ("using database backend %s\n", name);
+			return;
+		}
+	}
+
+	error (0, 0, _("unknown database backend `%s'; using %s"),
+	       name, mydbm_backend->name);
+}
+
+/* Use whichever backend names its databases like FILE, or leave the
+ * current choice alone if none of them does.
+ */
+void mydbm_select_backend_for_file (const char *file)
+{
+	const struct mydbm_backend * const *backend;
+	size_t file_len = strlen (file), best_len = 0;
+
+	for (backend = backends; *backend; ++backend) {
+		size_t ext_len = strlen ((*backend)->ext);
+
+		if (ext_len > best_len && ext_len <= file_len &&
+		    STREQ (file + file_len - ext_len, (*backend)->ext)) {
+			mydbm_backend = *backend;
+			best_len = ext_len;
+		}
+	}
+}
+
+/* Return the name of the database in the directory PATH. */
+char *mkdbname (const char *path)
+{
+	return appendstr (NULL, path, "/index", mydbm_backend->ext, NULL);
+}
+
+MYDBM_FILE mydbm_open (const char *name, int flags)
+{
+	MYDBM_FILE db;
+	void *handle = NULL;
+
+	/* Readers use the current published generation if there is one.
+	 * If mandb publishes another and removes this one between our
+	 * finding and opening it, look again.
+	 */
+	if ((flags & O_ACCMODE) == O_RDONLY) {
+		char *current = mydbm_current (name);
+		int tries;
+
+		for (tries = 0; current && !handle && tries < 3; ++tries) {
+			char *next;
+
+			handle = mydbm_backend->open (current, flags, DBMODE);
+			if (handle)
+				break;
+			next = mydbm_current (name);
+			if (next && STREQ (next, current)) {
+				free (next);
+				next = NULL;
+			}
+			free (current);
+			current = next;
+		}
+		free (current);
+	}
+
+	if (!handle)
+		handle = mydbm_backend->open (name, flags, DBMODE);
+	if (!handle)
+		return NULL;
+
+	db = XMALLOC (struct mydbm_file);
+	db->backend = mydbm_backend;
+	db->handle = handle;
+	return db;
+}
+
+void mydbm_close (MYDBM_FILE db)
+{
+	if (!db)
+		return;
+
+	db->backend->close (db->handle);
+	free (db);
+}
+
+datum mydbm_fetch (MYDBM_FILE db, datum key)
+{
+	STATS_ADD (STATS_DB_FETCHES, 1);
+	return db->backend->fetch (db->handle, key);
+}
+
+int mydbm_store (MYDBM_FILE db, datum key, datum cont, int replace)
+{
+	STATS_ADD (STATS_DB_STORES, 1);
+	return db->backend->store (db->handle, key, cont, replace);
+}
+
+void mydbm_reorganize (MYDBM_FILE db)
+{
+	if (db->backend->reorganize) {
+		enum stats_phase previous = stats_enter (STATS_REORGANIZE);
+		db->backend->reorganize (db->handle);
+		stats_leave (previous);
+	}
+}
+
+/* Walk every key in DB and its content, in key order. */
+struct mydbm_cursor *mydbm_cursor_open (MYDBM_FILE db)
+{
+	struct mydbm_cursor *cursor = XZALLOC (struct mydbm_cursor);
+
+	cursor->db = db;
+	if (db->backend->cursor_open)
+		cursor->handle = db->backend->cursor_open (db->handle);
+	return cursor;
+}
+
+/* Fill in KEY and CONT, which the caller must free, and return 0; or
+ * return non-zero once there are no more keys.
+ */
+int mydbm_cursor_next (struct mydbm_cursor *cursor, datum *key, datum *cont)
+{
+	MYDBM_FILE db = cursor->db;
+	datum nextkey;
+
+	if (cursor->handle)
+		return db->backend->cursor_next (cursor->handle, key, cont);
+
+	if (!cursor->started) {
+		nextkey = MYDBM_FIRSTKEY (db);
+		cursor->started = 1;
+	} else if (MYDBM_DPTR (cursor->key)) {
+		nextkey = MYDBM_NEXTKEY (db, cursor->key);
+		MYDBM_FREE (MYDBM_DPTR (cursor->key));
+	} else
+		return 1;
+
+	cursor->key = nextkey;
+	if (!MYDBM_DPTR (nextkey))
+		return 1;
+
+	*key = copy_datum (nextkey);
+	*cont = MYDBM_FETCH (db, nextkey);
+	return 0;
+}
+
+void mydbm_cursor_close (struct mydbm_cursor *cursor)
+{
+	if (cursor->handle)
+		cursor->db->backend->cursor_close (cursor->handle);
+	else if (MYDBM_DPTR (cursor->key))
+		MYDBM_FREE (MYDBM_DPTR (cursor->key));
+	free (cursor);
+}
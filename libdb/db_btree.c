@@ -29,6 +29,7 @@
 #ifdef BTREE
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <errno.h>
 #include <string.h>
 
@@ -50,7 +51,7 @@
 #include "mydbm.h"
 #include "db_storage.h"
 
-struct hashtable *loop_check_hash;
+static struct hashtable *loop_check_hash;
 
 /* the Berkeley database libraries do nothing to arbitrate between concurrent
    database accesses, so we do a simple flock(). If the db is opened in
@@ -58,27 +59,19 @@ struct hashtable *loop_check_hash;
    lock is shared. A file cannot have both locks at once, and the non
    blocking method is used ": Try again". This adopts GNU dbm's approach. */
 
-#ifdef FAST_BTREE
-#define B_FLAGS		R_DUP 	/* R_DUP: allow duplicates in tree */
-
-void test_insert (int line, const datum key, const datum cont)
-{
-	debug ("(%d) key: \"%s\", cont: \"%.40s\"\n",
-	       line, MYDBM_DPTR (key), MYDBM_DPTR (cont));
-}
-#else /* !FAST_BTREE */
 #define B_FLAGS		0	/* do not allow any duplicate keys */
-#endif /* FAST_BTREE */
 
 /* release the lock and close the database */
-int btree_close (DB *db)
+static void btree_close (void *handle)
 {
+	DB *db = handle;
+
 	(void) flock ((db->fd) (db), LOCK_UN);
-	return (db->close) (db);
+	(db->close) (db);
 }
 
 /* open a btree type database, with file locking. */
-DB *btree_flopen (char *filename, int flags, int mode)
+static void *btree_flopen (const char *filename, int flags, int mode)
 {
 	DB *db;
 	BTREEINFO b;
@@ -151,27 +144,25 @@ DB *btree_flopen (char *filename, int flags, int mode)
 	return db;
 }
 
-/* do a replace when we have the duplicate flag set on the database -
-   we must do a del and insert, as a direct insert will not wipe out the
-   old entry */
-int btree_replace (DB *db, datum key, datum cont)
+static int btree_store (void *handle, datum key, datum cont, int replace)
 {
-#ifdef FAST_BTREE
-	test_insert (__LINE__, key, cont);
-	return (db->put) (db, (DBT *) &key, (DBT *) &cont, R_CURSOR);
-#else /* normal BTREE */
-	return (db->put) (db, (DBT *) &key, (DBT *) &cont, 0);
-#endif /* FAST_BTREE */
+	DB *db = handle;
+
+	return (db->put) (db, (DBT *) &key, (DBT *) &cont,
+			  replace ? 0 : R_NOOVERWRITE);
 }
 
-int btree_insert (DB *db, datum key, datum cont)
+static int btree_delete (void *handle, datum key)
 {
-	return (db->put) (db, (DBT *) &key, (DBT *) &cont, R_NOOVERWRITE);
+	DB *db = handle;
+
+	return (db->del) (db, (DBT *) &key, 0) ? -1 : 0;
 }
 
 /* generic fetch routine for the btree database */
-datum btree_fetch (DB *db, datum key)
+static datum btree_fetch (void *handle, datum key)
 {
+	DB *db = handle;
 	datum data;
 
 	memset (&data, 0, sizeof data);
@@ -185,8 +176,9 @@ datum btree_fetch (DB *db, datum key)
 }
 
 /* return 1 if the key exists, 0 otherwise */
-int btree_exists (DB *db, datum key)
+static int btree_exists (void *handle, datum key)
 {
+	DB *db = handle;
 	datum data;
 	return ((db->get) (db, (DBT *) &key, (DBT *) &data, 0) ? 0 : 1);
 }
@@ -232,7 +224,7 @@ static inline datum btree_findkey (DB *db, u_int flags)
 }
 
 /* return the first key in the db */
-datum btree_firstkey (DB *db)
+static datum btree_firstkey (void *db)
 {
 	return btree_findkey (db, R_FIRST);
 }
@@ -241,17 +233,38 @@ datum btree_firstkey (DB *db)
    has been previously set by btree_firstkey() since it was last opened. So
    if we close/reopen a db mid search, we have to manually set up the
    cursor again. */
-datum btree_nextkey (DB *db)
+static datum btree_nextkey (void *db, datum key ATTRIBUTE_UNUSED)
 {
 	return btree_findkey (db, R_NEXT);
 }
 
+/* The tree keeps its own position, so a cursor only needs to remember
+ * whether it has started yet.
+ */
+struct btree_cursor {
+	DB *db;
+	u_int flags;
+};
+
+static void *btree_cursor_open (void *db)
+{
+	struct btree_cursor *cursor = XMALLOC (struct btree_cursor);
+
+	cursor->db = db;
+	cursor->flags = R_FIRST;
+	return cursor;
+}
+
 /* compound nextkey routine, initialising key and content */
-int btree_nextkeydata (DB *db, datum *key, datum *cont)
+static int btree_cursor_next (void *handle, datum *key, datum *cont)
 {
+	struct btree_cursor *cursor = handle;
+	DB *db = cursor->db;
 	int status;
 
-	if ((status = (db->seq) (db, (DBT *) key, (DBT *) cont, R_NEXT)) != 0)
+	status = (db->seq) (db, (DBT *) key, (DBT *) cont, cursor->flags);
+	cursor->flags = R_NEXT;
+	if (status != 0)
 		return status;
 
 	*key = copy_datum (*key);
@@ -260,135 +273,30 @@ int btree_nextkeydata (DB *db, datum *key, datum *cont)
 	return 0;
 }
 
-#ifdef FAST_BTREE
-
-/* EXTREMELY experimental and broken code, leave well alone for the time
-   being */
-
-#define free(x)
-
-void gripe_get (int lineno)
+static void btree_cursor_close (void *cursor)
 {
-	error (0, 0, "Oops, bad fetch, line %d ", lineno);
+	free (cursor);
 }
 
-/* the simplified storage routine */
-int dbstore (struct mandata *in, char *base)
-{
-	datum key, cont;
-	int status;
-
-	memset (&key, 0, sizeof key);
-	memset (&cont, 0, sizeof cont);
-
-	MYDBM_SET (key, base);
- 	if (!*base) {
-		dbprintf (in);
- 		return 2;
- 	}
-
-	/* initialise the cursor to (possibly) our key/cont */
-	status = (dbf->seq) (dbf, (DBT *) &key, (DBT *) &cont, R_CURSOR);
-
-	if (status == -1)
-		gripe_get (__LINE__);
-
-	/* either nothing was found or the key was not an exact match */
-	else if (status == 1 || !STREQ (MYDBM_DPTR (key), base)) {
-		cont = make_content (in);
-		MYDBM_SET (key, base);
-		test_insert (__LINE__, key, cont);
-		status = (dbf->put) (dbf, (DBT *) &key, (DBT *) &cont, 0);
-		free (MYDBM_DPTR (cont));
-
-	/* There is already a key with this name */
-	} else {
-		/* find an exact match and see if it needs replacing or put
-		   our new key in */
-		while (1) {
-			struct mandata old;
-
-			/* TODO: what if cont is unset? */
-			cont = copy_datum (cont);
-			split_content (MYDBM_DPTR (cont), &old);
-			if (STREQ (in->ext, old.ext)) {
-				cont = make_content (in);
-				status = replace_if_necessary (in, &old,
-							       key, cont);
-				free (MYDBM_DPTR (cont));
-				free_mandata_elements (&old);
-				break;
-			}
-			free_mandata_elements (&old);
-			status = (dbf->seq) (dbf, (DBT *) &key, (DBT *) &cont,
-					     R_NEXT);
-			if (!STREQ (MYDBM_DPTR (key), base)) {
-				MYDBM_SET (key, base);
-				cont = make_content (in);
-				test_insert (__LINE__, key, cont);
-				status = (dbf->put) (dbf, (DBT *) &key,
-						     (DBT *) &cont, 0);
-				free (MYDBM_DPTR (cont));
-				break;
-			}
-		}
-	}
-
-	return status;
-}
-
-/* FIXME: I'm broken as I don't return properly */
-static struct mandata *dblookup (char *page, char *section, int flags)
-{
-	struct mandata *info, *ret = NULL, **null_me;
-	datum key, cont;
-	int status;
-
-	memset (&key, 0, sizeof key);
-	memset (&cont, 0, sizeof cont);
-
-	MYDBM_SET (key, page);
-
-	/* initialise the cursor to (possibly) our key/cont */
-	status = (dbf->seq) (dbf, (DBT *) &key, (DBT *) &cont, R_CURSOR);
-
-	/* either nothing was found or the key was not an exact match */
-	if (status == 1 || !STREQ (page, MYDBM_DPTR (key)))
-		return NULL;
-	if (status == -1)
-		gripe_get (__LINE__);
-
-	ret = info = infoalloc ();
-	null_me = &(info->next);
-
-	do {
-		/* TODO: what if cont is unset? */
-		cont = copy_datum (cont);
-		split_content (MYDBM_DPTR (cont), info);
-
-		if (!(section == NULL ||
-		    STRNEQ (section, info->ext,
-		    	    flags & EXACT ? strlen (info->ext)
-					  : strlen (section)))) {
-			free_mandata_elements (info);
-		} else {
-			null_me = &(info->next);
-			info = info->next = infoalloc ();
-		}
-
-		/* get next in the db */
-		status = (dbf->seq) (dbf, (DBT *) &key, (DBT *) &cont, R_NEXT);
-
-		if (status == -1)
-			gripe_get (__LINE__);
-
-		/* run out of identical keys */
-	} while (!(status == 1 || !STREQ (page, MYDBM_DPTR (key))));
-
-	free (info);
-	*null_me = NULL;
-	return ret;
-}
+static const char * const btree_files[] = { "", NULL };
+
+const struct mydbm_backend btree_backend = {
+	"btree", ".bt", btree_files,
+	btree_flopen,
+	btree_close,
+	btree_fetch,
+	btree_store,
+	btree_delete,
+	btree_exists,
+	btree_firstkey,
+	btree_nextkey,
+	btree_firstkey,
+	btree_nextkey,
+	NULL,
+	btree_cursor_open,
+	btree_cursor_next,
+	btree_cursor_close,
+	0
+};
 
-#endif /* FAST_BTREE */
 #endif /* BTREE */
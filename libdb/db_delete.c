@@ -44,11 +44,11 @@
    Again, 3 possibilities:
 
    1) page is singular reference, just delete it :)
-   2) page has 2+ companions. Delete page and alter multi entry to not
-      point to it anymore.
-   3) page has 1 companion. Could do as (2), but we'd waste an entry in
-      the db. Should delete page, extract friend and reinsert as singular,
-      overwriting the old multi entry.
+   2) page has 2+ companions. Delete page and rewrite the key's content
+      without it.
+   3) page has 1 companion. Could do as (2), but we'd waste space in the
+      db. Should delete page, and store friend as singular, overwriting
+      the old multiple content.
 */
 
 #define NO_ENTRY	1;
@@ -70,76 +70,51 @@ int dbdelete (const char *name, struct mandata *info)
 	if (!MYDBM_DPTR (cont)) {			/* 0 entries */
 		free (MYDBM_DPTR (key));
 		return NO_ENTRY;
-	} else if (*MYDBM_DPTR (cont) != '\t') {	/* 1 entry */
+	} else if (*MYDBM_DPTR (cont) != MULTI_MAGIC &&
+		   *MYDBM_DPTR (cont) != '\t') {		/* 1 entry */
 		MYDBM_DELETE (dbf, key);
 		MYDBM_FREE (MYDBM_DPTR (cont));
 	} else {					/* 2+ entries */
-		char **names, **ext;
-		char *multi_content = NULL;
-		datum multi_key;
-		int refs, i, j;
-
-		/* Extract all of the extensions associated with
-		   this key */
-
-		refs = list_extensions (MYDBM_DPTR (cont) + 1, &names, &ext);
-
-		for (i = 0; i < refs; ++i)
-			if (STREQ (names[i], name) &&
-			    STREQ (ext[i], info->ext))
-				break;
-
-		if (i >= refs) {
-			free (names);
-			free (ext);
-			MYDBM_FREE (MYDBM_DPTR (cont));
-			free (MYDBM_DPTR (key));
-			return NO_ENTRY;
+		struct mandata *list, *entry, **entries;
+		size_t refs = 0;
+		int found = 0, multi;
+
+		/* Extract all of the entries held by this key, except
+		   for the one we're deleting */
+
+		list = split_key_content (MYDBM_DPTR (key), MYDBM_DPTR (cont),
+					  MYDBM_DSIZE (cont), &multi);
+		for (entry = list; entry; entry = entry->next)
+			++refs;
+		entries = XNMALLOC (refs, struct mandata *);
+
+		refs = 0;
+		for (entry = list; entry; entry = entry->next) {
+			if (!found &&
+			    STREQ (entry->name ? entry->name
+					       : MYDBM_DPTR (key), name) &&
+			    STREQ (entry->ext, info->ext))
+				found = 1;
+			else
+				entries[refs++] = entry;
 		}
 
-		multi_key = make_multi_key (names[i], ext[i]);
-		if (!MYDBM_EXISTS (dbf, multi_key)) {
-			error (0, 0,
-			       _( "multi key %s does not exist"),
-			       MYDBM_DPTR (multi_key));
-			gripe_corrupt_data ();
-		}
-		MYDBM_DELETE (dbf, multi_key);
-		free (MYDBM_DPTR (multi_key));
-
-		/* refs *may* be 1 if all manual pages with this name
-		   have been deleted. In this case, we'll have to remove
-		   the key too */
-
-		if (refs == 1) {
-			free (names);
-			free (ext);
-			MYDBM_FREE (MYDBM_DPTR (cont));
-			MYDBM_DELETE (dbf, key);
+		if (!found) {
+			free (entries);
+			free_mandata_struct (list);
 			free (MYDBM_DPTR (key));
-			return 0;
+			return NO_ENTRY;
 		}
 
-		/* create our new multi content */
-		for (j = 0; j < refs; ++j)
-			if (i != j)
-				multi_content = appendstr (multi_content,
-							   "\t", names[j],
-							   "\t", ext[j], NULL);
-
-		MYDBM_FREE (MYDBM_DPTR (cont));
-
-		/* if refs = 2 do something else. Doesn't really matter as
-		   the gdbm db file does not shrink any after a deletion
-		   anyway */
-
-		MYDBM_SET (cont, multi_content);
+		/* refs *may* be 0 if all manual pages with this name
+		   have been deleted. In this case, store_key_content()
+		   removes the key too */
 
-		if (MYDBM_REPLACE (dbf, key, cont))
-			gripe_replace_key (MYDBM_DPTR (key));
+		store_key_content (MYDBM_DPTR (key), entries, refs,
+				   multi ? list : NULL);
 
-		free (names);
-		free (ext);
+		free (entries);
+		free_mandata_struct (list);
 	}
 
 	free (MYDBM_DPTR (key));
@@ -38,6 +38,20 @@
 
 #include "mydbm.h"
 
+#ifndef HAVE_GDBM_EXISTS
+extern inline int gdbm_exists (GDBM_FILE db, datum key);
+#endif /* !HAVE_GDBM_EXISTS */
+
+#define BLK_SIZE	0  /* to invoke normal fs block size */
+
+/* gdbm_nextkey() is not lexicographically sorted, so we need to keep the
+ * filename around to use as a hash key.
+ */
+typedef struct {
+	char *name;
+	GDBM_FILE file;
+} *man_gdbm_wrapper;
+
 static struct hashtable *parent_sortkey_hash;
 
 struct sortkey {
@@ -64,7 +78,7 @@ static void trap_error (const char *val)
 		fprintf (stderr, "gdbm fatal: %s\n", val);
 }
 
-man_gdbm_wrapper man_gdbm_open_wrapper (const char *name, int flags)
+static man_gdbm_wrapper man_gdbm_open_wrapper (const char *name, int flags)
 {
 	man_gdbm_wrapper wrap;
 	GDBM_FILE file;
@@ -87,7 +101,7 @@ man_gdbm_wrapper man_gdbm_open_wrapper (const char *name, int flags)
 		 */
 		memset (&key, 0, sizeof key);
 		MYDBM_SET (key, xstrdup (VER_KEY));
-		content = MYDBM_FETCH (wrap, key);
+		content = gdbm_fetch (wrap->file, key);
 		free (MYDBM_DPTR (key));
 		free (MYDBM_DPTR (content));
 	}
@@ -146,7 +160,7 @@ static datum empty_datum = { NULL, 0 };
  * so that both sequential access and random access are quick. This is
  * necessary for a reasonable ordered implementation of nextkey.
  */
-datum man_gdbm_firstkey (man_gdbm_wrapper wrap)
+static datum man_gdbm_firstkey (man_gdbm_wrapper wrap)
 {
 	struct hashtable *sortkey_hash;
 	struct sortkey **keys, *firstkey;
@@ -202,7 +216,7 @@ datum man_gdbm_firstkey (man_gdbm_wrapper wrap)
 		return empty_datum; /* dptr is NULL, so no copy needed */
 }
 
-datum man_gdbm_nextkey (man_gdbm_wrapper wrap, datum key)
+static datum man_gdbm_nextkey (man_gdbm_wrapper wrap, datum key)
 {
 	struct hashtable *sortkey_hash;
 	struct sortkey *sortkey;
@@ -222,7 +236,7 @@ datum man_gdbm_nextkey (man_gdbm_wrapper wrap, datum key)
 	return copy_datum (sortkey->next->key);
 }
 
-void man_gdbm_close (man_gdbm_wrapper wrap)
+static void man_gdbm_close (man_gdbm_wrapper wrap)
 {
 	if (!wrap)
 		return;
@@ -258,4 +272,91 @@ int gdbm_exists (GDBM_FILE file, datum key)
 
 #endif /* !HAVE_GDBM_EXISTS */
 
+static void *gdbm_backend_open (const char *name, int flags,
+				int mode ATTRIBUTE_UNUSED)
+{
+	int gdbm_flags;
+
+	if (flags & O_TRUNC)
+		gdbm_flags = GDBM_NEWDB | GDBM_FAST;
+	else if (flags & O_CREAT)
+		gdbm_flags = GDBM_WRCREAT | GDBM_FAST;
+	else if ((flags & O_ACCMODE) != O_RDONLY)
+		gdbm_flags = GDBM_WRITER | GDBM_FAST;
+	else
+		gdbm_flags = GDBM_READER;
+
+	return man_gdbm_open_wrapper (name, gdbm_flags);
+}
+
+static void gdbm_backend_close (void *db)
+{
+	man_gdbm_close (db);
+}
+
+static datum gdbm_backend_fetch (void *db, datum key)
+{
+	return gdbm_fetch (((man_gdbm_wrapper) db)->file, key);
+}
+
+static int gdbm_backend_store (void *db, datum key, datum cont, int replace)
+{
+	return gdbm_store (((man_gdbm_wrapper) db)->file, key, cont,
+			   replace ? GDBM_REPLACE : GDBM_INSERT);
+}
+
+static int gdbm_backend_delete (void *db, datum key)
+{
+	return gdbm_delete (((man_gdbm_wrapper) db)->file, key);
+}
+
+static int gdbm_backend_exists (void *db, datum key)
+{
+	return gdbm_exists (((man_gdbm_wrapper) db)->file, key);
+}
+
+static datum gdbm_backend_firstkey (void *db)
+{
+	return man_gdbm_firstkey (db);
+}
+
+static datum gdbm_backend_nextkey (void *db, datum key)
+{
+	return man_gdbm_nextkey (db, key);
+}
+
+static datum gdbm_backend_raw_firstkey (void *db)
+{
+	return gdbm_firstkey (((man_gdbm_wrapper) db)->file);
+}
+
+static datum gdbm_backend_raw_nextkey (void *db, datum key)
+{
+	return gdbm_nextkey (((man_gdbm_wrapper) db)->file, key);
+}
+
+static void gdbm_backend_reorganize (void *db)
+{
+	gdbm_reorganize (((man_gdbm_wrapper) db)->file);
+}
+
+static const char * const gdbm_files[] = { "", NULL };
+
+const struct mydbm_backend gdbm_backend = {
+	"gdbm", ".db", gdbm_files,
+	gdbm_backend_open,
+	gdbm_backend_close,
+	gdbm_backend_fetch,
+	gdbm_backend_store,
+	gdbm_backend_delete,
+	gdbm_backend_exists,
+	gdbm_backend_firstkey,
+	gdbm_backend_nextkey,
+	gdbm_backend_raw_firstkey,
+	gdbm_backend_raw_nextkey,
+	gdbm_backend_reorganize,
+	NULL, NULL, NULL,
+	0
+};
+
 #endif /* GDBM */
@@ -0,0 +1,468 @@
+/*
+ * db_generation.c: publish databases as immutable generations.
+ *
+ * Copyright (C) 2013 Colin Watson.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* Nothing ever writes to a published database.  Writers build a private
+ * copy and publish it as a new generation: its files are linked to NAME.N
+ * (e.g. index.db.7, or index.7.dir and index.7.pag), the generation number
+ * is written to NAME.current and renamed into place, and then NAME itself
+ * is replaced with another link to the same files for the benefit of
+ * anything that opens it directly.  Writers publish one at a time, under
+ * a lock on NAME.lock.  Readers follow NAME.current, so they never contend
+ * for a lock with a writer and always see every file of a single
+ * generation, even for backends that use more than one file.
+ *
+ * A generation is only trusted while NAME still refers to it; if NAME has
+ * been removed or replaced by something other than mandb, readers use
+ * NAME as it stands.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <stdio.h>
+#include <ctype.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/file.h> /* for flock() */
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#if HAVE_FCNTL_H
+#  include <fcntl.h>
+#endif
+
+#include "gettext.h"
+#define _(String) gettext (String)
+
+#include "manconfig.h"
+
+#include "dirname.h"
+#include "error.h"
+#include "xvasprintf.h"
+
+#include "mydbm.h"
+
+/* Return the generation named by NAME.current, or 0 if there is none. */
+static unsigned long read_generation (const char *name)
+{
+	char *current = appendstr (NULL, name, ".current", NULL);
+	FILE *fp;
+	unsigned long gen = 0;
+
+	fp = fopen (current, "r");
+	if (fp) {
+		if (fscanf (fp, "%lu", &gen) != 1)
+			gen = 0;
+		fclose (fp);
+	}
+	free (current);
+	return gen;
+}
+
+static char *generation_name (const char *name, unsigned long gen)
+{
+	return xasprintf ("%s.%lu", name, gen);
+}
+
+/* Return the files making up the database called BASE, as a
+ * NULL-terminated array to be freed with free_names().
+ */
+static char **file_names (const struct mydbm_backend *backend,
+			  const char *base)
+{
+	const char * const *suffix;
+	char **names;
+	size_t n = 0;
+
+	for (suffix = backend->files; *suffix; ++suffix)
+		++n;
+	names = XNMALLOC (n + 1, char *);
+	for (n = 0, suffix = backend->files; *suffix; ++suffix)
+		names[n++] = appendstr (NULL, base, *suffix, NULL);
+	names[n] = NULL;
+	return names;
+}
+
+static void free_names (char **names)
+{
+	char **name;
+
+	for (name = names; *name; ++name)
+		free (*name);
+	free (names);
+}
+
+static void remove_files (char **names)
+{
+	char **name;
+
+	for (name = names; *name; ++name)
+		unlink (*name);
+}
+
+/* Return the name to open in order to read the current generation of the
+ * database called NAME, or NULL if NAME should be opened directly.
+ */
+char *mydbm_current (const char *name)
+{
+	unsigned long gen = read_generation (name);
+	char *current, *gen_file, *name_file;
+	struct stat gen_st, name_st;
+	int ok;
+
+	if (!gen)
+		return NULL;
+
+	current = generation_name (name, gen);
+	gen_file = appendstr (NULL, current, mydbm_backend->files[0], NULL);
+	name_file = appendstr (NULL, name, mydbm_backend->files[0], NULL);
+	ok = stat (gen_file, &gen_st) == 0 && stat (name_file, &name_st) == 0 &&
+	     gen_st.st_dev == name_st.st_dev &&
+	     gen_st.st_ino == name_st.st_ino;
+	free (name_file);
+	free (gen_file);
+
+	if (!ok) {
+		debug ("%s is not generation %lu; ignoring it\n", name, gen);
+		free (current);
+		return NULL;
+	}
+	return current;
+}
+
+/* Copy FROM to TO, returning 0 on success (or if FROM does not exist) or
+ * -errno on failure.
+ */
+static int copy_file (const char *from, const char *to)
+{
+	FILE *ifp, *ofp;
+	int ret = 0;
+
+	ifp = fopen (from, "r");
+	if (!ifp) {
+		ret = -errno;
+		if (errno == ENOENT)
+			return 0;
+		error (0, errno, _("can't open %s"), from);
+		return ret;
+	}
+
+	ofp = fopen (to, "w");
+	if (!ofp) {
+		ret = -errno;
+		error (0, errno, _("can't open %s"), to);
+		fclose (ifp);
+		return ret;
+	}
+
+	while (!feof (ifp) && !ferror (ifp)) {
+		char buf[32 * 1024];
+		size_t in = fread (buf, 1, sizeof (buf), ifp);
+		if (in > 0) {
+			if (fwrite (buf, 1, in, ofp) == 0 && ferror (ofp)) {
+				ret = -errno;
+				error (0, errno, _("can't write to %s"), to);
+				break;
+			}
+		} else if (ferror (ifp)) {
+			ret = -errno;
+			error (0, errno, _("can't read from %s"), from);
+			break;
+		}
+	}
+
+	fclose (ifp);
+	if (fclose (ofp) == EOF && !ret) {
+		ret = -errno;
+		error (0, errno, _("can't write to %s"), to);
+	}
+
+	if (ret < 0)
+		unlink (to);
+
+	return ret;
+}
+
+/* Copy the current generation of the database called NAME to a private
+ * database called TMP, ready to be modified and published.  Returns 0 on
+ * success, including when there is nothing to copy, or -errno on failure.
+ */
+int mydbm_copy (const char *name, const char *tmp)
+{
+	char *current = mydbm_current (name);
+	char **from, **to;
+	size_t i;
+	int ret = 0;
+
+	from = file_names (mydbm_backend, current ? current : name);
+	to = file_names (mydbm_backend, tmp);
+	for (i = 0; from[i]; ++i) {
+		ret = copy_file (from[i], to[i]);
+		if (ret < 0) {
+			remove_files (to);
+			break;
+		}
+		if (chmod (to[i], DBMODE) < 0 && errno != ENOENT) {
+			ret = -errno;
+			error (0, errno, _("can't chmod %s"), to[i]);
+			remove_files (to);
+			break;
+		}
+	}
+	free_names (to);
+	free_names (from);
+	free (current);
+	return ret;
+}
+
+/* Remove the files making up the private database called TMP. */
+void mydbm_unlink (const char *tmp)
+{
+	char **names = file_names (mydbm_backend, tmp);
+
+	remove_files (names);
+	free_names (names);
+}
+
+/* Replace TARGET with a link to OLD, or failing that with a copy. */
+static int replace_file (const char *old, const char *target)
+{
+	char *tmp = xasprintf ("%s.%ld.tmp", target, (long) getpid ());
+	int ret = 0;
+
+	unlink (tmp);
+	if (link (old, tmp) < 0 && copy_file (old, tmp) < 0)
+		ret = -1;
+	else if (rename (tmp, target) < 0) {
+		error (0, errno, _("can't rename %s to %s"), tmp, target);
+		unlink (tmp);
+		ret = -1;
+	}
+	free (tmp);
+	return ret;
+}
+
+/* Give the files FROM the names TO, which must not already exist.
+ * link() refuses to replace an existing file, so concurrent writers cannot
+ * publish over each other.  Returns 0 on success, 1 if one of TO already
+ * exists, or -1 on any other error.
+ */
+static int link_files (char **from, char **to)
+{
+	size_t i;
+
+	for (i = 0; from[i]; ++i) {
+		int ret;
+
+		if (link (from[i], to[i]) == 0)
+			continue;
+		if (errno == EEXIST)
+			ret = 1;
+		else if (access (to[i], F_OK) < 0 &&
+			 rename (from[i], to[i]) == 0)
+			/* No hard links here; FROM is about to go away
+			 * anyway.
+			 */
+			continue;
+		else {
+			error (0, errno, _("can't rename %s to %s"),
+			       from[i], to[i]);
+			ret = -1;
+		}
+		while (i--)
+			unlink (to[i]);
+		return ret;
+	}
+	return 0;
+}
+
+/* Take an exclusive lock on NAME.lock, waiting for any other writer that
+ * holds it.  NAME.current itself cannot be locked, since publishing
+ * replaces it.  Returns a descriptor to close in order to release the
+ * lock, or -1 on failure.
+ */
+static int lock_generations (const char *name)
+{
+	char *lock = appendstr (NULL, name, ".lock", NULL);
+	int fd;
+
+	fd = open (lock, O_RDONLY | O_CREAT, DBMODE);
+	if (fd < 0)
+		error (0, errno, _("can't open %s"), lock);
+	else if (flock (fd, LOCK_EX) < 0) {
+		error (0, errno, _("can't lock index cache %s"), lock);
+		close (fd);
+		fd = -1;
+	}
+	free (lock);
+	return fd;
+}
+
+/* Remove every generation of the database called NAME other than KEEP,
+ * such as those left behind by a publisher that died part of the way
+ * through.  Call this with the lock held, so that no other publisher is
+ * part of the way through.
+ */
+static void remove_stale_generations (const char *name, unsigned long keep)
+{
+	char *dir = dir_name (name), *base = base_name (name);
+	size_t base_len = strlen (base);
+	DIR *dirp;
+	struct dirent *entry;
+
+	dirp = opendir (dir);
+	if (!dirp)
+		goto out;
+	while ((entry = readdir (dirp)) != NULL) {
+		const char *p = entry->d_name;
+		const char * const *suffix;
+		unsigned long gen = 0;
+		char *path;
+
+		/* NAME.N followed by one of the backend's suffixes. */
+		if (strncmp (p, base, base_len) || p[base_len] != '.')
+			continue;
+		p += base_len + 1;
+		if (!CTYPE (isdigit, *p))
+			continue;
+		while (CTYPE (isdigit, *p))
+			gen = gen * 10 + (*p++ - '0');
+		for (suffix = mydbm_backend->files; *suffix; ++suffix)
+			if (STREQ (p, *suffix))
+				break;
+		if (!*suffix || gen == keep)
+			continue;
+
+		path = appendstr (NULL, dir, "/", entry->d_name, NULL);
+		debug ("removing stale generation file %s\n", path);
+		unlink (path);
+		free (path);
+	}
+	closedir (dirp);
+out:
+	free (base);
+	free (dir);
+}
+
+/* Publish the private database called TMP as the next generation of the
+ * database called NAME, and remove TMP.  Returns 0 on success or -1 on
+ * failure, in which case the previous generation stays current.
+ *
+ * Publishers hold a lock from reading the current generation until they
+ * have replaced it, so that one finishing late cannot roll NAME.current
+ * back to an older generation than the one it replaces; the last to
+ * publish wins, and removes the generation it replaced.
+ */
+int mydbm_publish (const char *name, const char *tmp)
+{
+	unsigned long old_gen, gen;
+	char **tmp_files = file_names (mydbm_backend, tmp);
+	char **name_files = file_names (mydbm_backend, name);
+	char **gen_files = NULL;
+	char *gen_name = NULL, *current, *current_tmp;
+	FILE *fp;
+	size_t i;
+	int lock_fd = -1;
+	int ret = -1;
+
+	for (i = 0; tmp_files[i]; ++i) {
+		if (chmod (tmp_files[i], DBMODE) < 0) {
+			/* Nothing was written; nothing to publish. */
+			if (errno == ENOENT && i == 0)
+				ret = 0;
+			else
+				error (0, errno, _("can't chmod %s"),
+				       tmp_files[i]);
+			goto out;
+		}
+	}
+
+	lock_fd = lock_generations (name);
+	if (lock_fd < 0)
+		goto out;
+	old_gen = gen = read_generation (name);
+	remove_stale_generations (name, old_gen);
+
+	/* Claim the first unused generation number. */
+	for (;;) {
+		int status;
+
+		++gen;
+		free (gen_name);
+		gen_name = generation_name (name, gen);
+		if (gen_files)
+			free_names (gen_files);
+		gen_files = file_names (mydbm_backend, gen_name);
+
+		status = link_files (tmp_files, gen_files);
+		if (status == 0)
+			break;
+		if (status < 0)
+			goto out;
+	}
+
+	current = appendstr (NULL, name, ".current", NULL);
+	current_tmp = xasprintf ("%s.%ld.tmp", current, (long) getpid ());
+	fp = fopen (current_tmp, "w");
+	if (!fp || fprintf (fp, "%lu\n", gen) < 0 || fclose (fp) == EOF) {
+		error (0, errno, _("can't write to %s"), current_tmp);
+		unlink (current_tmp);
+		remove_files (gen_files);
+	} else if (rename (current_tmp, current) < 0) {
+		error (0, errno, _("can't rename %s to %s"),
+		       current_tmp, current);
+		unlink (current_tmp);
+		remove_files (gen_files);
+	} else {
+		chmod (current, DBMODE);
+		debug ("published %s as generation %lu\n", name, gen);
+		ret = 0;
+		for (i = 0; gen_files[i]; ++i)
+			if (replace_file (gen_files[i], name_files[i]) < 0)
+				ret = -1;
+	}
+	free (current_tmp);
+	free (current);
+
+	if (ret == 0 && old_gen && old_gen != gen) {
+		char *old_name = generation_name (name, old_gen);
+		char **old_files = file_names (mydbm_backend, old_name);
+
+		/* Anyone still reading it has it open already. */
+		remove_files (old_files);
+		free_names (old_files);
+		free (old_name);
+	}
+
+out:
+	if (lock_fd >= 0)
+		close (lock_fd);
+	remove_files (tmp_files);
+	free_names (tmp_files);
+	free_names (name_files);
+	if (gen_files)
+		free_names (gen_files);
+	free (gen_name);
+	return ret;
+}
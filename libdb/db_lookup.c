@@ -67,7 +67,7 @@ datum copy_datum (datum dat)
 
 /* gdbm does locking itself. */
 #if defined(NDBM) || defined(BTREE)
-void gripe_lock (char *filename)
+void gripe_lock (const char *filename)
 {
 	error (0, errno, _("can't lock index cache %s"), filename);
 }
@@ -113,11 +113,13 @@ void dbprintf (const struct mandata *info)
 	       "st_mtime   %ld\n"
 	       "pointer:   %s\n"
 	       "filter:    %s\n"
-	       "whatis:    %s\n\n",
+	       "whatis:    %s\n"
+	       "encoding:  %s\n\n",
 	       dash_if_unset (info->name),
 	       info->ext, info->sec, info->comp,
 	       info->id, (long) info->_st_mtime,
-	       info->pointer, info->filter, info->whatis);
+	       info->pointer, info->filter, info->whatis,
+	       dash_if_unset (info->encoding));
 }
 
 /* Form a multi-style key from page and extension info. The page should
@@ -199,33 +201,217 @@ char **split_data (char *content, char *start[])
 	return start;
 }
 
-/* Parse the db-returned data and put it into a mandata format */
-void split_content (char *cont_ptr, struct mandata *pinfo)
+/* Read a string field of a binary record ending at end, advancing *p past
+ * it.  Each string is stored as its length in base-128 (least significant
+ * group first, with the top bit set on all but the last byte), followed by
+ * the bytes of the string and a terminating NUL, so that it can be used in
+ * place.
+ */
+static const char *record_string (const char **p, const char *end)
 {
-	char *start[FIELDS];
-	char **data;
+	const unsigned char *u = (const unsigned char *) *p;
+	const unsigned char *uend = (const unsigned char *) end;
+	size_t len = 0;
+	int shift = 0;
+	const char *str;
+
+	do {
+		if (u >= uend || shift >= (int) (sizeof len * 8))
+			gripe_corrupt_data ();
+		len |= (size_t) (*u & 0x7f) << shift;
+		shift += 7;
+	} while (*u++ & 0x80);
+
+	str = (const char *) u;
+	if (len >= (size_t) (end - str) || str[len] != '\0')
+		gripe_corrupt_data ();
+	*p = str + len + 1;
+	return str;
+}
 
-	data = split_data (cont_ptr, start);
+static const char *dash_if_empty (const char *str)
+{
+	return *str ? str : "-";
+}
 
-	pinfo->name = copy_if_set (*(data++));
-	pinfo->ext = *(data++);
-	pinfo->sec = *(data++);
-	pinfo->_st_mtime = (time_t) atol (*(data++));	/* time_t format */
-	pinfo->id = **(data++);				/* single char id */
-	pinfo->pointer = *(data++);
-	pinfo->filter = *(data++);
-	pinfo->comp = *(data++);
-	pinfo->whatis = *(data);
+/* Parse a binary record of size bytes; see make_content for the layout. */
+static void split_record (const char *cont_ptr, size_t size,
+			  struct mandata *pinfo)
+{
+	const unsigned char *u = (const unsigned char *) cont_ptr;
+	const char *p = cont_ptr + RECORD_HEADER;
+	const char *end = cont_ptr + size;
+	unsigned long long mtime = 0;
+	const char *name;
+	int i;
+
+	if (size < RECORD_HEADER)
+		gripe_corrupt_data ();
+	pinfo->id = (char) u[1];
+	for (i = 0; i < 8; ++i)
+		mtime = (mtime << 8) | u[2 + i];
+	pinfo->_st_mtime = (time_t) (long long) mtime;
+
+	name = record_string (&p, end);
+	pinfo->name = *name ? xstrdup (name) : NULL;
+	pinfo->ext = record_string (&p, end);
+	pinfo->sec = record_string (&p, end);
+	pinfo->pointer = dash_if_empty (record_string (&p, end));
+	pinfo->filter = dash_if_empty (record_string (&p, end));
+	pinfo->comp = dash_if_empty (record_string (&p, end));
+	pinfo->whatis = record_string (&p, end);
+	if (*cont_ptr == RECORD_MAGIC) {
+		const char *encoding = record_string (&p, end);
+		pinfo->encoding = *encoding ? encoding : NULL;
+	} else
+		pinfo->encoding = NULL;
+}
+
+/* Parse the db-returned data of size bytes and put it into a mandata
+ * format.
+ */
+void split_content (char *cont_ptr, size_t size, struct mandata *pinfo)
+{
+	if (!size)
+		gripe_corrupt_data ();
+	if (*cont_ptr == RECORD_MAGIC || *cont_ptr == RECORD_MAGIC_NOENC)
+		split_record (cont_ptr, size, pinfo);
+	else {
+		/* A text record from a database older than VER_ID. */
+		char *start[FIELDS];
+		char **data;
+
+		if (!memchr (cont_ptr, '\0', size))
+			gripe_corrupt_data ();
+		data = split_data (cont_ptr, start);
+
+		pinfo->name = copy_if_set (*(data++));
+		pinfo->ext = *(data++);
+		pinfo->sec = *(data++);
+		pinfo->_st_mtime = (time_t) atol (*(data++));	/* time_t format */
+		pinfo->id = **(data++);				/* single char id */
+		pinfo->pointer = *(data++);
+		pinfo->filter = *(data++);
+		pinfo->comp = *(data++);
+		pinfo->whatis = *(data);
+		pinfo->encoding = NULL;
+	}
 
 	pinfo->addr = cont_ptr;
 	pinfo->next = (struct mandata *) NULL;
 }
 
-/* The complement of split_content */
-datum make_content (struct mandata *in)
+/* Return the length of the binary record at cont_ptr, which must not run
+ * past end.
+ */
+static size_t record_size (const char *cont_ptr, const char *end)
+{
+	const char *p = cont_ptr + RECORD_HEADER;
+	int fields = RECORD_FIELDS;
+	int i;
+
+	if (end - cont_ptr < RECORD_HEADER)
+		gripe_corrupt_data ();
+	if (*cont_ptr == RECORD_MAGIC_NOENC)
+		--fields;
+	for (i = 0; i < fields; ++i)
+		record_string (&p, end);
+	return p - cont_ptr;
+}
+
+/* Parse the content of a key, size bytes long, into a list of newly
+ * allocated structures, one for each page it holds, taking over cont_ptr.
+ * A name field is only set if the page's name differs from the key.  Where
+ * a key holds several pages, each structure gets its own copy of its
+ * record, so that they can be freed independently.
+ */
+struct mandata *split_content_list (char *cont_ptr, size_t size)
+{
+	struct mandata *ret = NULL, *info = NULL;
+	const char *p, *end = cont_ptr + size;
+
+	if (!size)
+		gripe_corrupt_data ();
+	if (*cont_ptr != MULTI_MAGIC) {
+		ret = infoalloc ();
+		split_content (cont_ptr, size, ret);
+		return ret;
+	}
+
+	for (p = cont_ptr + 1; ; ) {
+		size_t record_len;
+		char *record;
+
+		if (p >= end)
+			gripe_corrupt_data ();
+		if (!*p)
+			break;
+		if (*p != RECORD_MAGIC && *p != RECORD_MAGIC_NOENC)
+			gripe_corrupt_data ();
+		record_len = record_size (p, end);
+		record = xmemdup (p, record_len);
+		p += record_len;
+
+		if (!ret)
+			ret = info = infoalloc ();
+		else
+			info = info->next = infoalloc ();
+		split_content (record, record_len, info);
+	}
+
+	free (cont_ptr);
+	return ret;
+}
+
+static size_t varint_size (size_t len)
+{
+	size_t size = 1;
+
+	while (len >= 0x80) {
+		len >>= 7;
+		++size;
+	}
+	return size;
+}
+
+/* Write a string field in the form read by record_string. */
+static char *put_string (char *p, const char *str, size_t len)
+{
+	size_t rest = len;
+
+	do {
+		unsigned char byte = rest & 0x7f;
+		rest >>= 7;
+		if (rest)
+			byte |= 0x80;
+		*p++ = (char) byte;
+	} while (rest);
+	memcpy (p, str, len);
+	p += len;
+	*p++ = '\0';
+	return p;
+}
+
+/* Encode a binary record, shortening the whatis if necessary so that the
+ * record takes no more than limit bytes (unless limit is zero).
+ *
+ * Records are stored in a compact binary layout so that they can be
+ * parsed in place without any copying: RECORD_MAGIC, the id, and the
+ * mtime as a big-endian 64-bit integer, followed by the name (empty if the
+ * same as the key), extension, section, pointer, filter, compression
+ * extension (each of the last three empty if unset), whatis, and page
+ * encoding (empty if unknown), each in the form read by record_string.
+ */
+static datum make_record (struct mandata *in, size_t limit)
 {
 	datum cont;
 	static const char dash[] = "-";
+	const char *fields[RECORD_FIELDS];
+	size_t lengths[RECORD_FIELDS];
+	size_t size = RECORD_HEADER;
+	unsigned long long mtime;
+	char *p;
+	int i;
 
 	memset (&cont, 0, sizeof cont);
 
@@ -238,28 +424,198 @@ datum make_content (struct mandata *in)
 	if (!in->whatis)
 		in->whatis = dash + 1;
 
-	MYDBM_SET (cont, xasprintf (
-		"%s\t%s\t%s\t%ld\t%c\t%s\t%s\t%s\t%s",
-		dash_if_unset (in->name),
-		in->ext,
-		in->sec,
-		(long) in->_st_mtime,
-		in->id,
-		in->pointer,
-		in->filter,
-		in->comp,
-		in->whatis));
-
-#ifdef NDBM
-	/* limit of 4096 bytes of data using ndbm */
-	if (MYDBM_DSIZE (cont) > 4095) {
-		MYDBM_DPTR (cont)[4095] = '\0';
-		MYDBM_DSIZE (cont) = 4096;
+	fields[0] = in->name ? in->name : "";
+	fields[1] = in->ext;
+	fields[2] = in->sec;
+	fields[3] = STREQ (in->pointer, dash) ? "" : in->pointer;
+	fields[4] = STREQ (in->filter, dash) ? "" : in->filter;
+	fields[5] = STREQ (in->comp, dash) ? "" : in->comp;
+	fields[6] = in->whatis;
+	fields[7] = in->encoding ? in->encoding : "";
+	for (i = 0; i < RECORD_FIELDS; ++i) {
+		lengths[i] = strlen (fields[i]);
+		size += varint_size (lengths[i]) + lengths[i] + 1;
+	}
+
+	while (limit && size > limit && lengths[6]) {
+		size_t excess = size - limit;
+		size_t old = varint_size (lengths[6]) + lengths[6];
+
+		lengths[6] -= excess < lengths[6] ? excess : lengths[6];
+		size -= old - (varint_size (lengths[6]) + lengths[6]);
 	}
-#endif
+
+	p = xmalloc (size);
+	MYDBM_SET_DPTR (cont, p);
+	MYDBM_DSIZE (cont) = size;
+
+	*p++ = RECORD_MAGIC;
+	*p++ = in->id;
+	mtime = (unsigned long long) (long long) in->_st_mtime;
+	for (i = 7; i >= 0; --i)
+		*p++ = (char) ((mtime >> (i * 8)) & 0xff);
+	for (i = 0; i < RECORD_FIELDS; ++i)
+		p = put_string (p, fields[i], lengths[i]);
+
 	return cont;
 }
 
+/* The complement of split_content. */
+datum make_content (struct mandata *in)
+{
+	return make_record (in, MYDBM_MAX_CONTENT (dbf));
+}
+
+/* The complement of split_content_list, for a key holding the n pages in
+ * entries: MULTI_MAGIC, followed by the record for each page in turn and a
+ * terminating NUL.  Nothing is shortened to fit the backend's size limit;
+ * store_key_content deals with content that is too large.
+ */
+datum make_multi_content (struct mandata * const *entries, size_t n)
+{
+	datum cont;
+	datum *records = XNMALLOC (n, datum);
+	size_t size = 2;
+	size_t i;
+	char *p;
+
+	memset (&cont, 0, sizeof cont);
+
+	for (i = 0; i < n; ++i) {
+		records[i] = make_record (entries[i], 0);
+		size += MYDBM_DSIZE (records[i]);
+	}
+
+	p = xmalloc (size);
+	MYDBM_SET_DPTR (cont, p);
+	MYDBM_DSIZE (cont) = size;
+
+	*p++ = MULTI_MAGIC;
+	for (i = 0; i < n; ++i) {
+		memcpy (p, MYDBM_DPTR (records[i]), MYDBM_DSIZE (records[i]));
+		p += MYDBM_DSIZE (records[i]);
+		free (MYDBM_DPTR (records[i]));
+	}
+	*p = '\0';
+
+	free (records);
+	return cont;
+}
+
+/* Parse the content of key, size bytes long, into a list of pages as
+ * split_content_list does, taking over cont_ptr.  A key whose pages were
+ * too many to fit in one record instead lists the multi keys holding them
+ * (see store_key_content), which are fetched in turn; *multi is set if so.
+ */
+struct mandata *split_key_content (const char *key, char *cont_ptr,
+				   size_t size, int *multi)
+{
+	struct mandata *ret = NULL, *info = NULL;
+	char **names, **ext;
+	int refs, i;
+
+	*multi = size && *cont_ptr == '\t';
+	if (!*multi)
+		return split_content_list (cont_ptr, size);
+
+	refs = list_extensions (cont_ptr + 1, &names, &ext);
+	for (i = 0; i < refs; ++i) {
+		datum multi_key, multi_cont;
+
+		multi_key = make_multi_key (names[i], ext[i]);
+		multi_cont = MYDBM_FETCH (dbf, multi_key);
+		if (MYDBM_DPTR (multi_cont) == NULL) {
+			error (0, 0, _("bad fetch on multi key %s"),
+			       MYDBM_DPTR (multi_key));
+			gripe_corrupt_data ();
+		}
+		free (MYDBM_DPTR (multi_key));
+
+		if (!ret)
+			ret = info = infoalloc ();
+		else
+			info = info->next = infoalloc ();
+		split_content (MYDBM_DPTR (multi_cont),
+			       MYDBM_DSIZE (multi_cont), info);
+		if (!info->name && !STREQ (names[i], key))
+			info->name = xstrdup (names[i]);
+	}
+
+	free (names);
+	free (ext);
+	free (cont_ptr);
+	return ret;
+}
+
+/* Store the n pages in entries under key, replacing its previous content,
+ * or delete key if n is zero.  If old is not NULL, it is the list of pages
+ * that key previously held under multi keys (see split_key_content), which
+ * are removed first.
+ *
+ * All of a key's pages normally go in one record, but with enough of them
+ * that would exceed the backend's size limit.  In that case each page is
+ * stored under its own multi key instead, and key holds a tab followed by
+ * the tab-separated names and extensions of those multi keys, as in
+ * databases before 2.6.4.
+ */
+void store_key_content (const char *key, struct mandata * const *entries,
+			size_t n, const struct mandata *old)
+{
+	size_t max = MYDBM_MAX_CONTENT (dbf);
+	datum dkey, cont;
+	size_t i;
+
+	memset (&dkey, 0, sizeof dkey);
+	memset (&cont, 0, sizeof cont);
+
+	for (; old; old = old->next) {
+		dkey = make_multi_key (old->name ? old->name : key, old->ext);
+		MYDBM_DELETE (dbf, dkey);
+		free (MYDBM_DPTR (dkey));
+	}
+
+	MYDBM_SET (dkey, xstrdup (key));
+	if (n == 0) {
+		MYDBM_DELETE (dbf, dkey);
+		free (MYDBM_DPTR (dkey));
+		return;
+	}
+
+	if (n == 1)
+		cont = make_content (entries[0]);
+	else
+		cont = make_multi_content (entries, n);
+
+	if (n > 1 && max && MYDBM_DSIZE (cont) > max) {
+		char *list = xstrdup ("");
+
+		debug ("store_key_content(): %s needs %lu bytes; using "
+		       "multi keys\n", key, (unsigned long) MYDBM_DSIZE (cont));
+		free (MYDBM_DPTR (cont));
+		for (i = 0; i < n; ++i) {
+			const char *name = entries[i]->name ? entries[i]->name
+							    : key;
+			datum multi_key, multi_cont;
+
+			multi_key = make_multi_key (name, entries[i]->ext);
+			multi_cont = make_content (entries[i]);
+			if (MYDBM_REPLACE (dbf, multi_key, multi_cont))
+				gripe_replace_key (MYDBM_DPTR (multi_key));
+			free (MYDBM_DPTR (multi_cont));
+			free (MYDBM_DPTR (multi_key));
+
+			list = appendstr (list, "\t", name, "\t",
+					  entries[i]->ext, NULL);
+		}
+		MYDBM_SET (cont, list);
+	}
+
+	if (MYDBM_REPLACE (dbf, dkey, cont))
+		gripe_replace_key (MYDBM_DPTR (dkey));
+	free (MYDBM_DPTR (cont));
+	free (MYDBM_DPTR (dkey));
+}
+
 /* Extract all of the names/extensions associated with this key. Each case
  * variant of a name will be returned separately.
  *
@@ -303,8 +659,27 @@ int list_extensions (char *data, char ***names, char ***ext)
  1) No data exists, lookup will fail, returned structure will be NULL.
  2) One data item exists. Item is returned as first in set of structures.
  3) Many items exist. They are all returned, in a multiple structure set.
+
+ All items for a name are normally held in the content of its key, so one
+ fetch suffices in each case.  A key with too many items to fit in one
+ record, like every key with several items in databases from before
+ version 2.6.4, instead holds a list of multi keys, each of which must be
+ fetched in turn.
  */
-#ifndef FAST_BTREE
+/* Decide whether a page with this name and extension is suitable. */
+static int lookup_matches (const char *name, const char *ext,
+			   const char *page, const char *section, int flags)
+{
+	if ((flags & MATCH_CASE) && !STREQ (name, page))
+		return 0;
+	if (section == NULL)
+		return 1;
+	if (flags & EXACT)
+		return STREQ (section, ext);
+	else
+		return STRNEQ (section, ext, strlen (section));
+}
+
 static struct mandata *dblookup (const char *page, const char *section,
 				 int flags)
 {
@@ -316,34 +691,49 @@ static struct mandata *dblookup (const char *page, const char *section,
 
 	MYDBM_SET (key, name_to_key (page));
 	cont = MYDBM_FETCH (dbf, key);
-	free (MYDBM_DPTR (key));
 
 	if (MYDBM_DPTR (cont) == NULL) {	/* No entries at all */
+		free (MYDBM_DPTR (key));
 		return info;			/* indicate no entries */
-	} else if (*MYDBM_DPTR (cont) != '\t') {	/* Just one entry */
-		info = infoalloc ();
-		split_content (MYDBM_DPTR (cont), info);
-		if (!info->name)
-			info->name = xstrdup (page);
-		if (!(flags & MATCH_CASE) || STREQ (info->name, page)) {
-			if (section == NULL)
-				return info;
-			if (flags & EXACT) {
-				if (STREQ (section, info->ext))
-					return info;
-			} else {
-				if (STRNEQ (section, info->ext,
-					    strlen (section)))
-					return info;
+	} else if (*MYDBM_DPTR (cont) != '\t') {
+		struct mandata *all, *next, *ret = NULL;
+		int single;
+
+		all = split_content_list (MYDBM_DPTR (cont),
+					  MYDBM_DSIZE (cont));
+		single = all && !all->next;
+		for (; all; all = next) {
+			next = all->next;
+			all->next = NULL;
+
+			/* A single entry without a name field is taken to
+			 * have the requested name; entries sharing a key
+			 * have the key's name unless they say otherwise.
+			 */
+			if (!all->name)
+				all->name = xstrdup (single ? page
+							    : MYDBM_DPTR (key));
+			if (!lookup_matches (all->name, all->ext,
+					     page, section, flags)) {
+				free_mandata_struct (all);
+				continue;
 			}
+
+			if (!ret)
+				ret = info = all;
+			else
+				info = info->next = all;
 		}
-		free_mandata_struct (info);
-		return NULL;
-	} else {				/* multiple entries */
+
+		free (MYDBM_DPTR (key));
+		return ret;
+	} else {				/* old multiple entries */
 		char **names, **ext;
 		struct mandata *ret = NULL;
 		int refs, i;
 
+		free (MYDBM_DPTR (key));
+
 		/* Extract all of the case-variant-names/extensions
 		 * associated with this key.
 		 */
@@ -361,20 +751,10 @@ static struct mandata *dblookup (const char *page, const char *section,
 			 * suitable.
 			 */
 
-			if ((flags & MATCH_CASE) && !STREQ (names[i], page))
+			if (!lookup_matches (names[i], ext[i],
+					     page, section, flags))
 				continue;
 
-			if (section != NULL) {
-				if (flags & EXACT) {
-					if (!STREQ (section, ext[i]))
-						continue;
-				} else {
-					if (!STRNEQ (section, ext[i],
-						     strlen (section)))
-						continue;
-				}
-			}
-
 			/* So the key is suitable ... */
 			key = make_multi_key (names[i], ext[i]);
 			debug ("multi key lookup (%s)\n", MYDBM_DPTR (key));
@@ -392,7 +772,8 @@ static struct mandata *dblookup (const char *page, const char *section,
 				ret = info = infoalloc ();
 			else
 				info = info->next = infoalloc ();
-			split_content (MYDBM_DPTR (multi_cont), info);
+			split_content (MYDBM_DPTR (multi_cont),
+				       MYDBM_DSIZE (multi_cont), info);
 			if (!info->name)
 				info->name = xstrdup (names[i]);
 		}
@@ -403,7 +784,6 @@ static struct mandata *dblookup (const char *page, const char *section,
 		return ret;
 	}
 }
-#endif /* !FAST_BTREE */
 
 struct mandata *dblookup_all (const char *page, const char *section,
 			      int match_case)
@@ -423,6 +803,8 @@ struct mandata *dblookup_pattern (const char *pattern, const char *section,
 {
 	struct mandata *ret = NULL, *tail = NULL;
 	datum key, cont;
+	struct mydbm_cursor *cursor = NULL;
+	char **candidates = NULL, **candidate;
 	regex_t preg;
 
 	if (pattern_regex)
@@ -430,23 +812,28 @@ struct mandata *dblookup_pattern (const char *pattern, const char *section,
 			  REG_EXTENDED | REG_NOSUB |
 			  (match_case ? 0 : REG_ICASE));
 
-#ifndef BTREE
-	datum nextkey;
-
-	key = MYDBM_FIRSTKEY (dbf);
-	while (MYDBM_DPTR (key)) {
-		cont = MYDBM_FETCH (dbf, key);
-#else /* BTREE */
-	int end;
+	/* The trigram index only covers names, not descriptions. */
+	if (!try_descriptions)
+		candidates = dbtrigram_candidates (&pattern, 1,
+						   pattern_regex);
+	candidate = candidates;
+	if (!candidates)
+		cursor = MYDBM_CURSOR_OPEN (dbf);
 
-	end = btree_nextkeydata (dbf, &key, &cont);
-	while (!end) {
-#endif /* !BTREE */
-		struct mandata info;
+	for (;;) {
+		struct mandata *list, *info, *next;
 		char *tab;
-		int got_match;
 
-		memset (&info, 0, sizeof (info));
+		if (candidates) {
+			key = dbtrigram_nextkey (&candidate);
+			if (!MYDBM_DPTR (key))
+				break;
+			cont = MYDBM_FETCH (dbf, key);
+			/* Candidates may be stale. */
+			if (!MYDBM_DPTR (cont))
+				goto nextpage;
+		} else if (MYDBM_CURSOR_NEXT (cursor, &key, &cont))
+			break;
 
 		if (!MYDBM_DPTR (cont))
 		{
@@ -463,68 +850,74 @@ struct mandata *dblookup_pattern (const char *pattern, const char *section,
 		if (*MYDBM_DPTR (cont) == '\t')
 			goto nextpage;
 
-		/* a real page */
+		/* real pages */
 
-		split_content (MYDBM_DPTR (cont), &info);
-
-		/* If there's a section given, does it match either the
-		 * section or extension of this page?
-		 */
-		if (section &&
-		    (!STREQ (section, info.sec) && !STREQ (section, info.ext)))
-			goto nextpage;
+		list = split_content_list (MYDBM_DPTR (cont),
+					   MYDBM_DSIZE (cont));
+		MYDBM_SET_DPTR (cont, NULL); /* owned by list */
 
 		tab = strrchr (MYDBM_DPTR (key), '\t');
 		if (tab) 
 			 *tab = '\0';
 
-		if (!info.name)
-			info.name = xstrdup (MYDBM_DPTR (key));
+		for (info = list; info; info = next) {
+			int got_match;
+
+			next = info->next;
+			info->next = NULL;
+
+			/* If there's a section given, does it match either
+			 * the section or extension of this page?
+			 */
+			if (section && (!STREQ (section, info->sec) &&
+					!STREQ (section, info->ext))) {
+				free_mandata_struct (info);
+				continue;
+			}
+
+			if (!info->name)
+				info->name = xstrdup (MYDBM_DPTR (key));
 
-		if (pattern_regex)
-			got_match = (regexec (&preg, info.name,
-					      0, NULL, 0) == 0);
-		else
-			got_match = fnmatch (pattern, info.name,
-					     match_case ? 0
-							: FNM_CASEFOLD) == 0;
-		if (try_descriptions && !got_match && info.whatis) {
 			if (pattern_regex)
-				got_match = (regexec (&preg, info.whatis,
+				got_match = (regexec (&preg, info->name,
 						      0, NULL, 0) == 0);
 			else
-				got_match = word_fnmatch (pattern,
-							  info.whatis);
-		}
-		if (!got_match)
-			goto nextpage_tab;
+				got_match = fnmatch (pattern, info->name,
+						     match_case ? 0
+								: FNM_CASEFOLD)
+					    == 0;
+			if (try_descriptions && !got_match && info->whatis) {
+				if (pattern_regex)
+					got_match = (regexec (&preg,
+							      info->whatis,
+							      0, NULL, 0)
+						     == 0);
+				else
+					got_match = word_fnmatch
+						(pattern, info->whatis);
+			}
+			if (!got_match) {
+				free_mandata_struct (info);
+				continue;
+			}
 
-		if (!ret)
-			ret = tail = infoalloc ();
-		else
-			tail = tail->next = infoalloc ();
-		memcpy (tail, &info, sizeof (info));
-		info.name = NULL; /* steal memory */
-		MYDBM_SET_DPTR (cont, NULL); /* == info.addr */
+			if (!ret)
+				ret = tail = info;
+			else
+				tail = tail->next = info;
+		}
 
-nextpage_tab:
 		if (tab)
 			*tab = '\t';
 nextpage:
-#ifndef BTREE
-		nextkey = MYDBM_NEXTKEY (dbf, key);
-		MYDBM_FREE (MYDBM_DPTR (cont));
-		MYDBM_FREE (MYDBM_DPTR (key));
-		key = nextkey;
-#else /* BTREE */
 		MYDBM_FREE (MYDBM_DPTR (cont));
 		MYDBM_FREE (MYDBM_DPTR (key));
-		end = btree_nextkeydata (dbf, &key, &cont);
-#endif /* !BTREE */
-		info.addr = NULL;
-		free_mandata_elements (&info);
 	}
 
+	if (cursor)
+		MYDBM_CURSOR_CLOSE (cursor);
+	dbtrigram_free_candidates (candidates);
+
 	if (pattern_regex)
 		regfree (&preg);
 
@@ -0,0 +1,249 @@
+/*
+ * db_merge.c: merge index shards into a single database.
+ *
+ * Copyright (C) 2013 Colin Watson.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* A shard is an ordinary database covering some subset of the pages in a
+ * manual hierarchy, typically those shipped by one package.  Each shard's
+ * keys are read into memory and sorted, and the resulting sorted streams
+ * are merged with a binary heap, so that every entry is passed to
+ * dbstore() in key order.  Equal keys from different shards are taken in
+ * the order the shards were given, and dbstore() resolves collisions
+ * between them exactly as it would if the pages had been found by a scan.
+ * The result depends only on the contents of the shards and their order,
+ * not on how each shard happens to be laid out on disk.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#include "gettext.h"
+#define _(String) gettext (String)
+
+#include "manconfig.h"
+
+#include "error.h"
+
+#include "mydbm.h"
+#include "db_storage.h"
+
+struct shard_entry {
+	char *key;
+	char *content;
+	size_t content_size;
+};
+
+struct shard {
+	struct shard_entry *entries;
+	size_t len, pos;
+};
+
+static int shard_entry_compare (const void *a, const void *b)
+{
+	const struct shard_entry *left = a;
+	const struct shard_entry *right = b;
+
+	return strcmp (left->key, right->key);
+}
+
+/* Read every key and content of the shard database NAME, sorted by key.
+ * Return 0 on success, or non-zero if the shard could not be used.
+ */
+static int shard_read (const char *name, struct shard *shard)
+{
+	MYDBM_FILE file;
+	datum key;
+	size_t max = 0;
+
+	shard->entries = NULL;
+	shard->len = shard->pos = 0;
+
+	file = MYDBM_RDOPEN (name);
+	if (!file) {
+		error (0, errno, _("can't open %s for reading"), name);
+		return 1;
+	}
+	if (dbver_rd (file)) {
+		error (0, 0, _("warning: ignoring shard %s with incompatible "
+			       "version"), name);
+		MYDBM_CLOSE (file);
+		return 1;
+	}
+
+	key = MYDBM_RAW_FIRSTKEY (file);
+	while (MYDBM_DPTR (key) != NULL) {
+		datum content, nextkey;
+
+		content = MYDBM_FETCH (file, key);
+		if (MYDBM_DPTR (content)) {
+			if (shard->len == max) {
+				max = max ? max * 2 : 256;
+				shard->entries = xnrealloc (
+					shard->entries, max,
+					sizeof *shard->entries);
+			}
+			shard->entries[shard->len].key = MYDBM_DPTR (key);
+			shard->entries[shard->len].content =
+				MYDBM_DPTR (content);
+			shard->entries[shard->len].content_size =
+				MYDBM_DSIZE (content);
+			++shard->len;
+		} else
+			debug ("key %s in shard %s has no content\n",
+			       MYDBM_DPTR (key), name);
+
+		nextkey = MYDBM_RAW_NEXTKEY (file, key);
+		if (!MYDBM_DPTR (content))
+			MYDBM_FREE (MYDBM_DPTR (key));
+		key = nextkey;
+	}
+	MYDBM_CLOSE (file);
+
+	qsort (shard->entries, shard->len, sizeof *shard->entries,
+	       shard_entry_compare);
+	debug ("shard %s: %lu keys\n", name, (unsigned long) shard->len);
+	return 0;
+}
+
+static void shard_free (struct shard *shard)
+{
+	size_t i;
+
+	for (i = 0; i < shard->len; ++i) {
+		MYDBM_FREE (shard->entries[i].key);
+		MYDBM_FREE (shard->entries[i].content);
+	}
+	free (shard->entries);
+}
+
+/* Is the head of shard A to be merged before the head of shard B? */
+static int shard_before (const struct shard *shards, size_t a, size_t b)
+{
+	int cmp = strcmp (shards[a].entries[shards[a].pos].key,
+			  shards[b].entries[shards[b].pos].key);
+
+	return cmp < 0 || (cmp == 0 && a < b);
+}
+
+/* Restore the heap property below position I of HEAP, which has LEN
+ * elements.
+ */
+static void heap_down (const struct shard *shards, size_t *heap, size_t len,
+		       size_t i)
+{
+	for (;;) {
+		size_t least = i, child = 2 * i + 1, tmp;
+
+		if (child < len && shard_before (shards, heap[child],
+						 heap[least]))
+			least = child;
+		if (child + 1 < len && shard_before (shards, heap[child + 1],
+						     heap[least]))
+			least = child + 1;
+		if (least == i)
+			break;
+		tmp = heap[i];
+		heap[i] = heap[least];
+		heap[least] = tmp;
+		i = least;
+	}
+}
+
+/* Store the entries held by one key from a shard in dbf, taking over
+ * content, which is size bytes long.
+ */
+static void merge_entry (const char *key, char *content, size_t size)
+{
+	struct mandata *list, *info;
+	char *nicekey, *tab;
+
+	/* Keys may be multi keys (see store_key_content). */
+	nicekey = xstrdup (key);
+	tab = strchr (nicekey, '\t');
+	if (tab)
+		*tab = '\0';
+
+	list = split_content_list (content, size);
+	for (info = list; info; info = info->next) {
+		char *name = info->name ? info->name : xstrdup (nicekey);
+
+		/* dbstore() works out the name field for itself. */
+		info->name = NULL;
+
+		if (dbstore (info, name) > 0)
+			debug ("dbmerge(): conflicting entry for %s(%s) "
+			       "ignored\n", name, info->ext);
+		free (name);
+	}
+	free_mandata_struct (list);
+	free (nicekey);
+}
+
+/* Merge the shard databases named in SHARDS into dbf, which must be open
+ * for writing.  Special keys (other than $mtime$) are not copied, since the
+ * caller will rebuild them.  Return the latest $mtime$ of any of the
+ * shards, or 0 if none of them has one.
+ */
+time_t dbmerge (char * const *shards, size_t n)
+{
+	struct shard *streams = XNMALLOC (n, struct shard);
+	size_t *heap = XNMALLOC (n, size_t);
+	size_t heap_len = 0;
+	time_t latest = 0;
+	size_t i;
+
+	for (i = 0; i < n; ++i) {
+		if (shard_read (shards[i], &streams[i]) == 0 &&
+		    streams[i].len)
+			heap[heap_len++] = i;
+	}
+	for (i = heap_len; i-- > 0; )
+		heap_down (streams, heap, heap_len, i);
+
+	while (heap_len) {
+		struct shard *shard = &streams[heap[0]];
+		struct shard_entry *entry = &shard->entries[shard->pos];
+
+		if (STREQ (entry->key, KEY)) {
+			time_t mtime = (time_t) atol (entry->content);
+			if (mtime > latest)
+				latest = mtime;
+		} else if (*entry->key != '$' && *entry->content != '\t') {
+			/* Old lists of multi keys are rebuilt by dbstore(). */
+			merge_entry (entry->key, entry->content,
+				     entry->content_size);
+			entry->content = NULL;
+		}
+
+		if (++shard->pos == shard->len)
+			heap[0] = heap[--heap_len];
+		heap_down (streams, heap, heap_len, 0);
+	}
+
+	for (i = 0; i < n; ++i)
+		shard_free (&streams[i]);
+	free (heap);
+	free (streams);
+
+	return latest;
+}
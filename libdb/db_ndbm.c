@@ -47,15 +47,14 @@
 #include "db_storage.h"
 
 /* release the lock and close the database */
-int ndbm_flclose (DBM *db)
+static void ndbm_flclose (void *db)
 {
-	flock (dbm_dirfno (db), LOCK_UN);
+	flock (dbm_dirfno ((DBM *) db), LOCK_UN);
 	dbm_close (db);
-	return 0;
 }
 
 /* open a ndbm type database, with file locking. */
-DBM* ndbm_flopen (char *filename, int flags, int mode)
+static void *ndbm_flopen (const char *filename, int flags, int mode)
 {
 	DBM *db;
 	int lock_op;
@@ -80,11 +79,12 @@ DBM* ndbm_flopen (char *filename, int flags, int mode)
 		free (dir_fname);
 		if (dir_fd != -1) {
 			if (!(lock_failed = flock (dir_fd, lock_op)))
-				db = dbm_open (filename, flags, mode);
+				db = dbm_open ((char *) filename, flags,
+					       mode);
 			close (dir_fd);
 		}
 	} else {
-		db = dbm_open (filename, flags, mode);
+		db = dbm_open ((char *) filename, flags, mode);
 		if (db)
 			lock_failed = flock (dbm_dirfno (db), lock_op);
 	}
@@ -101,4 +101,57 @@ DBM* ndbm_flopen (char *filename, int flags, int mode)
 	return db;
 }
 
+static datum ndbm_fetch (void *db, datum key)
+{
+	return copy_datum (dbm_fetch (db, key));
+}
+
+static int ndbm_store (void *db, datum key, datum cont, int replace)
+{
+	return dbm_store (db, key, cont, replace ? DBM_REPLACE : DBM_INSERT);
+}
+
+static int ndbm_delete (void *db, datum key)
+{
+	return dbm_delete (db, key);
+}
+
+static int ndbm_exists (void *db, datum key)
+{
+	return dbm_fetch (db, key).dptr != NULL;
+}
+
+static datum ndbm_firstkey (void *db)
+{
+	return copy_datum (dbm_firstkey (db));
+}
+
+static datum ndbm_nextkey (void *db, datum key ATTRIBUTE_UNUSED)
+{
+	return copy_datum (dbm_nextkey (db));
+}
+
+#ifdef BERKELEY_DB
+static const char * const ndbm_files[] = { ".db", NULL };
+#else /* !BERKELEY_DB */
+static const char * const ndbm_files[] = { ".dir", ".pag", NULL };
+#endif /* BERKELEY_DB */
+
+const struct mydbm_backend ndbm_backend = {
+	"ndbm", "", ndbm_files,
+	ndbm_flopen,
+	ndbm_flclose,
+	ndbm_fetch,
+	ndbm_store,
+	ndbm_delete,
+	ndbm_exists,
+	ndbm_firstkey,
+	ndbm_nextkey,
+	ndbm_firstkey,
+	ndbm_nextkey,
+	NULL,
+	NULL, NULL, NULL,
+	4096			/* a limit of 4096 bytes of data */
+};
+
 #endif /* NDBM */
@@ -0,0 +1,841 @@
+/*
+ * db_sst.c: sorted string table storage backend.
+ *
+ * Copyright (C) 2013 Colin Watson.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* An index database is written rarely and read often, so this backend
+ * stores it as an immutable file of keys in sorted order:
+ *
+ *	SST_MAGIC
+ *	data blocks
+ *	block index
+ *	footer: index offset (8 bytes), block count (4), entry count (4),
+ *		SST_MAGIC; all big-endian
+ *
+ * Each data block holds entries of about SST_BLOCK_SIZE bytes in total.
+ * An entry is the number of leading bytes its key shares with the previous
+ * key in the same block, the number of bytes that follow, and the length
+ * of its content, all as variable-length integers, followed by the rest of
+ * the key and the content.  The first key in each block is stored in full
+ * and repeated in the block index, along with the block's offset and
+ * length, so that a lookup need only search the block index and then scan
+ * a single block.
+ *
+ * Readers map the file and never modify it.  Opening it for writing reads
+ * every entry into memory instead; if anything changes, closing the
+ * database writes a new file alongside and renames it into place, so that
+ * a reader always sees either the old table or the new one.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef HAVE_SYS_MMAN_H
+#  include <sys/mman.h>
+#endif /* HAVE_SYS_MMAN_H */
+
+#include "xvasprintf.h"
+
+#include "gettext.h"
+#define _(String) gettext (String)
+
+#include "manconfig.h"
+
+#include "error.h"
+#include "hashtable.h"
+
+#include "mydbm.h"
+
+#define SST_MAGIC	"mandbsst"
+#define SST_MAGIC_LEN	8
+#define SST_FOOTER_LEN	(8 + 4 + 4 + SST_MAGIC_LEN)
+#define SST_BLOCK_SIZE	4096
+
+struct sst_block {
+	const char *first_key;
+	size_t first_key_len;
+	size_t offset, len;
+};
+
+/* A position within a mapped table. */
+struct sst_pos {
+	size_t block;		/* block holding the next entry */
+	size_t offset;		/* offset of the next entry */
+	char *key;		/* the current entry */
+	size_t key_len, key_max;
+	const char *value;
+	size_t value_len;
+	int valid;
+};
+
+/* An entry held in memory while the table is open for writing. */
+struct sst_entry {
+	char *key;
+	size_t key_len;
+	char *value;
+	size_t value_len;
+};
+
+struct sst_file {
+	char *name;
+	int mode;
+
+	/* Mapped table, when reading. */
+	char *map;
+	size_t map_len;
+	int mapped;
+	struct sst_block *blocks;
+	size_t nblocks;
+	struct sst_pos pos;	/* for firstkey and nextkey */
+
+	/* In-memory table, when writing. */
+	struct hashtable *entries;
+	int dirty;
+	struct sst_entry *sorted;	/* snapshot for firstkey and nextkey */
+	size_t nsorted, sorted_pos;
+};
+
+static datum empty_datum;
+
+static int key_compare (const char *a, size_t a_len,
+			const char *b, size_t b_len)
+{
+	int cmp = memcmp (a, b, a_len < b_len ? a_len : b_len);
+
+	if (cmp)
+		return cmp;
+	return a_len < b_len ? -1 : a_len > b_len ? 1 : 0;
+}
+
+static datum make_datum (const char *data, size_t len)
+{
+	datum d;
+	char *copy = xmalloc (len + 1);
+
+	memcpy (copy, data, len);
+	copy[len] = '\0';
+	memset (&d, 0, sizeof d);
+	MYDBM_SET_DPTR (d, copy);
+	MYDBM_DSIZE (d) = len;
+	return d;
+}
+
+/* Decode a variable-length integer from *P, which must not pass END. */
+static int get_varint (const char **p, const char *end, size_t *value)
+{
+	size_t result = 0;
+	int shift = 0;
+
+	while (*p < end && shift < 64) {
+		unsigned char byte = (unsigned char) *(*p)++;
+
+		result |= (size_t) (byte & 0x7f) << shift;
+		if (!(byte & 0x80)) {
+			*value = result;
+			return 0;
+		}
+		shift += 7;
+	}
+	return -1;
+}
+
+static void put_varint (FILE *out, size_t value, size_t *written)
+{
+	do {
+		unsigned char byte = value & 0x7f;
+
+		value >>= 7;
+		if (value)
+			byte |= 0x80;
+		putc (byte, out);
+		++*written;
+	} while (value);
+}
+
+static size_t get_be (const char *p, int len)
+{
+	size_t value = 0;
+	int i;
+
+	for (i = 0; i < len; ++i)
+		value = (value << 8) | (unsigned char) p[i];
+	return value;
+}
+
+static void put_be (FILE *out, size_t value, int len)
+{
+	int i;
+
+	for (i = len - 1; i >= 0; --i)
+		putc ((int) ((value >> (i * 8)) & 0xff), out);
+}
+
+/* Read the whole of the table FD into memory, preferably by mapping it. */
+static int sst_map (struct sst_file *db, int fd)
+{
+	struct stat st;
+
+	if (fstat (fd, &st) < 0)
+		return -1;
+	db->map_len = st.st_size;
+	if (db->map_len < SST_MAGIC_LEN + SST_FOOTER_LEN) {
+		errno = EINVAL;
+		return -1;
+	}
+
+#ifdef HAVE_SYS_MMAN_H
+	db->map = mmap (NULL, db->map_len, PROT_READ, MAP_SHARED, fd, 0);
+	if (db->map != MAP_FAILED) {
+		db->mapped = 1;
+		return 0;
+	}
+	db->map = NULL;
+#endif /* HAVE_SYS_MMAN_H */
+
+	{
+		size_t done = 0;
+
+		db->map = xmalloc (db->map_len);
+		while (done < db->map_len) {
+			ssize_t n = read (fd, db->map + done,
+					  db->map_len - done);
+			if (n <= 0) {
+				if (n == 0)
+					errno = EINVAL;
+				free (db->map);
+				db->map = NULL;
+				return -1;
+			}
+			done += n;
+		}
+	}
+	return 0;
+}
+
+/* Check the table's framing and load its block index. */
+static int sst_load_index (struct sst_file *db)
+{
+	const char *footer = db->map + db->map_len - SST_FOOTER_LEN;
+	const char *p, *end = footer;
+	size_t index_offset, i;
+
+	if (memcmp (db->map, SST_MAGIC, SST_MAGIC_LEN) ||
+	    memcmp (footer + 16, SST_MAGIC, SST_MAGIC_LEN))
+		return -1;
+	index_offset = get_be (footer, 8);
+	db->nblocks = get_be (footer + 8, 4);
+	if (index_offset < SST_MAGIC_LEN ||
+	    index_offset > db->map_len - SST_FOOTER_LEN ||
+	    db->nblocks > db->map_len - SST_FOOTER_LEN - index_offset)
+		return -1;
+
+	db->blocks = XNMALLOC (db->nblocks ? db->nblocks : 1,
+			       struct sst_block);
+	p = db->map + index_offset;
+	for (i = 0; i < db->nblocks; ++i) {
+		struct sst_block *block = &db->blocks[i];
+
+		if (get_varint (&p, end, &block->first_key_len) ||
+		    block->first_key_len > (size_t) (end - p))
+			return -1;
+		block->first_key = p;
+		p += block->first_key_len;
+		if (get_varint (&p, end, &block->offset) ||
+		    get_varint (&p, end, &block->len) ||
+		    block->offset < SST_MAGIC_LEN ||
+		    block->offset > index_offset ||
+		    block->len > index_offset - block->offset)
+			return -1;
+	}
+
+	return 0;
+}
+
+static void sst_pos_start (struct sst_file *db, struct sst_pos *pos,
+			   size_t block)
+{
+	pos->block = block;
+	pos->offset = block < db->nblocks ? db->blocks[block].offset : 0;
+	pos->key_len = 0;
+	pos->valid = 0;
+}
+
+/* Decode the next entry into POS.  Return 0 at the end of the table. */
+static int sst_pos_next (struct sst_file *db, struct sst_pos *pos)
+{
+	const struct sst_block *block;
+	const char *p, *end;
+	size_t shared, unshared;
+
+	pos->valid = 0;
+	while (pos->block < db->nblocks &&
+	       pos->offset >= db->blocks[pos->block].offset +
+			      db->blocks[pos->block].len)
+		sst_pos_start (db, pos, pos->block + 1);
+	if (pos->block >= db->nblocks)
+		return 0;
+
+	block = &db->blocks[pos->block];
+	if (pos->offset == block->offset)
+		pos->key_len = 0;
+	p = db->map + pos->offset;
+	end = db->map + block->offset + block->len;
+	if (get_varint (&p, end, &shared) ||
+	    get_varint (&p, end, &unshared) ||
+	    get_varint (&p, end, &pos->value_len) ||
+	    shared > pos->key_len ||
+	    unshared > (size_t) (end - p) ||
+	    pos->value_len > (size_t) (end - p) - unshared) {
+		debug ("%s: corrupt block at offset %lu\n",
+		       db->name, (unsigned long) block->offset);
+		pos->block = db->nblocks;
+		return 0;
+	}
+
+	if (shared + unshared > pos->key_max) {
+		pos->key_max = shared + unshared;
+		pos->key = xrealloc (pos->key, pos->key_max);
+	}
+	memcpy (pos->key + shared, p, unshared);
+	pos->key_len = shared + unshared;
+	p += unshared;
+	pos->value = p;
+	p += pos->value_len;
+	pos->offset = p - db->map;
+	pos->valid = 1;
+	return 1;
+}
+
+/* Position POS at the first entry whose key is not less than KEY. */
+static void sst_pos_seek (struct sst_file *db, struct sst_pos *pos,
+			  const char *key, size_t key_len)
+{
+	size_t lo = 0, hi = db->nblocks;
+
+	/* Find the last block whose first key is not greater than KEY. */
+	while (hi - lo > 1) {
+		size_t mid = lo + (hi - lo) / 2;
+		const struct sst_block *block = &db->blocks[mid];
+
+		if (key_compare (block->first_key, block->first_key_len,
+				 key, key_len) <= 0)
+			lo = mid;
+		else
+			hi = mid;
+	}
+
+	sst_pos_start (db, pos, lo);
+	while (sst_pos_next (db, pos))
+		if (key_compare (pos->key, pos->key_len, key, key_len) >= 0)
+			return;
+}
+
+static int sst_pos_at (const struct sst_pos *pos, datum key)
+{
+	return pos->valid &&
+	       key_compare (pos->key, pos->key_len,
+			    MYDBM_DPTR (key), MYDBM_DSIZE (key)) == 0;
+}
+
+static void sst_entry_free (void *defn)
+{
+	struct sst_entry *entry = defn;
+
+	free (entry->key);
+	free (entry->value);
+	free (entry);
+}
+
+static void sst_install (struct sst_file *db, const char *key, size_t key_len,
+			 const char *value, size_t value_len)
+{
+	struct sst_entry *entry = XMALLOC (struct sst_entry);
+
+	entry->key = xmemdup (key, key_len);
+	entry->key_len = key_len;
+	entry->value = xmemdup (value, value_len);
+	entry->value_len = value_len;
+	hashtable_install (db->entries, key, key_len, entry);
+}
+
+static void sst_unmap (struct sst_file *db)
+{
+	if (!db->map)
+		return;
+#ifdef HAVE_SYS_MMAN_H
+	if (db->mapped)
+		munmap (db->map, db->map_len);
+	else
+#endif /* HAVE_SYS_MMAN_H */
+		free (db->map);
+	db->map = NULL;
+	free (db->blocks);
+	db->blocks = NULL;
+	db->nblocks = 0;
+}
+
+static void sst_free_sorted (struct sst_file *db)
+{
+	size_t i;
+
+	for (i = 0; i < db->nsorted; ++i)
+		free (db->sorted[i].key);
+	free (db->sorted);
+	db->sorted = NULL;
+	db->nsorted = db->sorted_pos = 0;
+}
+
+static void sst_free (struct sst_file *db)
+{
+	sst_unmap (db);
+	free (db->pos.key);
+	if (db->entries)
+		hashtable_free (db->entries);
+	sst_free_sorted (db);
+	free (db->name);
+	free (db);
+}
+
+static void *sst_open (const char *name, int flags, int mode)
+{
+	struct sst_file *db = XZALLOC (struct sst_file);
+	int writable = (flags & O_ACCMODE) != O_RDONLY;
+	int fd = -1;
+
+	db->name = xstrdup (name);
+	db->mode = mode;
+
+	if (!(flags & O_TRUNC)) {
+		fd = open (name, O_RDONLY);
+		if (fd < 0 && (errno != ENOENT || !(flags & O_CREAT)))
+			goto fail;
+	}
+	if (fd >= 0) {
+		if (sst_map (db, fd) < 0) {
+			close (fd);
+			goto fail;
+		}
+		close (fd);
+		if (sst_load_index (db) < 0) {
+			debug ("%s: not a sorted string table\n", name);
+			errno = EINVAL;
+			goto fail;
+		}
+	}
+
+	if (writable) {
+		struct sst_pos pos;
+
+		db->entries = hashtable_create (&sst_entry_free);
+		memset (&pos, 0, sizeof pos);
+		sst_pos_start (db, &pos, 0);
+		while (sst_pos_next (db, &pos))
+			sst_install (db, pos.key, pos.key_len,
+				     pos.value, pos.value_len);
+		free (pos.key);
+		if (!db->map)
+			db->dirty = 1;	/* create the file even if empty */
+		sst_unmap (db);
+	}
+
+	return db;
+
+fail:
+	{
+		int saved_errno = errno;
+
+		sst_free (db);
+		errno = saved_errno;
+	}
+	return NULL;
+}
+
+static int sst_entry_compare (const void *a, const void *b)
+{
+	const struct sst_entry *left = a;
+	const struct sst_entry *right = b;
+
+	return key_compare (left->key, left->key_len,
+			    right->key, right->key_len);
+}
+
+/* Write the in-memory table to a new file and rename it into place. */
+static int sst_write (struct sst_file *db)
+{
+	struct hashtable_iter *iter = NULL;
+	const struct nlist *elt;
+	struct sst_entry *entries;
+	size_t *block_starts = NULL, *block_offsets = NULL, *block_lens = NULL;
+	size_t n = 0, max = 256, nblocks = 0, maxblocks = 0, i;
+	size_t offset = SST_MAGIC_LEN, block_len = 0, index_offset;
+	const struct sst_entry *prev = NULL;
+	char *tmpname;
+	FILE *out;
+	int fd;
+
+	entries = XNMALLOC (max, struct sst_entry);
+	while ((elt = hashtable_iterate (db->entries, &iter)) != NULL) {
+		if (n == max) {
+			max *= 2;
+			entries = xnrealloc (entries, max, sizeof *entries);
+		}
+		entries[n++] = *(const struct sst_entry *) elt->defn;
+	}
+	qsort (entries, n, sizeof *entries, sst_entry_compare);
+
+	tmpname = xasprintf ("%s.%d.tmp", db->name, getpid ());
+	fd = open (tmpname, O_WRONLY | O_CREAT | O_TRUNC, db->mode);
+	if (fd < 0 || !(out = fdopen (fd, "wb"))) {
+		error (0, errno, _("can't write to %s"), tmpname);
+		if (fd >= 0)
+			close (fd);
+		free (tmpname);
+		free (entries);
+		return -1;
+	}
+
+	fwrite (SST_MAGIC, 1, SST_MAGIC_LEN, out);
+	for (i = 0; i < n; ++i) {
+		const struct sst_entry *entry = &entries[i];
+		size_t shared = 0;
+
+		if (!nblocks || block_len >= SST_BLOCK_SIZE) {
+			if (nblocks)
+				block_lens[nblocks - 1] = block_len;
+			if (nblocks == maxblocks) {
+				maxblocks = maxblocks ? maxblocks * 2 : 64;
+				block_starts = xnrealloc (block_starts,
+							  maxblocks,
+							  sizeof *block_starts);
+				block_offsets = xnrealloc
+					(block_offsets, maxblocks,
+					 sizeof *block_offsets);
+				block_lens = xnrealloc (block_lens, maxblocks,
+							sizeof *block_lens);
+			}
+			block_starts[nblocks] = i;
+			block_offsets[nblocks] = offset;
+			++nblocks;
+			block_len = 0;
+			prev = NULL;
+		}
+
+		if (prev)
+			while (shared < prev->key_len &&
+			       shared < entry->key_len &&
+			       prev->key[shared] == entry->key[shared])
+				++shared;
+
+		put_varint (out, shared, &block_len);
+		put_varint (out, entry->key_len - shared, &block_len);
+		put_varint (out, entry->value_len, &block_len);
+		fwrite (entry->key + shared, 1, entry->key_len - shared, out);
+		fwrite (entry->value, 1, entry->value_len, out);
+		block_len += entry->key_len - shared + entry->value_len;
+		offset = block_offsets[nblocks - 1] + block_len;
+		prev = entry;
+	}
+	if (nblocks)
+		block_lens[nblocks - 1] = block_len;
+
+	index_offset = offset;
+	for (i = 0; i < nblocks; ++i) {
+		const struct sst_entry *first = &entries[block_starts[i]];
+		size_t written = 0;
+
+		put_varint (out, first->key_len, &written);
+		fwrite (first->key, 1, first->key_len, out);
+		put_varint (out, block_offsets[i], &written);
+		put_varint (out, block_lens[i], &written);
+	}
+	put_be (out, index_offset, 8);
+	put_be (out, nblocks, 4);
+	put_be (out, n, 4);
+	fwrite (SST_MAGIC, 1, SST_MAGIC_LEN, out);
+
+	free (block_starts);
+	free (block_offsets);
+	free (block_lens);
+	free (entries);
+
+	if (ferror (out) | fclose (out)) {
+		error (0, errno, _("can't write to %s"), tmpname);
+		unlink (tmpname);
+		free (tmpname);
+		return -1;
+	}
+	if (rename (tmpname, db->name) < 0) {
+		error (0, errno, _("can't rename %s to %s"),
+		       tmpname, db->name);
+		unlink (tmpname);
+		free (tmpname);
+		return -1;
+	}
+	free (tmpname);
+
+	debug ("%s: wrote %lu entries in %lu blocks\n",
+	       db->name, (unsigned long) n, (unsigned long) nblocks);
+	return 0;
+}
+
+static void sst_close (void *handle)
+{
+	struct sst_file *db = handle;
+
+	if (db->entries && db->dirty)
+		sst_write (db);
+	sst_free (db);
+}
+
+static datum sst_fetch (void *handle, datum key)
+{
+	struct sst_file *db = handle;
+	struct sst_pos pos;
+	datum cont = empty_datum;
+
+	if (db->entries) {
+		const struct sst_entry *entry =
+			hashtable_lookup (db->entries, MYDBM_DPTR (key),
+					  MYDBM_DSIZE (key));
+		if (entry)
+			cont = make_datum (entry->value, entry->value_len);
+		return cont;
+	}
+
+	memset (&pos, 0, sizeof pos);
+	sst_pos_seek (db, &pos, MYDBM_DPTR (key), MYDBM_DSIZE (key));
+	if (sst_pos_at (&pos, key))
+		cont = make_datum (pos.value, pos.value_len);
+	free (pos.key);
+	return cont;
+}
+
+static int sst_store (void *handle, datum key, datum cont, int replace)
+{
+	struct sst_file *db = handle;
+
+	if (!db->entries) {
+		errno = EBADF;
+		return -1;
+	}
+	if (!replace && hashtable_lookup_structure (db->entries,
+						    MYDBM_DPTR (key),
+						    MYDBM_DSIZE (key)))
+		return 1;
+
+	sst_install (db, MYDBM_DPTR (key), MYDBM_DSIZE (key),
+		     MYDBM_DPTR (cont), MYDBM_DSIZE (cont));
+	db->dirty = 1;
+	return 0;
+}
+
+static int sst_delete (void *handle, datum key)
+{
+	struct sst_file *db = handle;
+
+	if (!db->entries) {
+		errno = EBADF;
+		return -1;
+	}
+	if (!hashtable_lookup_structure (db->entries, MYDBM_DPTR (key),
+					 MYDBM_DSIZE (key)))
+		return -1;
+
+	hashtable_remove (db->entries, MYDBM_DPTR (key), MYDBM_DSIZE (key));
+	db->dirty = 1;
+	return 0;
+}
+
+static int sst_exists (void *handle, datum key)
+{
+	struct sst_file *db = handle;
+	struct sst_pos pos;
+	int ret;
+
+	if (db->entries)
+		return hashtable_lookup_structure (db->entries,
+						   MYDBM_DPTR (key),
+						   MYDBM_DSIZE (key)) != NULL;
+
+	memset (&pos, 0, sizeof pos);
+	sst_pos_seek (db, &pos, MYDBM_DPTR (key), MYDBM_DSIZE (key));
+	ret = sst_pos_at (&pos, key);
+	free (pos.key);
+	return ret;
+}
+
+/* While writing, walk a sorted snapshot of the keys taken by firstkey, so
+ * that callers may store and delete as they go.
+ */
+static datum sst_sorted_key (struct sst_file *db, size_t i)
+{
+	for (; i < db->nsorted; ++i) {
+		const struct sst_entry *entry = &db->sorted[i];
+
+		if (hashtable_lookup_structure (db->entries, entry->key,
+						entry->key_len)) {
+			db->sorted_pos = i;
+			return make_datum (entry->key, entry->key_len);
+		}
+	}
+	db->sorted_pos = db->nsorted;
+	return empty_datum;
+}
+
+static datum sst_firstkey (void *handle)
+{
+	struct sst_file *db = handle;
+
+	if (db->entries) {
+		struct hashtable_iter *iter = NULL;
+		const struct nlist *elt;
+		size_t max = 0;
+
+		sst_free_sorted (db);
+		while ((elt = hashtable_iterate (db->entries, &iter))) {
+			const struct sst_entry *entry = elt->defn;
+
+			if (db->nsorted == max) {
+				max = max ? max * 2 : 256;
+				db->sorted = xnrealloc (db->sorted, max,
+							sizeof *db->sorted);
+			}
+			db->sorted[db->nsorted].key =
+				xmemdup (entry->key, entry->key_len);
+			db->sorted[db->nsorted].key_len = entry->key_len;
+			++db->nsorted;
+		}
+		qsort (db->sorted, db->nsorted, sizeof *db->sorted,
+		       sst_entry_compare);
+		return sst_sorted_key (db, 0);
+	}
+
+	sst_pos_start (db, &db->pos, 0);
+	if (sst_pos_next (db, &db->pos))
+		return make_datum (db->pos.key, db->pos.key_len);
+	return empty_datum;
+}
+
+static datum sst_nextkey (void *handle, datum key)
+{
+	struct sst_file *db = handle;
+
+	if (db->entries) {
+		size_t lo = 0, hi = db->nsorted;
+
+		if (db->sorted_pos < db->nsorted &&
+		    key_compare (db->sorted[db->sorted_pos].key,
+				 db->sorted[db->sorted_pos].key_len,
+				 MYDBM_DPTR (key), MYDBM_DSIZE (key)) == 0)
+			return sst_sorted_key (db, db->sorted_pos + 1);
+
+		/* Find the first key greater than KEY. */
+		while (lo < hi) {
+			size_t mid = lo + (hi - lo) / 2;
+
+			if (key_compare (db->sorted[mid].key,
+					 db->sorted[mid].key_len,
+					 MYDBM_DPTR (key),
+					 MYDBM_DSIZE (key)) <= 0)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		return sst_sorted_key (db, lo);
+	}
+
+	/* Sequential walks pick up where the last call left off. */
+	if (!sst_pos_at (&db->pos, key)) {
+		sst_pos_seek (db, &db->pos, MYDBM_DPTR (key),
+			      MYDBM_DSIZE (key));
+		if (db->pos.valid && !sst_pos_at (&db->pos, key))
+			return make_datum (db->pos.key, db->pos.key_len);
+	}
+	if (db->pos.valid && sst_pos_next (db, &db->pos))
+		return make_datum (db->pos.key, db->pos.key_len);
+	return empty_datum;
+}
+
+struct sst_cursor {
+	struct sst_file *db;
+	struct sst_pos pos;
+};
+
+static void *sst_cursor_open (void *handle)
+{
+	struct sst_file *db = handle;
+	struct sst_cursor *cursor;
+
+	/* The generic cursor copes with an in-memory table. */
+	if (db->entries)
+		return NULL;
+
+	cursor = XZALLOC (struct sst_cursor);
+	cursor->db = db;
+	sst_pos_start (db, &cursor->pos, 0);
+	return cursor;
+}
+
+static int sst_cursor_next (void *handle, datum *key, datum *cont)
+{
+	struct sst_cursor *cursor = handle;
+
+	if (!sst_pos_next (cursor->db, &cursor->pos))
+		return 1;
+	*key = make_datum (cursor->pos.key, cursor->pos.key_len);
+	*cont = make_datum (cursor->pos.value, cursor->pos.value_len);
+	return 0;
+}
+
+static void sst_cursor_close (void *handle)
+{
+	struct sst_cursor *cursor = handle;
+
+	free (cursor->pos.key);
+	free (cursor);
+}
+
+static const char * const sst_files[] = { "", NULL };
+
+const struct mydbm_backend sst_backend = {
+	"sst", ".sst", sst_files,
+	sst_open,
+	sst_close,
+	sst_fetch,
+	sst_store,
+	sst_delete,
+	sst_exists,
+	sst_firstkey,
+	sst_nextkey,
+	sst_firstkey,
+	sst_nextkey,
+	NULL,
+	sst_cursor_open,
+	sst_cursor_next,
+	sst_cursor_close,
+	0
+};
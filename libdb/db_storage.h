@@ -45,6 +45,21 @@
 
 #define FIELDS  9       /* No of fields in each database page `content' */
 
+/* Binary page records (see make_content) start with RECORD_MAGIC, which
+   can start neither an old text record nor a multi key's list of names.
+   Records written before page encodings were stored start with
+   RECORD_MAGIC_NOENC instead, and lack the final encoding field. */
+#define RECORD_MAGIC	'\003'
+#define RECORD_MAGIC_NOENC '\001'
+#define RECORD_HEADER	10	/* magic, id, and 64-bit mtime */
+#define RECORD_FIELDS	8	/* string fields in a binary record */
+
+/* A key holding pages in more than one section (or with more than one
+   case variant of its name) holds MULTI_MAGIC followed by the binary
+   record of each page and a terminating NUL (see make_multi_content), so
+   that all of them can be read with a single fetch. */
+#define MULTI_MAGIC	'\002'
+
 #include "sys/time.h"	/* for time_t */
 
 #include "xalloc.h"
@@ -68,6 +83,8 @@ struct mandata {
 	const char *comp;		/* Compression extension */
 	const char *filter;		/* filters needed for the page */
 	const char *whatis;		/* whatis description for page */
+	const char *encoding;		/* "ASCII", "UTF-8", or NULL if the
+					   page may need converting */
 	time_t _st_mtime;		/* mod time for file */
 }; 
 
@@ -84,11 +101,26 @@ extern int dbdelete (const char *name, struct mandata *in);
 extern void dbprintf (const struct mandata *info);
 extern void free_mandata_elements (struct mandata *pinfo);
 extern void free_mandata_struct (struct mandata *pinfo);
-extern void split_content (char *cont_ptr, struct mandata *pinfo);
+extern void split_content (char *cont_ptr, size_t size,
+			   struct mandata *pinfo);
+extern struct mandata *split_content_list (char *cont_ptr, size_t size);
 extern int compare_ids (char a, char b, int promote_links);
 
+/* db_merge.c */
+extern time_t dbmerge (char * const *shards, size_t n);
+
+/* db_trigram.c */
+extern int dbtrigram_valid (void);
+extern void dbtrigram_invalidate (void);
+extern void dbtrigram_build (void);
+extern void dbtrigram_update (void);
+extern char **dbtrigram_candidates (const char * const *patterns,
+				    int num_patterns, int pattern_regex);
+extern datum dbtrigram_nextkey (char ***candidate);
+extern void dbtrigram_free_candidates (char **candidates);
+
 /* local to db routines */
-extern void gripe_lock (char *filename);
+extern void gripe_lock (const char *filename);
 extern void gripe_corrupt_data (void);
 extern datum make_multi_key (const char *page, const char *ext);
 
@@ -98,6 +130,12 @@ extern datum make_multi_key (const char *page, const char *ext);
 extern char *name_to_key (const char *name);
 extern char **split_data (char *content, char *start[]);
 extern datum make_content (struct mandata *in);
+extern datum make_multi_content (struct mandata * const *entries, size_t n);
+extern struct mandata *split_key_content (const char *key, char *cont_ptr,
+					  size_t size, int *multi);
+extern void store_key_content (const char *key,
+			       struct mandata * const *entries, size_t n,
+			       const struct mandata *old);
 extern int list_extensions (char *data, char ***names, char ***ext);
 extern void gripe_replace_key (const char *data);
 extern char *copy_if_set (const char *str);
@@ -30,8 +30,6 @@
 #include <stdlib.h>
 #include <unistd.h>
 
-#include "xvasprintf.h"
-
 #include "gettext.h"
 #define _(String) gettext (String)
 
@@ -74,14 +72,17 @@ int compare_ids (char a, char b, int promote_links)
 		return 0;
 }
 
-/* The do_we_replace logic. Decide, for some existing key, whether it should
- * be replaced with some new contents. Check that names and section
- * extensions match before calling this.
+/* The do_we_replace logic. Decide, for some existing entry, whether it
+ * should be replaced with some new contents, setting *replace accordingly.
+ * Check that names and section extensions match before calling this.
+ * Return the value to be returned by dbstore().
  */
 static int replace_if_necessary (struct mandata *newdata,
 				 struct mandata *olddata,
-				 datum newkey, datum newcont)
+				 const char *name, int *replace)
 {
+	*replace = 0;
+
 	/* It's OK to replace ULT_MAN with SO_MAN if the mtime is newer. It
 	 * isn't OK to replace a real page (either ULT_MAN or SO_MAN) with a
 	 * whatis reference; if the real page really went away then
@@ -91,14 +92,12 @@ static int replace_if_necessary (struct mandata *newdata,
 	if (compare_ids (newdata->id, olddata->id, 1) <= 0 &&
 	    newdata->_st_mtime > olddata->_st_mtime) {
 		debug ("replace_if_necessary(): newer mtime; replacing\n");
-		if (MYDBM_REPLACE (dbf, newkey, newcont))
-			gripe_replace_key (MYDBM_DPTR (newkey));
+		*replace = 1;
 		return 0;
 	}
 
 	if (compare_ids (newdata->id, olddata->id, 0) < 0) {
-		if (MYDBM_REPLACE (dbf, newkey, newcont))
-			gripe_replace_key (MYDBM_DPTR (newkey));
+		*replace = 1;
 		return 0;
 	}
 
@@ -109,28 +108,26 @@ static int replace_if_necessary (struct mandata *newdata,
 			return 0; /* same file */
 		else {
 			debug ("ignoring differing compression "
-			       "extensions: %s\n", MYDBM_DPTR (newkey));
+			       "extensions: %s(%s)\n", name, newdata->ext);
 			return 1; /* differing exts */
 		}
 	}
 
-	debug ("ignoring differing ids: %s\n", MYDBM_DPTR (newkey));
+	debug ("ignoring differing ids: %s(%s)\n", name, newdata->ext);
 	return 0;
 }
 
 /*
- Any one of three situations can occur when storing some data.
+ Either of two situations can occur when storing some data.
 
  1) no simple key is found.
  	store as singular reference.
- 2) simple key already exists, content starts with a '\t'.
- 	Already multiple reference. Add our new item in multiple format
- 	and update the simple key content, to point to our new one also.
- 3) simple key already exists, content does not start with a '\t'.
- 	First we have to reformat the simple key into a multi key for the
- 	old item, and insert. Then we have to insert the new data as a
- 	multi key. Lastly we must create the simple key and do a replace
- 	on it.
+ 2) simple key already exists.
+ 	If it already holds an entry with the same name and section
+ 	extension, decide which of the two to keep. Otherwise, add our new
+ 	item to those held by the key. A key holding more than one item
+ 	stores all of them together (see store_key_content), so that
+ 	dblookup() can usually read them with a single fetch.
 
  Use precedence algorithm on inserts. If we already have a key assigned
  to the new value, check priority of page using id. If new page is higher
@@ -148,7 +145,6 @@ static int replace_if_necessary (struct mandata *newdata,
 
  return errorcode or 0 on success.
 */
-#ifndef FAST_BTREE
 int dbstore (struct mandata *in, const char *base)
 {
 	datum oldkey, oldcont;
@@ -171,158 +167,71 @@ int dbstore (struct mandata *in, const char *base)
 		in->name = NULL;
 	}
 
+	if (!STREQ (base, MYDBM_DPTR (oldkey)))
+		in->name = xstrdup (base);
+
 	/* get the content for the simple key */
 
 	oldcont = MYDBM_FETCH (dbf, oldkey);
 
 	if (MYDBM_DPTR (oldcont) == NULL) { 		/* situation (1) */
-		if (!STREQ (base, MYDBM_DPTR (oldkey)))
-			in->name = xstrdup (base);
 		oldcont = make_content (in);
 		if (MYDBM_REPLACE (dbf, oldkey, oldcont))
 			gripe_replace_key (MYDBM_DPTR (oldkey));
 		free (MYDBM_DPTR (oldcont));
-		free (in->name);
-		in->name = NULL;
-	} else if (*MYDBM_DPTR (oldcont) == '\t') { 	/* situation (2) */
-		datum newkey, newcont;
-
-		memset (&newkey, 0, sizeof newkey);
-		memset (&newcont, 0, sizeof newcont);
-
-		newkey = make_multi_key (base, in->ext);
-		newcont = make_content (in);
-
-		/* Try to insert the new multi data */
-
-		if (MYDBM_INSERT (dbf, newkey, newcont)) {
-			datum cont;
-			struct mandata info;
-			int ret;
-
-			MYDBM_FREE (MYDBM_DPTR (oldcont));
-			cont = MYDBM_FETCH (dbf, newkey);
-			split_content (MYDBM_DPTR (cont), &info);
-			ret = replace_if_necessary (in, &info,
-						    newkey, newcont);
-			/* MYDBM_FREE (MYDBM_DPTR (cont)); */
-			free_mandata_elements (&info);
-			free (MYDBM_DPTR (newkey));
-			free (MYDBM_DPTR (newcont));
-			free (MYDBM_DPTR (oldkey));
-
-			return ret;
-		}
-
-		/* Now lets add some info to the simple key's cont. */
-
-		/* This next bit needs to be done first as we'll wipe out
-		   MYDBM_DPTR (oldcont) otherwise (for NDBM only!) */
-
-		free (MYDBM_DPTR (newkey));
-		free (MYDBM_DPTR (newcont));
-
-		MYDBM_SET (newcont, xasprintf (
-			"%s\t%s\t%s", MYDBM_DPTR (oldcont), base, in->ext));
-		MYDBM_FREE (MYDBM_DPTR (oldcont));
-
-		/* Try to replace the old simple data with the new stuff */
-
-		if (MYDBM_REPLACE (dbf, oldkey, newcont))
-			gripe_replace_key (MYDBM_DPTR (oldkey));
-
-		free (MYDBM_DPTR (newcont));
-	} else { 				/* situation (3) */
-		datum newkey, newcont, lastkey, lastcont;
-		struct mandata old;
-		char *old_name;
-
-		memset (&newkey, 0, sizeof newkey);
-		memset (&newcont, 0, sizeof newcont);
-		memset (&lastkey, 0, sizeof lastkey);
-		memset (&lastcont, 0, sizeof lastcont);
-
-		/* Extract the old singular reference */
-
-		split_content (MYDBM_DPTR (oldcont), &old);
-
-		/* Create multi keys for both old
-		   and new items, create new content */
-
-		if (old.name)
-			old_name = xstrdup (old.name);
-		else
-			old_name = xstrdup (MYDBM_DPTR (oldkey));
-
-		lastkey = make_multi_key (old_name, old.ext);
-
-		/* Check against identical multi keys before inserting
-		   into db */
-
-		if (STREQ (old_name, base) && STREQ (old.ext, in->ext)) {
-			int ret;
-
-			if (!STREQ (base, MYDBM_DPTR (oldkey)))
-				in->name = xstrdup (base);
-			newcont = make_content (in);
-			ret = replace_if_necessary (in, &old, oldkey, newcont);
-			/* MYDBM_FREE (MYDBM_DPTR (oldcont)); */
-			free_mandata_elements (&old);
-			free (MYDBM_DPTR (newcont));
-			free (MYDBM_DPTR (lastkey));
-			free (MYDBM_DPTR (oldkey));
-			free (old_name);
-			free (in->name);
-			in->name = NULL;
-
-			return ret;
-		}
-
-		/* Multi keys use the proper case, and so don't need a name
-		 * field.
-		 */
-		if (old.name) {
-			free (old.name);
-			old.name = NULL;
+		/* A new name, which the trigram index doesn't know about. */
+		dbtrigram_invalidate ();
+	} else { 				/* situation (2) */
+		struct mandata *old, *entry, **entries;
+		size_t count = 0, match = 0;
+		int found = 0, multi;
+
+		/* Extract the items already held by the key */
+
+		old = split_key_content (MYDBM_DPTR (oldkey),
+					 MYDBM_DPTR (oldcont),
+					 MYDBM_DSIZE (oldcont), &multi);
+		for (entry = old; entry; entry = entry->next)
+			++count;
+		entries = XNMALLOC (count + 1, struct mandata *);
+
+		count = 0;
+		for (entry = old; entry; entry = entry->next) {
+			if (!found &&
+			    STREQ (entry->name ? entry->name
+					       : MYDBM_DPTR (oldkey), base) &&
+			    STREQ (entry->ext, in->ext)) {
+				found = 1;
+				match = count;
+			}
+			entries[count++] = entry;
 		}
 
-		lastcont = make_content (&old);
-
-		/* We always replace here; if the multi key already exists
-		 * in the database, then that indicates some kind of
-		 * database corruption, but our new multi key is almost
-		 * certainly better.
-		 */
-		if (MYDBM_REPLACE (dbf, lastkey, lastcont))
-			gripe_replace_key (MYDBM_DPTR (lastkey));
-
-		free (MYDBM_DPTR (lastkey));
-		free (MYDBM_DPTR (lastcont));
-
-		newkey = make_multi_key (base, in->ext);
-		newcont = make_content (in);
-
-		if (MYDBM_REPLACE (dbf, newkey, newcont))
-			gripe_replace_key (MYDBM_DPTR (newkey));
-
-		free (MYDBM_DPTR (newkey));
-		free (MYDBM_DPTR (newcont));
-
-		/* Now build a simple reference to the above two items */
-
-		MYDBM_SET (newcont, xasprintf (
-			"\t%s\t%s\t%s\t%s", old_name, old.ext, base, in->ext));
-
-		if (MYDBM_REPLACE (dbf, oldkey, newcont))
-			gripe_replace_key (MYDBM_DPTR (oldkey));
-
-		/* MYDBM_FREE (MYDBM_DPTR (oldcont)); */
-		free_mandata_elements (&old);
-		free (MYDBM_DPTR (newcont));
-		free (old_name);
+		if (found) {
+			int replace;
+			int ret = replace_if_necessary (in, entries[match],
+							base, &replace);
+			if (!replace) {
+				free (entries);
+				free_mandata_struct (old);
+				free (MYDBM_DPTR (oldkey));
+				free (in->name);
+				in->name = NULL;
+				return ret;
+			}
+			entries[match] = in;
+		} else
+			entries[count++] = in;
+
+		store_key_content (MYDBM_DPTR (oldkey), entries, count,
+				   multi ? old : NULL);
+
+		free (entries);
+		free_mandata_struct (old);
 	}
 
+	free (in->name);
+	in->name = NULL;
 	free (MYDBM_DPTR (oldkey));
 	return 0;
 }
-#endif /* !FAST_BTREE */
@@ -0,0 +1,619 @@
+/*
+ * db_trigram.c: trigram index over page names, used to narrow down the
+ *               candidates for regex and wildcard lookups.
+ *
+ * Copyright (C) 2013 Colin Watson.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* Every simple key in the database is the lower-cased name of a page.  For
+ * each trigram (three consecutive bytes) occurring in any simple key, we
+ * store a posting list under TRIGRAM_PREFIX followed by the trigram,
+ * containing the tab-separated simple keys in which it occurs.  On
+ * backends that limit the size of a record, long lists are split into
+ * chunks, and each chunk after the first is stored under the same key
+ * followed by its number.
+ *
+ * A regex or wildcard can only match a name if the name contains every
+ * literal run that the pattern requires, so intersecting the posting lists
+ * of the trigrams in those runs gives a superset of the matching keys.
+ * The caller still verifies each candidate with regexec() or fnmatch().
+ *
+ * Stale entries left behind by deletions are harmless, since the caller
+ * simply fails to fetch them.  New names are not: dbstore() therefore
+ * removes TRIGRAM_KEY whenever it creates a new simple key, and readers
+ * fall back to a full scan until mandb rebuilds the index.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <ctype.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "xvasprintf.h"
+
+#include "manconfig.h"
+
+#include "hashtable.h"
+
+#include "mydbm.h"
+#include "db_storage.h"
+
+struct posting {
+	char *buf;
+	size_t len, max;
+};
+
+static void posting_hashtable_free (void *defn)
+{
+	struct posting *posting = defn;
+
+	free (posting->buf);
+	free (posting);
+}
+
+static void posting_add (struct posting *posting, const char *name)
+{
+	size_t namelen = strlen (name);
+
+	/* Room for a separator, the name, and the terminating NUL. */
+	if (posting->len + namelen + 2 > posting->max) {
+		posting->max = (posting->len + namelen + 2) * 2;
+		posting->buf = xrealloc (posting->buf, posting->max);
+	}
+	if (posting->len)
+		posting->buf[posting->len++] = '\t';
+	memcpy (posting->buf + posting->len, name, namelen + 1);
+	posting->len += namelen;
+}
+
+/* Only printable ASCII trigrams are indexed.  Patterns containing anything
+ * else are never narrowed (see pattern_trigrams() below), so there would be
+ * no point storing them.
+ */
+static int indexable (const char *trigram)
+{
+	int i;
+
+	for (i = 0; i < 3; ++i)
+		if ((unsigned char) trigram[i] <= ' ' ||
+		    (unsigned char) trigram[i] >= 0x7f)
+			return 0;
+	return 1;
+}
+
+static datum make_trigram_key (const char *trigram, int chunk)
+{
+	datum key;
+
+	memset (&key, 0, sizeof key);
+	if (chunk)
+		MYDBM_SET (key, xasprintf ("%s%.3s%d",
+					   TRIGRAM_PREFIX, trigram, chunk));
+	else
+		MYDBM_SET (key, xasprintf ("%s%.3s", TRIGRAM_PREFIX, trigram));
+	return key;
+}
+
+/* Is the trigram index in the open database complete? */
+int dbtrigram_valid (void)
+{
+	datum key, cont;
+	int valid;
+
+	memset (&key, 0, sizeof key);
+	MYDBM_SET (key, xstrdup (TRIGRAM_KEY));
+	cont = MYDBM_FETCH (dbf, key);
+	free (MYDBM_DPTR (key));
+
+	if (!MYDBM_DPTR (cont))
+		return 0;
+	valid = STREQ (MYDBM_DPTR (cont), TRIGRAM_ID);
+	MYDBM_FREE (MYDBM_DPTR (cont));
+	return valid;
+}
+
+/* Mark the trigram index as incomplete.  Called whenever a new name is
+ * added to the database.
+ */
+void dbtrigram_invalidate (void)
+{
+	datum key;
+
+	memset (&key, 0, sizeof key);
+	MYDBM_SET (key, xstrdup (TRIGRAM_KEY));
+	MYDBM_DELETE (dbf, key);
+	free (MYDBM_DPTR (key));
+}
+
+/* Store the posting list for trigram, split into chunks of no more than
+ * limit bytes each (unless limit is zero).  Keys written are removed from
+ * stale.  Returns non-zero if any chunk could not be stored.
+ */
+static int store_posting (const char *trigram, struct posting *posting,
+			  size_t limit, struct hashtable *stale)
+{
+	char *start = posting->buf, *end = posting->buf + posting->len;
+	int chunk = 0;
+
+	while (start < end) {
+		char *stop = end;
+		datum key, cont;
+		int ret;
+
+		if (limit && (size_t) (end - start) >= limit) {
+			/* Break after the last name that fits. */
+			stop = start + limit - 1;
+			while (stop > start && *stop != '\t')
+				--stop;
+			if (stop == start) {
+				debug ("trigram %.3s: name too long for a "
+				       "record\n", trigram);
+				return 1;
+			}
+			*stop = '\0';
+		}
+
+		key = make_trigram_key (trigram, chunk++);
+		hashtable_remove (stale, MYDBM_DPTR (key),
+				  strlen (MYDBM_DPTR (key)));
+		memset (&cont, 0, sizeof cont);
+		MYDBM_SET_DPTR (cont, start);
+		MYDBM_DSIZE (cont) = stop - start + 1;
+		ret = MYDBM_REPLACE (dbf, key, cont);
+		if (ret)
+			debug ("cannot replace key %s\n", MYDBM_DPTR (key));
+		free (MYDBM_DPTR (key));
+		if (ret)
+			return 1;
+
+		start = stop + 1;
+	}
+	return 0;
+}
+
+/* Rebuild the trigram index from scratch.  Only the keys are needed, so
+ * this is a single cursor pass with no fetches.  TRIGRAM_KEY is only
+ * written once every posting list has been stored; if any could not be,
+ * the index is left invalid and readers fall back to a full scan.
+ */
+void dbtrigram_build (void)
+{
+	struct hashtable *postings, *stale;
+	struct hashtable_iter *iter = NULL;
+	const struct nlist *elt;
+	datum key, cont;
+	size_t prefixlen = strlen (TRIGRAM_PREFIX);
+	size_t limit = MYDBM_MAX_CONTENT (dbf);
+	int names = 0, trigrams = 0, failed = 0;
+
+	postings = hashtable_create (&posting_hashtable_free);
+	stale = hashtable_create (&null_hashtable_free);
+
+	key = MYDBM_FIRSTKEY (dbf);
+	while (MYDBM_DPTR (key)) {
+		const char *name = MYDBM_DPTR (key);
+		datum nextkey;
+
+		if (STRNEQ (name, TRIGRAM_PREFIX, prefixlen))
+			hashtable_install (stale, name, strlen (name), NULL);
+		else if (*name != '$' && !strchr (name, '\t')) {
+			size_t namelen = strlen (name);
+			struct hashtable *seen;
+			size_t i;
+
+			/* Each key goes into each posting list at most
+			 * once, however often the trigram recurs.
+			 */
+			seen = hashtable_create (&null_hashtable_free);
+			for (i = 0; i + 3 <= namelen; ++i) {
+				struct posting *posting;
+
+				if (!indexable (name + i) ||
+				    hashtable_lookup_structure (seen,
+								name + i, 3))
+					continue;
+				hashtable_install (seen, name + i, 3, NULL);
+
+				posting = hashtable_lookup (postings,
+							    name + i, 3);
+				if (!posting) {
+					posting = XZALLOC (struct posting);
+					hashtable_install (postings, name + i,
+							   3, posting);
+					++trigrams;
+				}
+				posting_add (posting, name);
+			}
+			hashtable_free (seen);
+			++names;
+		}
+
+		nextkey = MYDBM_NEXTKEY (dbf, key);
+		MYDBM_FREE (MYDBM_DPTR (key));
+		key = nextkey;
+	}
+
+	while ((elt = hashtable_iterate (postings, &iter)) != NULL) {
+		if (store_posting (elt->name, elt->defn, limit, stale)) {
+			failed = 1;
+			/* Stop iterating part of the way through. */
+			free (iter);
+			iter = NULL;
+			break;
+		}
+	}
+
+	/* hashtable_iterate() forbids modifying the table being iterated,
+	 * but the database is a different matter.
+	 */
+	while ((elt = hashtable_iterate (stale, &iter)) != NULL) {
+		memset (&key, 0, sizeof key);
+		MYDBM_SET (key, elt->name);
+		MYDBM_DELETE (dbf, key);
+	}
+
+	if (failed)
+		dbtrigram_invalidate ();
+	else {
+		memset (&key, 0, sizeof key);
+		memset (&cont, 0, sizeof cont);
+		MYDBM_SET (key, xstrdup (TRIGRAM_KEY));
+		MYDBM_SET (cont, xstrdup (TRIGRAM_ID));
+		if (MYDBM_REPLACE (dbf, key, cont))
+			debug ("cannot replace key %s\n", TRIGRAM_KEY);
+		free (MYDBM_DPTR (key));
+		free (MYDBM_DPTR (cont));
+	}
+
+	debug ("dbtrigram_build(): %d names, %d trigrams%s\n", names,
+	       trigrams, failed ? " (incomplete)" : "");
+
+	hashtable_free (stale);
+	hashtable_free (postings);
+}
+
+/* Rebuild the trigram index if anything has invalidated it. */
+void dbtrigram_update (void)
+{
+	if (!dbtrigram_valid ())
+		dbtrigram_build ();
+}
+
+/* Add the trigrams of one literal run to the set of required trigrams. */
+static void add_run (struct hashtable *required, const char *run, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i + 3 <= len; ++i)
+		hashtable_install (required, run + i, 3, NULL);
+}
+
+/* Skip a bracket expression starting just after the opening '['.  Returns a
+ * pointer to the closing ']', or NULL if there is none.
+ */
+static const char *skip_bracket (const char *p)
+{
+	if (*p == '!' || *p == '^')
+		++p;
+	if (*p == ']')
+		++p;
+	while (*p && *p != ']') {
+		if (*p == '[' && (p[1] == ':' || p[1] == '.' || p[1] == '=')) {
+			char delim = p[1];
+
+			p += 2;
+			while (*p && !(*p == delim && p[1] == ']'))
+				++p;
+			if (!*p)
+				return NULL;
+			++p;
+		}
+		++p;
+	}
+	return *p ? p : NULL;
+}
+
+/* Work out which trigrams a name must contain to match pattern, and add
+ * them to required.  Returns 0 if the pattern is too complicated for us to
+ * be sure, in which case the caller must not narrow at all.
+ *
+ * We only look at ASCII patterns: case-insensitive matching of multibyte
+ * characters does not necessarily agree with lower() on the keys.  For
+ * extended regexes we give up on alternation, grouping and intervals, all
+ * of which could make a literal run optional.
+ */
+static int pattern_trigrams (const char *pattern, int pattern_regex,
+			     struct hashtable *required)
+{
+	char *run = xmalloc (strlen (pattern) + 1);
+	size_t len = 0;
+	const char *p;
+	int ok = 1, last_dup = 0;
+
+	for (p = pattern; *p && ok; ++p) {
+		int dup = 0;
+
+		if ((unsigned char) *p >= 0x80)
+			ok = 0;
+		else if (!pattern_regex) {
+			switch (*p) {
+				case '*':
+				case '?':
+					add_run (required, run, len);
+					len = 0;
+					break;
+				case '[':
+					add_run (required, run, len);
+					len = 0;
+					p = skip_bracket (p + 1);
+					if (!p)
+						ok = 0;
+					break;
+				case '\\':
+					if (!p[1] || (unsigned char) p[1] >= 0x80)
+						ok = 0;
+					else
+						run[len++] = CTYPE (tolower,
+								    *++p);
+					break;
+				default:
+					run[len++] = CTYPE (tolower, *p);
+					break;
+			}
+		} else {
+			switch (*p) {
+				case '|':
+				case '(':
+				case ')':
+				case '{':
+				case '}':
+					ok = 0;
+					break;
+				case '*':
+				case '?':
+					/* The preceding character is
+					 * optional.  Stacked duplication
+					 * operators are too subtle.
+					 */
+					if (last_dup)
+						ok = 0;
+					else if (len)
+						--len;
+					add_run (required, run, len);
+					len = 0;
+					dup = 1;
+					break;
+				case '+':
+					if (last_dup)
+						ok = 0;
+					add_run (required, run, len);
+					len = 0;
+					dup = 1;
+					break;
+				case '.':
+				case '^':
+				case '$':
+					add_run (required, run, len);
+					len = 0;
+					break;
+				case '[':
+					add_run (required, run, len);
+					len = 0;
+					p = skip_bracket (p + 1);
+					if (!p)
+						ok = 0;
+					break;
+				case '\\':
+					if (!p[1] || (unsigned char) p[1] >= 0x80)
+						ok = 0;
+					else if (CTYPE (isalnum, p[1]) ||
+						 strchr ("<>`'", p[1])) {
+						/* GNU operators such as
+						 * \w and \<, or a
+						 * back-reference.
+						 */
+						add_run (required, run, len);
+						len = 0;
+						++p;
+					} else
+						run[len++] = CTYPE (tolower,
+								    *++p);
+					break;
+				default:
+					run[len++] = CTYPE (tolower, *p);
+					break;
+			}
+		}
+		last_dup = dup;
+	}
+
+	if (ok)
+		add_run (required, run, len);
+	free (run);
+	return ok;
+}
+
+static int candidate_compare (const void *a, const void *b)
+{
+	const char * const *left = a;
+	const char * const *right = b;
+
+	return strcmp (*left, *right);
+}
+
+/* Return the keys of the names in the open database which could match
+ * pattern, as a hashtable, or NULL if the index cannot narrow the search.
+ */
+static struct hashtable *pattern_candidates (const char *pattern,
+					     int pattern_regex)
+{
+	struct hashtable *required, *names = NULL;
+	struct hashtable_iter *iter = NULL;
+	const struct nlist *elt;
+
+	required = hashtable_create (&null_hashtable_free);
+	if (!pattern_trigrams (pattern, pattern_regex, required)) {
+		hashtable_free (required);
+		return NULL;
+	}
+
+	while ((elt = hashtable_iterate (required, &iter)) != NULL) {
+		struct hashtable *next;
+		int chunk;
+
+		next = hashtable_create (&null_hashtable_free);
+		for (chunk = 0; ; ++chunk) {
+			datum key, cont;
+			char *data, *name;
+
+			key = make_trigram_key (elt->name, chunk);
+			cont = MYDBM_FETCH (dbf, key);
+			free (MYDBM_DPTR (key));
+			if (!MYDBM_DPTR (cont))
+				break;
+
+			data = MYDBM_DPTR (cont);
+			while ((name = strsep (&data, "\t")) != NULL)
+				if (!names ||
+				    hashtable_lookup_structure
+					    (names, name, strlen (name)))
+					hashtable_install (next, name,
+							   strlen (name),
+							   NULL);
+			MYDBM_FREE (MYDBM_DPTR (cont));
+		}
+
+		if (names)
+			hashtable_free (names);
+		names = next;
+	}
+
+	hashtable_free (required);
+	/* names is NULL if the pattern had no trigrams at all. */
+	return names;
+}
+
+/* Return a sorted, NULL-terminated array of the database keys that might
+ * match any of patterns, expanding old-style multi keys as necessary, or
+ * NULL if the trigram index is unavailable or cannot narrow the search.
+ * The order is the same as that of a full MYDBM_FIRSTKEY/MYDBM_NEXTKEY
+ * scan on a database with ordered keys.
+ */
+char **dbtrigram_candidates (const char * const *patterns, int num_patterns,
+			     int pattern_regex)
+{
+	struct hashtable *names;
+	struct hashtable_iter *iter = NULL;
+	const struct nlist *elt;
+	char **keys;
+	int i, count = 0, bound = 64;
+
+	if (!dbtrigram_valid ())
+		return NULL;
+
+	names = hashtable_create (&null_hashtable_free);
+	for (i = 0; i < num_patterns; ++i) {
+		struct hashtable *matched =
+			pattern_candidates (patterns[i], pattern_regex);
+
+		if (!matched) {
+			debug ("trigram index cannot narrow \"%s\"\n",
+			       patterns[i]);
+			hashtable_free (names);
+			return NULL;
+		}
+		while ((elt = hashtable_iterate (matched, &iter)) != NULL)
+			hashtable_install (names, elt->name,
+					   strlen (elt->name), NULL);
+		hashtable_free (matched);
+	}
+
+	keys = xnmalloc (bound, sizeof *keys);
+	while ((elt = hashtable_iterate (names, &iter)) != NULL) {
+		datum key, cont;
+		char **multi_names, **multi_ext;
+		int refs, j;
+
+		memset (&key, 0, sizeof key);
+		MYDBM_SET (key, elt->name);
+		cont = MYDBM_FETCH (dbf, key);
+		if (!MYDBM_DPTR (cont))
+			continue;
+
+		if (*MYDBM_DPTR (cont) != '\t') {
+			if (count + 1 >= bound) {
+				bound *= 2;
+				keys = xnrealloc (keys, bound, sizeof *keys);
+			}
+			keys[count++] = xstrdup (elt->name);
+			MYDBM_FREE (MYDBM_DPTR (cont));
+			continue;
+		}
+
+		refs = list_extensions (MYDBM_DPTR (cont) + 1,
+					&multi_names, &multi_ext);
+		for (j = 0; j < refs; ++j) {
+			datum multi_key = make_multi_key (multi_names[j],
+							  multi_ext[j]);
+
+			if (count + 1 >= bound) {
+				bound *= 2;
+				keys = xnrealloc (keys, bound, sizeof *keys);
+			}
+			keys[count++] = MYDBM_DPTR (multi_key);
+		}
+		free (multi_names);
+		free (multi_ext);
+		MYDBM_FREE (MYDBM_DPTR (cont));
+	}
+	keys[count] = NULL;
+	hashtable_free (names);
+
+	qsort (keys, count, sizeof *keys, &candidate_compare);
+	debug ("trigram index: %d candidate keys\n", count);
+	return keys;
+}
+
+/* Return the next key from a dbtrigram_candidates() array, advancing
+ * *candidate.  The result should be freed with MYDBM_FREE, as with
+ * MYDBM_NEXTKEY.
+ */
+datum dbtrigram_nextkey (char ***candidate)
+{
+	datum key;
+
+	memset (&key, 0, sizeof key);
+	if (**candidate) {
+		MYDBM_SET (key, xstrdup (**candidate));
+		++*candidate;
+	}
+	return key;
+}
+
+void dbtrigram_free_candidates (char **candidates)
+{
+	char **candidate;
+
+	if (!candidates)
+		return;
+	for (candidate = candidates; *candidate; ++candidate)
+		free (*candidate);
+	free (candidates);
+}
@@ -37,7 +37,8 @@
 
 #include "mydbm.h"
 
-int dbver_rd (MYDBM_FILE dbfile)
+/* Return the version identifier stored in dbfile, or NULL. */
+static char *dbver_get (MYDBM_FILE dbfile)
 {
 	datum key, content;
 
@@ -49,18 +50,46 @@ int dbver_rd (MYDBM_FILE dbfile)
 
 	free (MYDBM_DPTR (key));
 
-	if (MYDBM_DPTR (content) == NULL) {
+	return MYDBM_DPTR (content);
+}
+
+/* Return zero if dbfile can be read.  Databases written with the old text
+ * record format are still readable, since split_content understands both.
+ */
+int dbver_rd (MYDBM_FILE dbfile)
+{
+	char *version = dbver_get (dbfile);
+	int ret = 0;
+
+	if (version == NULL) {
 		debug (_("warning: %s has no version identifier\n"), database);
 		return 1;
-	} else if (!STREQ (MYDBM_DPTR (content), VER_ID)) {
+	} else if (STREQ (version, VER_ID_TEXT))
+		debug ("%s is version %s, with text records\n",
+		       database, version);
+	else if (!STREQ (version, VER_ID)) {
 		debug (_("warning: %s is version %s, expecting %s\n"),
-		       database, MYDBM_DPTR (content), VER_ID);
-		MYDBM_FREE (MYDBM_DPTR (content));
-		return 1;
-	} else {
-		MYDBM_FREE (MYDBM_DPTR (content));
-		return 0;
+		       database, version, VER_ID);
+		ret = 1;
 	}
+
+	MYDBM_FREE (version);
+	return ret;
+}
+
+/* Return non-zero if dbfile is readable but uses an old record format, and
+ * so should be rebuilt.
+ */
+int dbver_outdated (MYDBM_FILE dbfile)
+{
+	char *version = dbver_get (dbfile);
+	int ret;
+
+	if (!version)
+		return 0;
+	ret = STREQ (version, VER_ID_TEXT);
+	MYDBM_FREE (version);
+	return ret;
 }
 
 void dbver_wr (MYDBM_FILE dbfile)
@@ -37,126 +37,44 @@
 #ifndef MYDBM_H
 # define MYDBM_H
 
+# include <fcntl.h>
+
+/* The datum type is fixed by the database library man-db was built
+ * against, but the storage backend behind the MYDBM_* interface is chosen
+ * at run time; see struct mydbm_backend below.
+ */
 # if defined(GDBM) && !defined(NDBM) && !defined(BTREE)
 
 #  include <gdbm.h>
 
-#  ifndef HAVE_GDBM_EXISTS
-extern inline int gdbm_exists(GDBM_FILE db, datum key);
-#  endif /* !HAVE_GDBM_EXISTS */
-
-/* gdbm_nextkey() is not lexicographically sorted, so we need to keep the
- * filename around to use as a hash key.
- */
-typedef struct {
-	char *name;
-	GDBM_FILE file;
-} *man_gdbm_wrapper;
-
-man_gdbm_wrapper man_gdbm_open_wrapper (const char *name, int flags);
-datum man_gdbm_firstkey (man_gdbm_wrapper wrap);
-datum man_gdbm_nextkey (man_gdbm_wrapper wrap, datum key);
-void man_gdbm_close (man_gdbm_wrapper wrap);
-
-#  define BLK_SIZE			0  /* to invoke normal fs block size */
-#  define DB_EXT				".db"
-#  define MYDBM_FILE 			man_gdbm_wrapper
 #  define MYDBM_DPTR(d)			((d).dptr)
 #  define MYDBM_SET_DPTR(d, value)	((d).dptr = (value))
 #  define MYDBM_DSIZE(d)		((d).dsize)
-#  define MYDBM_CTRWOPEN(file)		\
-	man_gdbm_open_wrapper(file, GDBM_NEWDB|GDBM_FAST)
-#  define MYDBM_CRWOPEN(file)		\
-	man_gdbm_open_wrapper(file, GDBM_WRCREAT|GDBM_FAST)
-#  define MYDBM_RWOPEN(file)		\
-	man_gdbm_open_wrapper(file, GDBM_WRITER|GDBM_FAST)
-#  define MYDBM_RDOPEN(file)		\
-	man_gdbm_open_wrapper(file, GDBM_READER)
-#  define MYDBM_INSERT(db, key, cont)	gdbm_store((db)->file, key, cont, GDBM_INSERT)
-#  define MYDBM_REPLACE(db, key, cont) 	gdbm_store((db)->file, key, cont, GDBM_REPLACE)
-#  define MYDBM_EXISTS(db, key)		gdbm_exists((db)->file, key)
-#  define MYDBM_DELETE(db, key)		gdbm_delete((db)->file, key)
-#  define MYDBM_FETCH(db, key)		gdbm_fetch((db)->file, key)
-#  define MYDBM_CLOSE(db)		man_gdbm_close(db)
-#  define MYDBM_FIRSTKEY(db)		man_gdbm_firstkey(db)
-#  define MYDBM_NEXTKEY(db, key)		man_gdbm_nextkey(db, key)
-#  define MYDBM_REORG(db)		gdbm_reorganize((db)->file)
-#  define MYDBM_FREE(x)			free(x)
 
 # elif defined(NDBM) && !defined(GDBM) && !defined(BTREE)
 
 #  include <ndbm.h>
 
-#  if HAVE_FCNTL_H
-#   include <fcntl.h>
-#  endif
-
 /* Berkeley db routines emulate ndbm but don't add .dir & .pag, just .db! */
 #  ifdef _DB_H_ /* has Berkeley db.h been included? */
 #   define BERKELEY_DB
 #  endif /* _DB_H_ */
 
-extern DBM *ndbm_flopen(char *file, int flags, int mode);
-extern int ndbm_flclose(DBM *db);
-
-#  define DB_EXT				""
-#  define MYDBM_FILE 			DBM*
 #  define MYDBM_DPTR(d)			((d).dptr)
 #  define MYDBM_SET_DPTR(d, value)	((d).dptr = (value))
 #  define MYDBM_DSIZE(d)		((d).dsize)
-#  define MYDBM_CTRWOPEN(file)		ndbm_flopen(file, O_TRUNC|O_CREAT|O_RDWR, DBMODE)
-#  define MYDBM_CRWOPEN(file)             ndbm_flopen(file, O_CREAT|O_RDWR, DBMODE)
-#  define MYDBM_RWOPEN(file)		ndbm_flopen(file, O_RDWR, DBMODE)
-#  define MYDBM_RDOPEN(file)		ndbm_flopen(file, O_RDONLY, DBMODE)
-#  define MYDBM_INSERT(db, key, cont)	dbm_store(db, key, cont, DBM_INSERT)
-#  define MYDBM_REPLACE(db, key, cont)   dbm_store(db, key, cont, DBM_REPLACE)
-#  define MYDBM_EXISTS(db, key)		(dbm_fetch(db, key).dptr != NULL)
-#  define MYDBM_DELETE(db, key)		dbm_delete(db, key)
-#  define MYDBM_FETCH(db, key) 		copy_datum(dbm_fetch(db, key))
-#  define MYDBM_CLOSE(db)		ndbm_flclose(db)
-#  define MYDBM_FIRSTKEY(db)		copy_datum(dbm_firstkey(db))
-#  define MYDBM_NEXTKEY(db, key)		copy_datum(dbm_nextkey(db))
-#  define MYDBM_REORG(db)		/* nothing - not implemented */
-#  define MYDBM_FREE(x)			free (x)
 
 # elif defined(BTREE) && !defined(NDBM) && !defined(GDBM)
 
 #  include <sys/types.h>
-#  include <fcntl.h>
 #  include <limits.h>
 #  include BDB_H
 
 typedef DBT datum;
 
-extern DB *btree_flopen(char *filename, int flags, int mode);
-extern int btree_close(DB *db);
-extern int btree_exists(DB *db, datum key);
-extern datum btree_fetch(DB *db, datum key);
-extern int btree_insert(DB *db, datum key, datum cont);
-extern datum btree_firstkey(DB *db);
-extern datum btree_nextkey(DB *db);
-extern int btree_replace(DB *db, datum key, datum content);
-extern int btree_nextkeydata(DB *db, datum *key, datum *cont);
-
-#  define DB_EXT			".bt"
-#  define MYDBM_FILE			DB*
 #  define MYDBM_DPTR(d)			((char *) (d).data)
 #  define MYDBM_SET_DPTR(d, value)	((d).data = (char *) (value))
 #  define MYDBM_DSIZE(d)		((d).size)
-#  define MYDBM_CTRWOPEN(file)		btree_flopen(file, O_TRUNC|O_CREAT|O_RDWR, DBMODE)
-#  define MYDBM_CRWOPEN(file)             btree_flopen(file, O_CREAT|O_RDWR, DBMODE)
-#  define MYDBM_RWOPEN(file)		btree_flopen(file, O_RDWR, DBMODE)
-#  define MYDBM_RDOPEN(file)		btree_flopen(file, O_RDONLY, DBMODE)
-#  define MYDBM_INSERT(db, key, cont)	btree_insert(db, key, cont)
-#  define MYDBM_REPLACE(db, key, cont)	btree_replace(db, key, cont)
-#  define MYDBM_EXISTS(db, key)		btree_exists(db, key)
-#  define MYDBM_DELETE(db, key)		((db->del)(db, &key, 0) ? -1 : 0)
-#  define MYDBM_FETCH(db, key)		btree_fetch(db, key)
-#  define MYDBM_CLOSE(db)		btree_close(db)
-#  define MYDBM_FIRSTKEY(db)		btree_firstkey(db)
-#  define MYDBM_NEXTKEY(db, key)	btree_nextkey(db)
-#  define MYDBM_REORG(db)		/* nothing - not implemented */
-#  define MYDBM_FREE(x)			free(x)
 
 # else /* not GDBM or NDBM or BTREE */
 #  error Define either GDBM, NDBM or BTREE before including mydbm.h
@@ -165,14 +83,113 @@ extern int btree_nextkeydata(DB *db, datum *key, datum *cont);
 #define MYDBM_RESET_DSIZE(d)		(MYDBM_DSIZE(d) = strlen(MYDBM_DPTR(d)) + 1)
 #define MYDBM_SET(d, value)		do { MYDBM_SET_DPTR(d, value); MYDBM_RESET_DSIZE(d); } while (0)
 
+/* A storage backend.  Handles are opaque to everything but the backend
+ * itself.  open() takes the open(2) flags O_RDONLY, O_RDWR, O_CREAT and
+ * O_TRUNC; O_TRUNC means that a new database is about to be written in
+ * bulk, so the backend may defer work until it is closed.  Datums
+ * returned by fetch(), the key functions and cursor_next() belong to the
+ * caller and are released with MYDBM_FREE.
+ */
+struct mydbm_backend {
+	const char *name;
+	const char *ext;		/* appended to "index" */
+	const char * const *files;	/* suffixes of the files on disk */
+	void *(*open) (const char *name, int flags, int mode);
+	void (*close) (void *db);
+	datum (*fetch) (void *db, datum key);
+	int (*store) (void *db, datum key, datum cont, int replace);
+	int (*delete) (void *db, datum key);
+	int (*exists) (void *db, datum key);
+	datum (*firstkey) (void *db);
+	datum (*nextkey) (void *db, datum key);
+	datum (*raw_firstkey) (void *db);
+	datum (*raw_nextkey) (void *db, datum key);
+	void (*reorganize) (void *db);		/* may be NULL */
+	/* Walk every key and its content in key order.  If cursor_open is
+	 * NULL or returns NULL, a cursor is built from firstkey(),
+	 * nextkey() and fetch() instead.  cursor_next() returns non-zero at
+	 * the end.
+	 */
+	void *(*cursor_open) (void *db);
+	int (*cursor_next) (void *cursor, datum *key, datum *cont);
+	void (*cursor_close) (void *cursor);
+	/* The largest content a single key can hold, or 0 if there is no
+	 * limit.
+	 */
+	size_t max_content;
+};
+
+struct mydbm_file {
+	const struct mydbm_backend *backend;
+	void *handle;
+};
+
+typedef struct mydbm_file *MYDBM_FILE;
+struct mydbm_cursor;
+
+#define MYDBM_CTRWOPEN(file)		mydbm_open(file, O_TRUNC|O_CREAT|O_RDWR)
+#define MYDBM_CRWOPEN(file)		mydbm_open(file, O_CREAT|O_RDWR)
+#define MYDBM_RWOPEN(file)		mydbm_open(file, O_RDWR)
+#define MYDBM_RDOPEN(file)		mydbm_open(file, O_RDONLY)
+#define MYDBM_INSERT(db, key, cont)	mydbm_store(db, key, cont, 0)
+#define MYDBM_REPLACE(db, key, cont)	mydbm_store(db, key, cont, 1)
+#define MYDBM_EXISTS(db, key)		((db)->backend->exists((db)->handle, key))
+#define MYDBM_DELETE(db, key)		((db)->backend->delete((db)->handle, key))
+#define MYDBM_FETCH(db, key)		mydbm_fetch(db, key)
+#define MYDBM_CLOSE(db)			mydbm_close(db)
+#define MYDBM_FIRSTKEY(db)		((db)->backend->firstkey((db)->handle))
+#define MYDBM_NEXTKEY(db, key)		((db)->backend->nextkey((db)->handle, key))
+#define MYDBM_RAW_FIRSTKEY(db)		((db)->backend->raw_firstkey((db)->handle))
+#define MYDBM_RAW_NEXTKEY(db, key)	((db)->backend->raw_nextkey((db)->handle, key))
+#define MYDBM_REORG(db)			mydbm_reorganize(db)
+#define MYDBM_CURSOR_OPEN(db)		mydbm_cursor_open(db)
+#define MYDBM_CURSOR_NEXT(cur, key, cont) mydbm_cursor_next(cur, key, cont)
+#define MYDBM_CURSOR_CLOSE(cur)		mydbm_cursor_close(cur)
+#define MYDBM_MAX_CONTENT(db)		((db)->backend->max_content)
+#define MYDBM_FREE(x)			free(x)
+
+/* MYDBM_RAW_FIRSTKEY and MYDBM_RAW_NEXTKEY walk the keys in whatever order
+ * the backend finds cheapest.  Use them when order doesn't matter.
+ */
+
 extern char *database;
 extern MYDBM_FILE dbf;
 
+/* db_backend.c */
+extern const struct mydbm_backend *mydbm_backend;
+extern void mydbm_select_backend (const char *name);
+extern void mydbm_select_backend_for_file (const char *file);
+extern char *mkdbname (const char *path);
+extern MYDBM_FILE mydbm_open (const char *name, int flags);
+extern void mydbm_close (MYDBM_FILE db);
+extern datum mydbm_fetch (MYDBM_FILE db, datum key);
+extern int mydbm_store (MYDBM_FILE db, datum key, datum cont, int replace);
+extern void mydbm_reorganize (MYDBM_FILE db);
+extern struct mydbm_cursor *mydbm_cursor_open (MYDBM_FILE db);
+extern int mydbm_cursor_next (struct mydbm_cursor *cursor,
+			      datum *key, datum *cont);
+extern void mydbm_cursor_close (struct mydbm_cursor *cursor);
+
+/* db_generation.c */
+extern char *mydbm_current (const char *name);
+extern int mydbm_copy (const char *name, const char *tmp);
+extern int mydbm_publish (const char *name, const char *tmp);
+extern void mydbm_unlink (const char *tmp);
+
+/* db_gdbm.c, db_ndbm.c, db_btree.c */
+extern const struct mydbm_backend gdbm_backend;
+extern const struct mydbm_backend ndbm_backend;
+extern const struct mydbm_backend btree_backend;
+
+/* db_sst.c */
+extern const struct mydbm_backend sst_backend;
+
 /* db_lookup.c */
 extern datum copy_datum (datum dat);
 
 /* db_ver.c */
 extern void dbver_wr(MYDBM_FILE dbfile);
 extern int dbver_rd(MYDBM_FILE dbfile);
+extern int dbver_outdated(MYDBM_FILE dbfile);
 
 #endif /* MYDBM_H */
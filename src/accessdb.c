@@ -45,6 +45,7 @@
 #include "error.h"
 
 #include "mydbm.h"
+#include "db_storage.h"
 
 char *program_name;
 const char *cat_root;
@@ -60,8 +61,18 @@ error_t argp_err_exit_status = FAIL;
 static const char args_doc[] = N_("[MAN DATABASE]");
 static const char doc[] = "\v" N_("The man database defaults to %s%s.");
 
+enum output_format {
+	FORMAT_TEXT,
+	FORMAT_JSON,
+	FORMAT_TSV,
+	FORMAT_BINARY
+};
+
+static enum output_format format = FORMAT_TEXT;
+
 static struct argp_option options[] = {
-	{ "debug",	'd',	0,	0,	N_("emit debugging messages") },
+	{ "debug",	'd',	0,		0,	N_("emit debugging messages") },
+	{ "format",	'f',	N_("FORMAT"),	0,	N_("use output format FORMAT: text, json, tsv, or binary") },
 	{ 0, 'h', 0, OPTION_HIDDEN, 0 }, /* compatibility for --help */
 	{ 0 }
 };
@@ -72,6 +83,20 @@ static error_t parse_opt (int key, char *arg, struct argp_state *state)
 		case 'd':
 			debug_level = 1;
 			return 0;
+		case 'f':
+			if (STREQ (arg, "text"))
+				format = FORMAT_TEXT;
+			else if (STREQ (arg, "json"))
+				format = FORMAT_JSON;
+			else if (STREQ (arg, "tsv"))
+				format = FORMAT_TSV;
+			else if (STREQ (arg, "binary"))
+				format = FORMAT_BINARY;
+			else
+				argp_error (state,
+					    _("unknown output format `%s'"),
+					    arg);
+			return 0;
 		case 'h':
 			argp_state_help (state, state->out_stream,
 					 ARGP_HELP_STD_HELP &
@@ -81,9 +106,10 @@ static error_t parse_opt (int key, char *arg, struct argp_state *state)
 			if (database)
 				argp_usage (state);
 			database = arg;
+			mydbm_select_backend_for_file (database);
 			return 0;
 		case ARGP_KEY_NO_ARGS:
-			database = appendstr (NULL, cat_root, MAN_DB, NULL);
+			database = mkdbname (cat_root);
 			return 0;
 	}
 	return ARGP_ERR_UNKNOWN;
@@ -93,8 +119,13 @@ static char *help_filter (int key, const char *text,
 			  void *input ATTRIBUTE_UNUSED)
 {
 	switch (key) {
-		case ARGP_KEY_HELP_POST_DOC:
-			return xasprintf (text, cat_root, MAN_DB);
+		case ARGP_KEY_HELP_POST_DOC: {
+			char *index = mkdbname ("");
+			char *ret = xasprintf (text, cat_root, index);
+
+			free (index);
+			return ret;
+		}
 		default:
 			return (char *) text;
 	}
@@ -103,6 +134,204 @@ static char *help_filter (int key, const char *text,
 static struct argp argp = { options, parse_opt, args_doc, doc, 0,
 			    help_filter };
 
+/* Unset fields are stored as "-"; export them as empty or null. */
+static const char *field (const char *value)
+{
+	if (!value || STREQ (value, "-"))
+		return NULL;
+	return value;
+}
+
+static void put_json_string (const char *value)
+{
+	const char *p;
+
+	if (!value) {
+		fputs ("null", stdout);
+		return;
+	}
+
+	putchar ('"');
+	for (p = value; *p; ++p) {
+		unsigned char c = (unsigned char) *p;
+
+		if (c == '"' || c == '\\') {
+			putchar ('\\');
+			putchar (c);
+		} else if (c < 0x20)
+			printf ("\\u%04x", c);
+		else
+			putchar (c);
+	}
+	putchar ('"');
+}
+
+/* Escape tabs, newlines and backslashes, as in PostgreSQL's text format. */
+static void put_tsv_string (const char *value)
+{
+	const char *p;
+
+	if (!value)
+		return;
+
+	for (p = value; *p; ++p) {
+		switch (*p) {
+			case '\t':
+				fputs ("\\t", stdout);
+				break;
+			case '\n':
+				fputs ("\\n", stdout);
+				break;
+			case '\\':
+				fputs ("\\\\", stdout);
+				break;
+			default:
+				putchar (*p);
+				break;
+		}
+	}
+}
+
+static void put_binary_string (const char *value)
+{
+	if (value)
+		fputs (value, stdout);
+	putchar ('\0');
+}
+
+/* Print one real page entry in the selected machine-readable format. */
+static void export_entry (const char *name, const struct mandata *info)
+{
+	switch (format) {
+		case FORMAT_JSON:
+			fputs ("{\"name\":", stdout);
+			put_json_string (name);
+			fputs (",\"section\":", stdout);
+			put_json_string (info->sec);
+			fputs (",\"ext\":", stdout);
+			put_json_string (info->ext);
+			printf (",\"id\":\"%c\",\"pointer\":", info->id);
+			put_json_string (field (info->pointer));
+			fputs (",\"filter\":", stdout);
+			put_json_string (field (info->filter));
+			fputs (",\"comp\":", stdout);
+			put_json_string (field (info->comp));
+			printf (",\"mtime\":%ld,\"whatis\":",
+				(long) info->_st_mtime);
+			put_json_string (*info->whatis ? info->whatis : NULL);
+			fputs ("}\n", stdout);
+			break;
+
+		case FORMAT_TSV:
+			put_tsv_string (name);
+			putchar ('\t');
+			put_tsv_string (info->sec);
+			putchar ('\t');
+			put_tsv_string (info->ext);
+			printf ("\t%c\t", info->id);
+			put_tsv_string (field (info->pointer));
+			putchar ('\t');
+			put_tsv_string (field (info->filter));
+			putchar ('\t');
+			put_tsv_string (field (info->comp));
+			printf ("\t%ld\t", (long) info->_st_mtime);
+			put_tsv_string (info->whatis);
+			putchar ('\n');
+			break;
+
+		case FORMAT_BINARY: {
+			/* Big-endian 64-bit mtime and the id byte, followed
+			 * by NUL-terminated strings.
+			 */
+			unsigned long long mtime =
+				(unsigned long long) info->_st_mtime;
+			int shift;
+
+			for (shift = 56; shift >= 0; shift -= 8)
+				putchar ((mtime >> shift) & 0xff);
+			putchar (info->id);
+			put_binary_string (name);
+			put_binary_string (info->sec);
+			put_binary_string (info->ext);
+			put_binary_string (field (info->pointer));
+			put_binary_string (field (info->filter));
+			put_binary_string (field (info->comp));
+			put_binary_string (info->whatis);
+			break;
+		}
+
+		case FORMAT_TEXT:
+			break;
+	}
+}
+
+/* Show a page entry in the traditional text layout. */
+static void show_entry (const char *name, const struct mandata *info)
+{
+	printf ("\"%s %s %s %ld %c %s %s %s %s\"\n",
+		dash_if_unset (name), info->ext, info->sec,
+		(long) info->_st_mtime, info->id, info->pointer, info->filter,
+		info->comp, info->whatis);
+}
+
+/* Dump every real page entry in one pass over the database, in whatever
+ * order the database happens to store them.  Special keys, and the lists
+ * of multi keys in older databases, are skipped.
+ */
+static int export_database (void)
+{
+	static char buf[64 * 1024];
+	datum key;
+	int ret = OK;
+
+	setvbuf (stdout, buf, _IOFBF, sizeof buf);
+
+	if (format == FORMAT_TSV)
+		fputs ("name\tsection\text\tid\tpointer\tfilter\tcomp\t"
+		       "mtime\twhatis\n", stdout);
+
+	key = MYDBM_RAW_FIRSTKEY (dbf);
+	while (MYDBM_DPTR (key) != NULL) {
+		datum content, nextkey;
+		struct mandata *list, *info;
+		char *tab;
+
+		if (*MYDBM_DPTR (key) == '$')
+			goto next;
+
+		content = MYDBM_FETCH (dbf, key);
+		if (!MYDBM_DPTR (content)) {
+			debug ("key %s has no content!\n", MYDBM_DPTR (key));
+			ret = FATAL;
+			goto next;
+		}
+		if (*MYDBM_DPTR (content) == '\t') {
+			MYDBM_FREE (MYDBM_DPTR (content));
+			goto next;
+		}
+
+		list = split_content_list (MYDBM_DPTR (content),
+					   MYDBM_DSIZE (content));
+		tab = strchr (MYDBM_DPTR (key), '\t');
+		if (tab)
+			*tab = '\0';
+		for (info = list; info; info = info->next)
+			export_entry (info->name ? info->name
+						 : MYDBM_DPTR (key), info);
+		if (tab)
+			*tab = '\t';
+		free_mandata_struct (list);
+next:
+		nextkey = MYDBM_RAW_NEXTKEY (dbf, key);
+		MYDBM_FREE (MYDBM_DPTR (key));
+		key = nextkey;
+	}
+
+	if (fflush (stdout) == EOF)
+		error (FATAL, errno, _("can't write to standard output"));
+	return ret;
+}
+
 int main (int argc, char *argv[])
 {
 	datum key;
@@ -129,6 +358,12 @@ int main (int argc, char *argv[])
 	if (!dbf)
 		error (FATAL, errno, _("can't open %s for reading"), database);
 
+	if (format != FORMAT_TEXT) {
+		ret = export_database ();
+		MYDBM_CLOSE (dbf);
+		exit (ret);
+	}
+
 	key = MYDBM_FIRSTKEY (dbf);
 
 	while (MYDBM_DPTR (key) != NULL) {
@@ -144,11 +379,45 @@ int main (int argc, char *argv[])
 		nicekey = xstrdup (MYDBM_DPTR (key));
 		while ( (t = strchr (nicekey, '\t')) )
 			*t = '~';
-		while ( (t = strchr (MYDBM_DPTR (content), '\t')) )
-			*t = ' ';
-		printf ("%s -> \"%s\"\n", nicekey, MYDBM_DPTR (content));
+		if (*MYDBM_DPTR (key) != '$' &&
+		    *MYDBM_DPTR (content) == MULTI_MAGIC) {
+			/* pages sharing a key; show them as the multi keys
+			   that older databases used */
+			struct mandata *list, *info;
+
+			list = split_content_list (MYDBM_DPTR (content),
+						   MYDBM_DSIZE (content));
+			printf ("%s -> \"", nicekey);
+			for (info = list; info; info = info->next)
+				printf (" %s %s", info->name ? info->name
+							     : nicekey,
+					info->ext);
+			printf ("\"\n");
+			for (info = list; info; info = info->next) {
+				printf ("%s~%s -> ", info->name ? info->name
+								: nicekey,
+					info->ext);
+				show_entry (NULL, info);
+			}
+			free_mandata_struct (list);
+		} else if (*MYDBM_DPTR (key) != '$' &&
+			   *MYDBM_DPTR (content) != '\t') {
+			/* a real page; show it in the traditional layout */
+			struct mandata info;
+
+			split_content (MYDBM_DPTR (content),
+				       MYDBM_DSIZE (content), &info);
+			printf ("%s -> ", nicekey);
+			show_entry (info.name, &info);
+			free_mandata_elements (&info);
+		} else {
+			while ( (t = strchr (MYDBM_DPTR (content), '\t')) )
+				*t = ' ';
+			printf ("%s -> \"%s\"\n", nicekey,
+				MYDBM_DPTR (content));
+			MYDBM_FREE (MYDBM_DPTR (content));
+		}
 		free (nicekey); 
-		MYDBM_FREE (MYDBM_DPTR (content));
 next:
 		nextkey = MYDBM_NEXTKEY (dbf, key);
 		MYDBM_FREE (MYDBM_DPTR (key));
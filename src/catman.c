@@ -32,7 +32,6 @@
 #endif /* HAVE_CONFIG_H */
 
 #include <stdio.h>
-#include <assert.h>
 #include <sys/types.h>
 #include <errno.h>
 #include <string.h>
@@ -85,6 +84,7 @@ int quiet = 1;
 MYDBM_FILE dbf;
 char *manp;
 extern char *user_config_file;
+extern char *db_backend;
 char *database;
 static const char **sections;
 
@@ -278,15 +278,24 @@ static int parse_for_sec (const char *manpath, const char *section)
 
 			/* ignore overflow entries */
 			if (*MYDBM_DPTR (content) != '\t') { 
-				struct mandata entry;
-
-				split_content (MYDBM_DPTR (content), &entry);
-
-				/* Accept if the entry is an ultimate manual
-				   page and the section matches the one we're
-				   currently dealing with */
-				if (entry.id == ULT_MAN && 
-				    strcmp (entry.sec, section) == 0) {
+				struct mandata *list, *entry;
+				int wanted = 0;
+
+				/* Accept if any of the entries is an ultimate
+				   manual page and the section matches the one
+				   we're currently dealing with */
+				list = split_content_list
+					(MYDBM_DPTR (content),
+					 MYDBM_DSIZE (content));
+				for (entry = list; entry; entry = entry->next)
+					if (entry->id == ULT_MAN && 
+					    strcmp (entry->sec, section) == 0)
+						wanted = 1;
+				free_mandata_struct (list);
+				/* freed along with list */
+				MYDBM_SET_DPTR (content, NULL);
+
+				if (wanted) {
 					if (message) {
 						printf (_("\nUpdating cat files for section %s of man hierarchy %s\n"),
 							section, manpath);
@@ -311,14 +320,9 @@ static int parse_for_sec (const char *manpath, const char *section)
 				    		arg_size = initial_bit;
 				    	}
 				}
-
-				/* == MYDBM_DPTR (content), freed below */
-				entry.addr = NULL;
-				free_mandata_elements (&entry);
 			}
 			
 			/* we don't need the content ever again */
-			assert (MYDBM_DPTR (content)); /* just to be sure */
 			MYDBM_FREE (MYDBM_DPTR (content));
 		}
 
@@ -377,6 +381,7 @@ int main (int argc, char *argv[])
 
 	/* This is required for get_catpath(), regardless */
 	sys_manp = get_manpath (NULL);
+	mydbm_select_backend (db_backend);
 
 	/* pick up the system manpath or use the supplied one */
 	if (!manp) {
@@ -39,6 +39,7 @@
 #include <time.h>
 #include <errno.h>
 #include <ctype.h>
+#include <limits.h>
 
 #ifdef HAVE_DIRENT_H
 #  include <dirent.h>
@@ -66,8 +67,13 @@
 #include "manconfig.h"
 
 #include "error.h"
+#include "cleanup.h"
 #include "hashtable.h"
 #include "security.h"
+#include "pipeline.h"
+#include "decompress.h"
+#include "encodings.h"
+#include "stats.h"
 
 #include "mydbm.h"
 #include "db_storage.h"
@@ -87,6 +93,7 @@ static struct hashtable *whatis_hash = NULL;
 
 struct whatis_hashent {
 	char *whatis;
+	const char *encoding;
 	struct ult_trace trace;
 };
 
@@ -99,6 +106,167 @@ static void whatis_hashtable_free (void *defn)
 	free (hashent);
 }
 
+/* What the database holds for each page name and extension, so that
+ * test_manfile() can usually tell whether a file is already up to date
+ * without fetching it.  testmandirs() fills this in with one pass over the
+ * database if it is going to check enough pages to make that worthwhile,
+ * or leaves it empty when it has just created the database.
+ * Anything stored or deleted later is marked as needing a real lookup.
+ */
+struct known_page {
+	char *name;		/* NULL if named by its key */
+	char *comp;
+	time_t mtime;
+	char id;
+	int probe;		/* must look in the database */
+};
+
+/* testmandirs() only fills in known_pages if more than this fraction (one
+ * in N) of the hierarchy looks modified.
+ */
+#define KNOWN_PAGES_PREFETCH_RATIO 4
+
+static struct hashtable *known_pages = NULL;
+static unsigned long known_pages_answered, known_pages_probed;
+
+static void known_page_free (void *defn)
+{
+	struct known_page *known = defn;
+
+	free (known->name);
+	free (known->comp);
+	free (known);
+}
+
+static char *known_page_key (const char *name, const char *ext)
+{
+	char *key = name_to_key (name);
+
+	return appendstr (key, "\t", ext, NULL);
+}
+
+/* Note that NAME(EXT) must be looked up in the database if it is met
+ * again.
+ */
+static void known_page_probe (const char *name, const char *ext)
+{
+	struct known_page *known;
+	char *key;
+
+	if (!known_pages)
+		return;
+	known = XZALLOC (struct known_page);
+	known->probe = 1;
+	key = known_page_key (name, ext);
+	hashtable_install (known_pages, key, strlen (key), known);
+	free (key);
+}
+
+/* Record every page in the database. */
+static void known_pages_prefetch (void)
+{
+	struct mydbm_cursor *cursor = MYDBM_CURSOR_OPEN (dbf);
+	datum key, cont;
+	unsigned long count = 0;
+
+	while (!MYDBM_CURSOR_NEXT (cursor, &key, &cont)) {
+		struct mandata *list, *entry;
+		char *nicekey, *tab;
+
+		if (*MYDBM_DPTR (key) == '$' || !MYDBM_DPTR (cont) ||
+		    *MYDBM_DPTR (cont) == '\t')
+			goto next;
+
+		/* Multi keys are named after the page, not its key. */
+		nicekey = name_to_key (MYDBM_DPTR (key));
+		tab = strchr (nicekey, '\t');
+		if (tab)
+			*tab = '\0';
+
+		list = split_content_list (MYDBM_DPTR (cont),
+					   MYDBM_DSIZE (cont));
+		MYDBM_SET_DPTR (cont, NULL); /* owned by list */
+		for (entry = list; entry; entry = entry->next) {
+			struct known_page *known;
+			char *page_key;
+
+			page_key = appendstr (NULL, nicekey, "\t",
+					      entry->ext, NULL);
+			known = hashtable_lookup (known_pages, page_key,
+						  strlen (page_key));
+			if (known)
+				/* Names differing only in case. */
+				known->probe = 1;
+			else {
+				known = XZALLOC (struct known_page);
+				known->name = entry->name ?
+					xstrdup (entry->name) : NULL;
+				known->comp = xstrdup (entry->comp);
+				known->mtime = entry->_st_mtime;
+				known->id = entry->id;
+				hashtable_install (known_pages, page_key,
+						   strlen (page_key), known);
+			}
+			free (page_key);
+			++count;
+		}
+		free_mandata_struct (list);
+		free (nicekey);
+next:
+		MYDBM_FREE (MYDBM_DPTR (cont));
+		MYDBM_FREE (MYDBM_DPTR (key));
+	}
+	MYDBM_CURSOR_CLOSE (cursor);
+
+	debug ("known_pages_prefetch(): %lu pages\n", count);
+}
+
+static void known_pages_free (void)
+{
+	if (!known_pages)
+		return;
+	debug ("test_manfile(): %lu lookups answered from memory, "
+	       "%lu database fetches\n",
+	       known_pages_answered, known_pages_probed);
+	hashtable_free (known_pages);
+	known_pages = NULL;
+}
+
+/* Look up NAME(EXT) as dblookup_exact (NAME, EXT, 1) would.  If the page
+ * is recorded as up to date with respect to INFO, set *CURRENT and return
+ * NULL without touching the database.
+ */
+static struct mandata *lookup_manfile (const char *name,
+				       const struct mandata *info,
+				       int *current)
+{
+	struct known_page *known;
+	char *key;
+
+	*current = 0;
+	if (!known_pages) {
+		++known_pages_probed;
+		return dblookup_exact (name, info->ext, 1);
+	}
+
+	key = known_page_key (name, info->ext);
+	known = hashtable_lookup (known_pages, key, strlen (key));
+	free (key);
+	if (!known) {
+		++known_pages_answered;
+		return NULL;
+	}
+	if (!known->probe && (!known->name || STREQ (known->name, name)) &&
+	    STREQ (known->comp, info->comp ? info->comp : "-") &&
+	    known->mtime == info->_st_mtime && known->id < WHATIS_MAN) {
+		++known_pages_answered;
+		*current = 1;
+		return NULL;
+	}
+	++known_pages_probed;
+	return dblookup_exact (name, info->ext, 1);
+}
+
 static void gripe_multi_extensions (const char *path, const char *sec, 
 				    const char *name, const char *ext)
 {
@@ -121,31 +289,276 @@ static void gripe_rwopen_failed (void)
 	}
 }
 
+/* Read a page for its whatis, filters, and encoding.  The caller must have
+ * dropped privileges.
+ */
+static void scan_page (const char *ult, const char *file_base, lexgrog *lg,
+		       const char **encoding)
+{
+	lg->type = MANPAGE;
+	find_name_and_encoding (ult, file_base, lg, encoding);
+	debug ("scan_page(): %s is %s\n",
+	       ult, *encoding ? *encoding : "unknown");
+}
+
+#ifdef SECURE_MAN_UID
+/* When running setuid, pages are read by a worker process that drops
+ * privileges once and for all, rather than by dropping and regaining them
+ * around every page.  The worker reads the ultimate source and base name of
+ * each page from its standard input, and writes back the whatis, filters,
+ * and encoding.  Every string is terminated by a NUL, and each reply field
+ * starts with '+' if it is set or '-' if not.  Replies come back in the
+ * order of the requests, so several requests may be outstanding at once.
+ */
+static pipeline *scan_worker;
+static int scan_worker_failed;
+
+static void put_reply_field (const char *str)
+{
+	if (str) {
+		putchar ('+');
+		fputs (str, stdout);
+	} else
+		putchar ('-');
+	putchar ('\0');
+}
+
+static void scan_worker_run (void *data ATTRIBUTE_UNUSED)
+{
+	char *ult = NULL, *file_base = NULL;
+	size_t ult_size = 0, file_base_size = 0;
+
+	drop_privs_permanently ();
+
+	while (getdelim (&ult, &ult_size, '\0', stdin) > 0 &&
+	       getdelim (&file_base, &file_base_size, '\0', stdin) > 0) {
+		lexgrog lg;
+		const char *encoding;
+
+		memset (&lg, 0, sizeof lg);
+		scan_page (ult, file_base, &lg, &encoding);
+		put_reply_field (lg.whatis);
+		put_reply_field (lg.filters);
+		put_reply_field (encoding);
+		if (fflush (stdout) == EOF)
+			break;
+		free (lg.whatis);
+		free (lg.filters);
+	}
+
+	free (ult);
+	free (file_base);
+}
+
+static void scan_worker_stop (void *data ATTRIBUTE_UNUSED)
+{
+	if (!scan_worker)
+		return;
+	pipeline_wait (scan_worker);
+	pipeline_free (scan_worker);
+	scan_worker = NULL;
+}
+
+/* Read one reply field from the worker.  Returns zero at end of file. */
+static int get_reply_field (FILE *replies, char **str)
+{
+	char *buf = NULL;
+	size_t size = 0;
+
+	if (getdelim (&buf, &size, '\0', replies) <= 0 || *buf == '\0') {
+		free (buf);
+		return 0;
+	}
+	if (*buf == '+')
+		*str = xstrdup (buf + 1);
+	else
+		*str = NULL;
+	free (buf);
+	return 1;
+}
+
+/* Start the worker if necessary.  Returns zero if it is not available. */
+static int scan_worker_start (void)
+{
+	if (scan_worker_failed)
+		return 0;
+	if (!scan_worker) {
+		pipecmd *cmd = pipecmd_new_function ("unprivileged scanner",
+						     &scan_worker_run, NULL,
+						     NULL);
+		scan_worker = pipeline_new_commands (cmd, NULL);
+		pipeline_want_in (scan_worker, -1);
+		pipeline_want_out (scan_worker, -1);
+		STATS_ADD (STATS_PIPELINES, 1);
+		pipeline_start (scan_worker);
+		push_cleanup (scan_worker_stop, NULL, 0);
+	}
+	return 1;
+}
+
+static void scan_worker_give_up (void)
+{
+	debug ("unprivileged scanner failed; scanning pages directly\n");
+	scan_worker_stop (NULL);
+	scan_worker_failed = 1;
+}
+
+/* Ask the worker to scan a page, without waiting for the reply.  Returns
+ * zero on failure.
+ */
+static int scan_worker_request (const char *ult, const char *file_base)
+{
+	FILE *requests = pipeline_get_infile (scan_worker);
+
+	fputs (ult, requests);
+	putc ('\0', requests);
+	fputs (file_base, requests);
+	putc ('\0', requests);
+	return fflush (requests) != EOF;
+}
+
+/* Read the worker's reply to its oldest outstanding request.  Returns zero
+ * on failure.
+ */
+static int scan_worker_reply (lexgrog *lg, const char **encoding)
+{
+	FILE *replies = pipeline_get_outfile (scan_worker);
+	char *reply_encoding = NULL;
+
+	if (!get_reply_field (replies, &lg->whatis) ||
+	    !get_reply_field (replies, &lg->filters) ||
+	    !get_reply_field (replies, &reply_encoding)) {
+		free (lg->whatis);
+		free (lg->filters);
+		lg->whatis = lg->filters = NULL;
+		return 0;
+	}
+
+	/* Keep to the static strings returned by encoding_check_result. */
+	if (reply_encoding && STREQ (reply_encoding, "ASCII"))
+		*encoding = "ASCII";
+	else if (reply_encoding && STREQ (reply_encoding, "UTF-8"))
+		*encoding = "UTF-8";
+	else
+		*encoding = NULL;
+	free (reply_encoding);
+	return 1;
+}
+#endif /* SECURE_MAN_UID */
+
+/* A page that test_manfile has traced to its ultimate source, and whose
+ * whatis is either known or still to be read.
+ */
+struct manfile_job {
+	char *manpage;			/* owns the strings in info */
+	const char *manpage_base;
+	char *file_base;
+	const char *path;
+	struct mandata info;
+	char *ult;
+	struct ult_trace ult_trace;
+	struct lexgrog lg;
+	const char *encoding;
+	struct whatis_hashent *whatis;	/* NULL until the page is read */
+	struct manfile_job *next;
+};
+
+/* Pages waiting for replies from the worker, oldest first.  Requests are
+ * written without waiting, so that the worker reads one page while we
+ * trace the next; their total size is kept within PIPE_BUF so that writing
+ * them can never block while the worker is waiting for us to read replies.
+ */
+static struct manfile_job *scan_queue, **scan_queue_tail = &scan_queue;
+static size_t scan_queue_bytes;
+
+static void test_manfile_finish (struct manfile_job *job);
+
+/* Read the page for JOB in this process. */
+static void scan_job_locally (struct manfile_job *job)
+{
+	drop_effective_privs ();
+	scan_page (job->ult, job->file_base, &job->lg, &job->encoding);
+	regain_effective_privs ();
+}
+
+/* Finish every page waiting for the worker. */
+static void scan_queue_drain (void)
+{
+	enum stats_phase previous;
+
+	if (!scan_queue)
+		return;
+
+	previous = stats_enter (STATS_FIND_NAME);
+	while (scan_queue) {
+		struct manfile_job *job = scan_queue;
+
+		scan_queue = job->next;
+#ifdef SECURE_MAN_UID
+		if (!scan_worker ||
+		    !scan_worker_reply (&job->lg, &job->encoding)) {
+			if (scan_worker)
+				scan_worker_give_up ();
+			scan_job_locally (job);
+		}
+#else /* !SECURE_MAN_UID */
+		scan_job_locally (job);
+#endif /* SECURE_MAN_UID */
+		stats_leave (previous);
+		test_manfile_finish (job);
+		previous = stats_enter (STATS_FIND_NAME);
+	}
+	stats_leave (previous);
+	scan_queue_tail = &scan_queue;
+	scan_queue_bytes = 0;
+}
+
+/* Return non-zero if a page waiting for the worker might be stored under
+ * NAME or have the ultimate source ULT (either may be NULL), in which case
+ * it must be finished before we can look at another such page.
+ */
+static int scan_queue_conflicts (const char *name, const char *ult)
+{
+	const struct manfile_job *job;
+
+	for (job = scan_queue; job; job = job->next)
+		if ((name && strcasecmp (job->manpage_base, name) == 0) ||
+		    (ult && STREQ (job->ult, ult)))
+			return 1;
+	return 0;
+}
+
 /* Take absolute filename and path (for ult_src) and do sanity checks on
  * file. Also check that file is non-zero in length and is not already in
  * the db. If not, find its ult_src() and see if we have the whatis cached,
- * otherwise cache it in case we trace another manpage back to it. Next,
- * store it in the db along with any references found in the whatis.
+ * otherwise cache it in case we trace another manpage back to it.
+ *
+ * Returns the page, still to be read if its whatis is not cached, or NULL
+ * if there is nothing more to do.
  */
-void test_manfile (const char *file, const char *path)
+static struct manfile_job *test_manfile_start (const char *file,
+					       const char *path)
 {
 	char *manpage_base;
 	const char *ult;
-	struct lexgrog lg;
 	char *manpage;
 	struct mandata info, *exists;
 	struct stat buf;
 	size_t len;
 	struct ult_trace ult_trace;
 	struct whatis_hashent *whatis;
+	struct manfile_job *job;
+	int current;
+	enum stats_phase previous;
+
+	STATS_ADD (STATS_FILES, 1);
 
-	memset (&lg, 0, sizeof (struct lexgrog));
 	memset (&info, 0, sizeof (struct mandata));
 	memset (&ult_trace, 0, sizeof (struct ult_trace));
 
 	manpage = filename_info (file, &info, NULL);
 	if (!manpage)
-		return;
+		return NULL;
 	manpage_base = manpage + strlen (manpage) + 1;
 
 	len  = strlen (manpage) + 1;		/* skip over directory name */
@@ -160,14 +573,22 @@ void test_manfile (const char *file, const char *path)
 	if (buf.st_size == 0) {
 		/* man-db pre 2.3 place holder ? */
 		free (manpage);
-		return;
+		return NULL;
 	}
 
+	/* A page with this name may be on its way into the database. */
+	if (scan_queue_conflicts (manpage_base, NULL))
+		scan_queue_drain ();
+
 	/* See if we already have it, before going any further. This will
 	 * save both an ult_src() and a find_name(), amongst other wastes of
 	 * time.
 	 */
-	exists = dblookup_exact (manpage_base, info.ext, 1);
+	exists = lookup_manfile (manpage_base, &info, &current);
+	if (current) {
+		free (manpage);
+		return NULL;
+	}
 
 	/* Ensure we really have the actual page. Gzip keeps the mtime the
 	 * same when it compresses, so we have to compare compression
@@ -179,7 +600,7 @@ void test_manfile (const char *file, const char *path)
 			    && exists->id < WHATIS_MAN) {
 				free_mandata_struct (exists);
 				free (manpage);
-				return;
+				return NULL;
 			}
 		} else {
 			struct stat physical;
@@ -192,15 +613,20 @@ void test_manfile (const char *file, const char *path)
 						      exists, "man");
 			debug ("test_manfile(): stat %s\n", abs_filename);
 			if (stat (abs_filename, &physical) == -1) {
-				if (!opt_test)
+				if (!opt_test) {
+					previous = stats_enter (STATS_DBSTORE);
 					dbdelete (manpage_base, exists);
+					stats_leave (previous);
+					known_page_probe (manpage_base,
+							  exists->ext);
+				}
 			} else {
 				gripe_multi_extensions (path, exists->sec,
 							manpage_base,
 							exists->ext);
 				free_mandata_struct (exists);
 				free (manpage);
-				return;
+				return NULL;
 			}
 		}
 		free_mandata_struct (exists);
@@ -214,7 +640,9 @@ void test_manfile (const char *file, const char *path)
 		/* Avoid too much noise in debug output */
 		int save_debug = debug_level;
 		debug_level = 0;
+		previous = stats_enter (STATS_ULT_SRC);
 		ult = ult_src (file, path, &buf, SOFT_LINK | HARD_LINK, NULL);
+		stats_leave (previous);
 		debug_level = save_debug;
 	}
 
@@ -222,12 +650,16 @@ void test_manfile (const char *file, const char *path)
 		/* already warned about this, don't do so again */
 		debug ("test_manfile(): bad link %s\n", file);
 		free (manpage);
-		return;
+		return NULL;
 	}
 
 	if (!whatis_hash)
 		whatis_hash = hashtable_create (&whatis_hashtable_free);
 
+	/* The worker may be reading this source for another page. */
+	if (scan_queue_conflicts (NULL, ult))
+		scan_queue_drain ();
+
 	whatis = hashtable_lookup (whatis_hash, ult, strlen (ult));
 	if (!whatis) {
 		if (!STRNEQ (ult, file, len))
@@ -238,8 +670,10 @@ void test_manfile (const char *file, const char *path)
 		 * looking for whatis info in files containing only '.so
 		 * manx/foo.x', which will give us an unobtainable whatis
 		 * for the entry. */
+		previous = stats_enter (STATS_ULT_SRC);
 		ult = ult_src (file, path, &buf,
 			       SO_LINK | SOFT_LINK | HARD_LINK, &ult_trace);
+		stats_leave (previous);
 	}
 
 	if (!ult) {
@@ -248,7 +682,7 @@ void test_manfile (const char *file, const char *path)
 			       _("warning: %s: bad symlink or ROFF `.so' request"),
 			       file);
 		free (manpage);
-		return;
+		return NULL;
 	}
 
 	pages++;			/* pages seen so far */
@@ -258,6 +692,15 @@ void test_manfile (const char *file, const char *path)
 	else
 		info.id = SO_MAN;	/* .so, sym or hard linked file */
 
+	job = XZALLOC (struct manfile_job);
+	job->manpage = manpage;
+	job->manpage_base = manpage_base;
+	job->file_base = base_name (file);
+	job->path = path;
+	job->info = info;
+	job->ult = xstrdup (ult);
+	job->ult_trace = ult_trace;
+
 	/* Ok, here goes: Use a hash tree to store the ult_srcs with
 	 * their whatis. Anytime after, check the hash tree, if it's there, 
 	 * use it. This saves us a find_name() which is a real hog.
@@ -266,54 +709,139 @@ void test_manfile (const char *file, const char *path)
 	 * clear the hash between calls.
 	 */
 
-	if (whatis)
-		lg.whatis = whatis->whatis ? xstrdup (whatis->whatis) : NULL;
-	else {
-		/* Cache miss; go and get the whatis info in its raw state. */
-		char *file_base = base_name (file);
+	if (whatis) {
+		STATS_ADD (STATS_WHATIS_HITS, 1);
+		job->lg.whatis = whatis->whatis ? xstrdup (whatis->whatis)
+						: NULL;
+		job->whatis = whatis;
+	} else
+		/* Cache miss; the caller must get the whatis info in its
+		 * raw state.
+		 */
+		STATS_ADD (STATS_WHATIS_MISSES, 1);
+
+	return job;
+}
 
-		lg.type = MANPAGE;
-		drop_effective_privs ();
-		find_name (ult, file_base, &lg, NULL);
-		free (file_base);
-		regain_effective_privs ();
+/* Store JOB's page in the db along with any references found in the
+ * whatis, and free JOB.
+ */
+static void test_manfile_finish (struct manfile_job *job)
+{
+	struct mandata *info = &job->info;
+	struct whatis_hashent *whatis = job->whatis;
+	enum stats_phase previous;
 
+	if (!whatis) {
 		whatis = XMALLOC (struct whatis_hashent);
-		whatis->whatis = lg.whatis ? xstrdup (lg.whatis) : NULL;
-		/* We filled out ult_trace above. */
-		memcpy (&whatis->trace, &ult_trace, sizeof (ult_trace));
-		hashtable_install (whatis_hash, ult, strlen (ult), whatis);
+		whatis->whatis = job->lg.whatis ? xstrdup (job->lg.whatis)
+						: NULL;
+		whatis->encoding = job->encoding;
+		/* test_manfile_start filled out ult_trace. */
+		memcpy (&whatis->trace, &job->ult_trace,
+			sizeof (job->ult_trace));
+		hashtable_install (whatis_hash, job->ult, strlen (job->ult),
+				   whatis);
 	}
 
-	debug ("\"%s\"\n", lg.whatis);
+	debug ("\"%s\"\n", job->lg.whatis);
 
 	/* split up the raw whatis data and store references */
-	info.pointer = NULL;	/* direct page, so far */
-	info.filter = lg.filters;
-	if (lg.whatis) {
+	info->pointer = NULL;	/* direct page, so far */
+	info->filter = job->lg.filters;
+	/* man only trusts this for the page itself, so don't bother
+	 * recording it for links.
+	 */
+	if (info->id == ULT_MAN)
+		info->encoding = whatis->encoding;
+	if (job->lg.whatis) {
 		struct page_description *descs =
-			parse_descriptions (manpage_base, lg.whatis);
+			parse_descriptions (job->manpage_base, job->lg.whatis);
 		if (descs) {
-			if (!opt_test)
-				store_descriptions (descs, &info,
-						    path, manpage_base,
+			if (!opt_test) {
+				const struct page_description *desc;
+
+				previous = stats_enter (STATS_DBSTORE);
+				store_descriptions (descs, info, job->path,
+						    job->manpage_base,
 						    &whatis->trace);
+				stats_leave (previous);
+				for (desc = descs; desc; desc = desc->next)
+					known_page_probe (desc->name,
+							  info->ext);
+			}
 			free_descriptions (descs);
 		}
 	} else if (quiet < 2) {
-		(void) stat (ult, &buf);
-		if (buf.st_size == 0)
+		struct stat buf;
+
+		if (stat (job->ult, &buf) == 0 && buf.st_size == 0)
 			error (0, 0, _("warning: %s: ignoring empty file"),
-			       ult);
+			       job->ult);
 		else
 			error (0, 0,
 			       _("warning: %s: whatis parse for %s(%s) failed"),
-			       ult, manpage_base, info.ext);
+			       job->ult, job->manpage_base, info->ext);
 	}
 
-	free (manpage);
-	if (lg.whatis)
-		free (lg.whatis);
+	free (job->manpage);
+	free (job->file_base);
+	free (job->ult);
+	free (job->lg.whatis);
+	free (job->lg.filters);
+	free (job);
+}
+
+/* Check FILE and bring its database entries up to date.  If its whatis has
+ * to be read and we are running setuid, leave it to the worker and return
+ * at once; scan_queue_drain() finishes the page.
+ */
+static void test_manfile_queued (const char *file, const char *path)
+{
+	struct manfile_job *job = test_manfile_start (file, path);
+	enum stats_phase previous;
+
+	if (!job)
+		return;
+	if (job->whatis) {
+		test_manfile_finish (job);
+		return;
+	}
+
+	/* Go and get the whatis info in its raw state.  Pages that need no
+	 * encoding conversion can be parsed as they are.
+	 */
+#ifdef SECURE_MAN_UID
+	if (running_setuid () && scan_worker_start ()) {
+		size_t bytes = strlen (job->ult) + strlen (job->file_base) + 2;
+		int sent;
+
+		if (scan_queue && scan_queue_bytes + bytes > PIPE_BUF)
+			scan_queue_drain ();
+		previous = stats_enter (STATS_FIND_NAME);
+		sent = scan_worker_request (job->ult, job->file_base);
+		stats_leave (previous);
+		if (sent) {
+			*scan_queue_tail = job;
+			scan_queue_tail = &job->next;
+			scan_queue_bytes += bytes;
+			return;
+		}
+		scan_worker_give_up ();
+	}
+#endif /* SECURE_MAN_UID */
+
+	previous = stats_enter (STATS_FIND_NAME);
+	scan_job_locally (job);
+	stats_leave (previous);
+	test_manfile_finish (job);
+}
+
+/* Check FILE and bring its database entries up to date. */
+void test_manfile (const char *file, const char *path)
+{
+	test_manfile_queued (file, path);
+	scan_queue_drain ();
 }
 
 static inline void add_dir_entries (const char *path, char *infile)
@@ -322,6 +850,8 @@ static inline void add_dir_entries (const char *path, char *infile)
 	int len;
 	struct dirent *newdir;
 	DIR *dir;
+	char **names = NULL;
+	size_t names_len = 0, names_max = 0, i;
 
 	manpage = appendstr (NULL, path, "/", infile, "/", NULL);
 	len = strlen (manpage);
@@ -337,19 +867,38 @@ static inline void add_dir_entries (const char *path, char *infile)
 		free (manpage);
                 return;
         }
-        
-        /* strlen(newdir->d_name) could be replaced by newdir->d_reclen */
-        
-	while ( (newdir = readdir (dir)) )
+
+	/* Read the whole directory first, noting hard links as we go, so
+	 * that ult_src() can resolve them without reading it again.
+	 */
+	manpage[len - 1] = '\0';
+	ult_hardlinks_begin (manpage);
+	manpage[len - 1] = '/';
+	while ( (newdir = readdir (dir)) ) {
+		ult_hardlinks_add (newdir->d_ino, newdir->d_name);
 		if (!(*newdir->d_name == '.' && 
 		      strlen (newdir->d_name) < (size_t) 3)) {
-			manpage = appendstr (manpage, newdir->d_name, NULL);
-			test_manfile (manpage, path);
-			*(manpage + len) = '\0';
+			if (names_len >= names_max) {
+				names_max = names_max ? names_max * 2 : 64;
+				names = xnrealloc (names, names_max,
+						   sizeof *names);
+			}
+			names[names_len++] = xstrdup (newdir->d_name);
 		}
-		
-	free (manpage);
+	}
 	closedir (dir);
+
+	for (i = 0; i < names_len; ++i) {
+		manpage = appendstr (manpage, names[i], NULL);
+		test_manfile_queued (manpage, path);
+		*(manpage + len) = '\0';
+		free (names[i]);
+	}
+	scan_queue_drain ();
+	ult_hardlinks_end ();
+
+	free (names);
+	free (manpage);
 }
 
 #ifdef SECURE_MAN_UID
@@ -432,6 +981,8 @@ static int testmandirs (const char *path, const char *catpath, time_t last,
 	struct stat stbuf;
 	int amount = 0;
 	int created = 0;
+	off_t total_size = 0, modified_size = 0;
+	int prefetch;
 
 	debug ("Testing %s for new files\n", path);
 
@@ -443,6 +994,27 @@ static int testmandirs (const char *path, const char *catpath, time_t last,
 
 	chdir (path);
 
+	/* Reading the whole database up front only pays off if we are going
+	 * to check a good part of it.  Directory sizes grow with the number
+	 * of entries on the filesystems we care about, so they give a cheap
+	 * estimate of how much of the hierarchy has been modified.
+	 */
+	while ((mandir = readdir (dir))) {
+		if (strncmp (mandir->d_name, "man", 3) != 0 ||
+		    stat (mandir->d_name, &stbuf) != 0 ||
+		    !S_ISDIR (stbuf.st_mode))
+			continue;
+		total_size += stbuf.st_size;
+		if (!last || stbuf.st_mtime > last)
+			modified_size += stbuf.st_size;
+	}
+	prefetch = !create &&
+		   modified_size * KNOWN_PAGES_PREFETCH_RATIO > total_size;
+	debug ("%ld of %ld bytes of directories modified; %s\n",
+	       (long) modified_size, (long) total_size,
+	       prefetch ? "prefetching" : "not prefetching");
+	rewinddir (dir);
+
 	while( (mandir = readdir (dir)) ) {
 		if (strncmp (mandir->d_name, "man", 3) != 0)
 			continue;
@@ -494,9 +1066,21 @@ static int testmandirs (const char *path, const char *catpath, time_t last,
 
 		if (!dbf) {
 			gripe_rwopen_failed ();
+			known_pages_free ();
 			return 0;
 		}
 
+		/* Without a prefetch, an empty table would claim that no
+		 * page is in the database; that is only true if we created
+		 * it.
+		 */
+		if (!known_pages && (create || prefetch)) {
+			known_pages = hashtable_create (&known_page_free);
+			known_pages_answered = known_pages_probed = 0;
+			if (prefetch)
+				known_pages_prefetch ();
+		}
+
 		if (!quiet) {
 			int tty = isatty (STDERR_FILENO);
 
@@ -513,27 +1097,42 @@ static int testmandirs (const char *path, const char *catpath, time_t last,
 		amount++;
 	}
 	closedir (dir);
+	known_pages_free ();
 
 	return amount;
 }
 
-/* update the time key stored within `database' */
-void update_db_time (void)
+/* The time to record as that of the last update.  Honour
+ * SOURCE_DATE_EPOCH so that databases can be built reproducibly.
+ */
+static time_t db_time_now (void)
+{
+	const char *epoch = getenv ("SOURCE_DATE_EPOCH");
+
+	if (epoch && *epoch) {
+		char *end;
+		long t;
+
+		errno = 0;
+		t = strtol (epoch, &end, 10);
+		if (!errno && !*end)
+			return (time_t) t;
+		debug ("ignoring invalid SOURCE_DATE_EPOCH %s\n", epoch);
+	}
+
+	return time (NULL);
+}
+
+/* set the time key stored within `database' */
+static void set_db_time (time_t mtime)
 {
 	datum key, content;
-#ifdef FAST_BTREE
-	datum key1, content1;
-#endif /* FAST_BTREE */
 
 	memset (&key, 0, sizeof key);
 	memset (&content, 0, sizeof content);
-#ifdef FAST_BTREE
-	memset (&key1, 0, sizeof key);
-	memset (&content1, 0, sizeof content);
-#endif
 
 	MYDBM_SET (key, xstrdup (KEY));
-	MYDBM_SET (content, xasprintf ("%ld", (long) time (NULL)));
+	MYDBM_SET (content, xasprintf ("%ld", (long) mtime));
 
 	/* Open the db in RW to store the $mtime$ ID */
 	/* we know that this should succeed because we just updated the db! */
@@ -547,24 +1146,22 @@ void update_db_time (void)
 		free (MYDBM_DPTR (content));
 		return;
 	}
-#ifndef FAST_BTREE
 	MYDBM_REPLACE (dbf, key, content);
-#else /* FAST_BTREE */
-	MYDBM_SET (key1, KEY);
 
-	(dbf->seq) (dbf, (DBT *) &key1, (DBT *) &content1, R_CURSOR);
-	
-	if (strcmp (MYDBM_DPTR (key1), MYDBM_DPTR (key)) == 0)
-		(dbf->put) (dbf, (DBT *) &key, (DBT *) &content, R_CURSOR);
-	else
-		(dbf->put) (dbf, (DBT *) &key, (DBT *) &content, 0);
-#endif /* !FAST_BTREE */
+	/* The update may have added new names. */
+	dbtrigram_update ();
 
 	MYDBM_CLOSE (dbf);
 	free (MYDBM_DPTR (key));
 	free (MYDBM_DPTR (content));
 }
 
+/* update the time key stored within `database' */
+void update_db_time (void)
+{
+	set_db_time (db_time_now ());
+}
+
 /* remove the db's time key - called prior to update_db if we want
    to `force' a full consistency check */
 void reset_db_time (void)
@@ -606,6 +1203,376 @@ int create_db (const char *manpath, const char *catpath)
 	return amount;
 }
 
+struct import_record {
+	char *line;			/* buffer holding all the fields */
+	const char *path, *name, *sec, *ext, *whatis, *filter;
+	time_t mtime;
+	int used;
+};
+
+static struct import_record *import_records = NULL;
+static size_t import_count = 0;
+
+static int import_record_compare (const void *a, const void *b)
+{
+	const struct import_record *left = a;
+	const struct import_record *right = b;
+	int cmp = strcmp (left->name, right->name);
+
+	if (cmp)
+		return cmp;
+	return strcmp (left->ext, right->ext);
+}
+
+/* Read pre-extracted page data for import_db() from FILE ("-" for standard
+ * input).  Each line holds the tab-separated fields path (which must be
+ * absolute), name, section, extension, whatis, filters and mtime; the
+ * whatis is the raw NAME line (e.g. "printf, sprintf - formatted output
+ * conversion"), and an empty or "-" whatis or filters field means none.
+ * Blank lines and lines starting with '#' are ignored.  The records are
+ * kept sorted by name so that import_db() stores them in key order.
+ */
+void import_read (const char *file)
+{
+	FILE *fp;
+	char *buf = NULL;
+	size_t n = 0;
+	size_t max = 0;
+	int lineno = 0;
+
+	if (STREQ (file, "-"))
+		fp = stdin;
+	else {
+		fp = fopen (file, "r");
+		if (!fp)
+			error (FATAL, errno, _("can't open %s"), file);
+	}
+
+	while (getline (&buf, &n, fp) >= 0) {
+		struct import_record *rec;
+		char *fields[7];
+		char *field, *end;
+		int i;
+
+		++lineno;
+		field = strchr (buf, '\n');
+		if (field)
+			*field = '\0';
+		if (!*buf || *buf == '#')
+			continue;
+
+		field = buf;
+		for (i = 0; i < 7 && field; ++i) {
+			fields[i] = field;
+			field = strchr (field, '\t');
+			if (field)
+				*field++ = '\0';
+		}
+		if (i < 7 || field || *fields[0] != '/' || !*fields[1] ||
+		    !*fields[2] || !*fields[3]) {
+			error (0, 0, _("%s:%d: malformed import record"),
+			       file, lineno);
+			continue;
+		}
+
+		if (import_count == max) {
+			max = max ? max * 2 : 1024;
+			import_records = xnrealloc (import_records, max,
+						    sizeof *import_records);
+		}
+		rec = &import_records[import_count];
+		rec->path = fields[0];
+		rec->name = fields[1];
+		rec->sec = fields[2];
+		rec->ext = fields[3];
+		rec->whatis = (*fields[4] && !STREQ (fields[4], "-"))
+			      ? fields[4] : NULL;
+		rec->filter = (*fields[5] && !STREQ (fields[5], "-"))
+			      ? fields[5] : NULL;
+		errno = 0;
+		rec->mtime = (time_t) strtol (fields[6], &end, 10);
+		if (errno || end == fields[6] || *end) {
+			error (0, 0, _("%s:%d: malformed import record"),
+			       file, lineno);
+			continue;
+		}
+		rec->used = 0;
+		/* The fields point into buf, so hand it over to the record. */
+		rec->line = buf;
+		buf = NULL;
+		n = 0;
+		++import_count;
+	}
+
+	if (ferror (fp))
+		error (FATAL, errno, _("can't read from %s"), file);
+	free (buf);
+	if (fp != stdin)
+		fclose (fp);
+
+	qsort (import_records, import_count, sizeof *import_records,
+	       import_record_compare);
+	debug ("import_read(%s): %lu records\n", file,
+	       (unsigned long) import_count);
+}
+
+/* Warn about any imported records that did not belong to any of the
+ * manual hierarchies we processed, and free them all.
+ */
+void import_free (void)
+{
+	size_t i;
+
+	for (i = 0; i < import_count; ++i) {
+		if (!import_records[i].used && quiet < 2)
+			error (0, 0,
+			       _("warning: %s: not in any manual hierarchy "
+				 "being processed"),
+			       import_records[i].path);
+		free (import_records[i].line);
+	}
+	free (import_records);
+	import_records = NULL;
+	import_count = 0;
+}
+
+/* Store the record REC, for a page under MANPATH, as test_manfile() would
+ * have done after scanning the file itself.  The record is only trusted if
+ * the page it describes is still there with the same mtime.
+ */
+static void import_record (const struct import_record *rec,
+			   const char *manpath)
+{
+	struct mandata info;
+	struct page_description *descs;
+	char *manpage;
+	struct stat buf;
+
+	if (lstat (rec->path, &buf) == -1 ||
+	    (!S_ISREG (buf.st_mode) && !S_ISLNK (buf.st_mode)) ||
+	    buf.st_mtime != rec->mtime) {
+		if (quiet < 2)
+			error (0, 0,
+			       _("warning: %s: import record does not match "
+				 "the file on disk"),
+			       rec->path);
+		return;
+	}
+
+	manpage = filename_info (rec->path, &info, rec->name);
+	if (!manpage)
+		return;
+	if (info.name || !STREQ (info.sec, rec->sec) ||
+	    !STREQ (info.ext, rec->ext)) {
+		if (quiet < 2)
+			error (0, 0,
+			       _("warning: %s: import record does not match "
+				 "file name"),
+			       rec->path);
+		free (info.name);
+		free (manpage);
+		return;
+	}
+
+	pages++;
+
+	info.id = ULT_MAN;
+	info.pointer = NULL;
+	info.filter = rec->filter;
+	info._st_mtime = rec->mtime;
+
+	descs = parse_descriptions (rec->name, rec->whatis);
+	if (descs) {
+		if (!opt_test) {
+			enum stats_phase previous =
+				stats_enter (STATS_DBSTORE);
+			store_descriptions (descs, &info, manpath, rec->name,
+					    NULL);
+			stats_leave (previous);
+		}
+		free_descriptions (descs);
+	} else if (quiet < 2)
+		error (0, 0, _("warning: %s: whatis parse for %s(%s) failed"),
+		       rec->path, rec->name, rec->ext);
+
+	free (manpage);
+}
+
+/* Create the database for manpath from the records read by import_read(),
+ * rather than by scanning the filesystem.  All the records are stored in
+ * sorted order while the database is held open.
+ */
+int import_db (const char *manpath, const char *catpath)
+{
+	size_t len = strlen (manpath);
+	struct hashtable *subdirs;
+	int amount = 0;
+	size_t i;
+
+	debug ("import_db(%s): %s\n", manpath, database);
+
+	subdirs = hashtable_create (&null_hashtable_free);
+	for (i = 0; i < import_count; ++i) {
+		struct import_record *rec = &import_records[i];
+		const char *subdir;
+		const char *slash;
+
+		if (rec->used || !STRNEQ (rec->path, manpath, len) ||
+		    !STRNEQ (rec->path + len, "/man", 4))
+			continue;
+		subdir = rec->path + len + 1;
+		slash = strchr (subdir, '/');
+		if (!slash || strchr (slash + 1, '/'))
+			continue;
+		rec->used = 1;
+		if (!hashtable_lookup_structure (subdirs, subdir,
+						 slash - subdir)) {
+			hashtable_install (subdirs, subdir, slash - subdir,
+					   NULL);
+			++amount;
+		}
+	}
+	hashtable_free (subdirs);
+
+	if (!amount)
+		return 0;
+
+	mkcatdirs (manpath, catpath);
+
+	dbf = MYDBM_CTRWOPEN (database);
+	if (dbf == NULL) {
+		if (errno == EACCES || errno == EROFS) {
+			debug ("database %s is read-only\n", database);
+			return 0;
+		} else {
+			error (0, errno, _("can't create index cache %s"),
+			       database);
+			return -errno;
+		}
+	}
+	dbver_wr (dbf);
+
+	if (!quiet)
+		fprintf (stderr,
+			 _("Importing index cache for path `%s'. Wait..."),
+			 manpath);
+	for (i = 0; i < import_count; ++i) {
+		struct import_record *rec = &import_records[i];
+
+		if (rec->used == 1) {
+			import_record (rec, manpath);
+			/* Don't store it again for another hierarchy. */
+			rec->used = 2;
+		}
+	}
+	MYDBM_CLOSE (dbf);
+
+	update_db_time ();
+	if (!quiet)
+		fputs (_("done.\n"), stderr);
+
+	return amount;
+}
+
+static int string_compare (const void *a, const void *b)
+{
+	return strcmp (*(const char * const *) a, *(const char * const *) b);
+}
+
+/* Create the database for manpath by merging the index shards in its
+ * SHARD_DIR, taken in name order so that the result is reproducible.
+ * The database's time is that of the newest shard, so that a subsequent
+ * update_db() will pick up any pages added since the shards were built.
+ * Return the number of shards merged.
+ */
+int merge_db (const char *manpath, const char *catpath)
+{
+	char *shard_dir = appendstr (NULL, manpath, SHARD_DIR, NULL);
+	/* Shards are ordinary databases, named like the database itself;
+	 * some backends open them without the suffix of the file on disk.
+	 */
+	const char *file_suffix = mydbm_backend->files[0];
+	char *suffix = appendstr (NULL, mydbm_backend->ext, file_suffix,
+				  NULL);
+	size_t suffix_len = strlen (suffix);
+	DIR *dir;
+	struct dirent *shardent;
+	char **shards = NULL;
+	size_t n = 0, max = 0, i;
+	time_t latest;
+
+	dir = opendir (shard_dir);
+	if (!dir) {
+		free (suffix);
+		free (shard_dir);
+		return 0;
+	}
+	while ((shardent = readdir (dir)) != NULL) {
+		size_t len = strlen (shardent->d_name);
+
+		if (*shardent->d_name == '.' || len <= suffix_len ||
+		    !STREQ (shardent->d_name + len - suffix_len, suffix))
+			continue;
+		len -= strlen (file_suffix);
+
+		if (n == max) {
+			max = max ? max * 2 : 64;
+			shards = xnrealloc (shards, max, sizeof *shards);
+		}
+		shards[n++] = xasprintf ("%s/%.*s", shard_dir, (int) len,
+					 shardent->d_name);
+	}
+	closedir (dir);
+	free (suffix);
+	free (shard_dir);
+
+	if (!n) {
+		free (shards);
+		return 0;
+	}
+	qsort (shards, n, sizeof *shards, string_compare);
+
+	debug ("merge_db(%s): %s, %lu shards\n", manpath, database,
+	       (unsigned long) n);
+
+	mkcatdirs (manpath, catpath);
+
+	dbf = MYDBM_CTRWOPEN (database);
+	if (dbf == NULL) {
+		int ret = 0;
+
+		if (errno == EACCES || errno == EROFS)
+			debug ("database %s is read-only\n", database);
+		else {
+			error (0, errno, _("can't create index cache %s"),
+			       database);
+			ret = -errno;
+		}
+		for (i = 0; i < n; ++i)
+			free (shards[i]);
+		free (shards);
+		return ret;
+	}
+	dbver_wr (dbf);
+
+	if (!quiet)
+		fprintf (stderr,
+			 _("Merging index shards for path `%s'. Wait..."),
+			 manpath);
+	latest = dbmerge (shards, n);
+	MYDBM_CLOSE (dbf);
+
+	set_db_time (latest);
+	if (!quiet)
+		fputs (_("done.\n"), stderr);
+
+	for (i = 0; i < n; ++i)
+		free (shards[i]);
+	free (shards);
+
+	return n;
+}
+
 /* Make sure an existing database is essentially sane. */
 int sanity_check_db (void)
 {
@@ -613,6 +1580,11 @@ int sanity_check_db (void)
 
 	if (dbver_rd (dbf))
 		return 0;
+	if (dbver_outdated (dbf)) {
+		debug ("%s uses an old record format; rebuilding\n",
+		       database);
+		return 0;
+	}
 
 	key = MYDBM_FIRSTKEY (dbf);
 	while (MYDBM_DPTR (key) != NULL) {
@@ -679,21 +1651,33 @@ int update_db (const char *manpath, const char *catpath)
 	return EOF;
 }
 
-/* Purge any entries pointing to name. This currently assumes that pointers
- * are always shallow, which may not be a good assumption yet; it should be
- * close, though.
+/* Names of pages that update_file has found to have vanished, whose
+ * pointers are still to be purged.
+ */
+static struct hashtable *vanished_pages;
+
+/* Purge any entries pointing to the pages in vanished_pages. This
+ * currently assumes that pointers are always shallow, which may not be a
+ * good assumption yet; it should be close, though.
+ *
+ * This walks the whole database, so update_file only queues names, and
+ * callers do this once when they have finished with a batch of files.
+ * Pages that still exist must not be purged: test_manfile only re-adds
+ * their own entries, not the .so and whatis pointers of other pages.
  *
  * Assumes that the appropriate database is already open on dbf.
  */
-void purge_pointers (const char *name)
+void purge_pointers (void)
 {
-	datum key = MYDBM_FIRSTKEY (dbf);
+	datum key;
 
-	debug ("Purging pointers to vanished page \"%s\"\n", name);
+	if (!vanished_pages)
+		return;
 
+	key = MYDBM_FIRSTKEY (dbf);
 	while (MYDBM_DPTR (key) != NULL) {
 		datum content, nextkey;
-		struct mandata entry;
+		struct mandata *list, *entry;
 		char *nicekey, *tab;
 
 		/* Ignore db identifier keys. */
@@ -702,7 +1686,7 @@ void purge_pointers (const char *name)
 
 		content = MYDBM_FETCH (dbf, key);
 		if (!MYDBM_DPTR (content))
-			return;
+			break;
 
 		/* Get just the name. */
 		nicekey = xstrdup (MYDBM_DPTR (key));
@@ -713,17 +1697,28 @@ void purge_pointers (const char *name)
 		if (*MYDBM_DPTR (content) == '\t')
 			goto pointers_contentnext;
 
-		split_content (MYDBM_DPTR (content), &entry);
-		if (entry.id != SO_MAN && entry.id != WHATIS_MAN)
-			goto pointers_contentnext;
+		list = split_content_list (MYDBM_DPTR (content),
+					   MYDBM_DSIZE (content));
+		MYDBM_SET_DPTR (content, NULL); /* owned by list */
+		for (entry = list; entry; entry = entry->next) {
+			const char *entry_name = entry->name ? entry->name
+							     : nicekey;
 
-		if (STREQ (entry.pointer, name)) {
-			if (!opt_test)
-				dbdelete (nicekey, &entry);
-			else
-				debug ("%s(%s): pointer vanished, "
-				       "would delete\n", nicekey, entry.ext);
+			if (entry->id != SO_MAN && entry->id != WHATIS_MAN)
+				continue;
+
+			if (hashtable_lookup_structure (
+					vanished_pages, entry->pointer,
+					strlen (entry->pointer))) {
+				if (!opt_test)
+					dbdelete (entry_name, entry);
+				else
+					debug ("%s(%s): pointer vanished, "
+					       "would delete\n",
+					       entry_name, entry->ext);
+			}
 		}
+		free_mandata_struct (list);
 
 pointers_contentnext:
 		free (nicekey);
@@ -733,6 +1728,52 @@ pointers_next:
 		MYDBM_FREE (MYDBM_DPTR (key));
 		key = nextkey;
 	}
+	if (MYDBM_DPTR (key))
+		MYDBM_FREE (MYDBM_DPTR (key));
+
+	hashtable_free (vanished_pages);
+	vanished_pages = NULL;
+}
+
+/* Replace the entries for the single page FILE under MANPATH with what is
+ * in the filesystem now.  This is what "mandb -f" does; man uses it to
+ * refresh stale entries without running mandb.
+ *
+ * Assumes that the appropriate database is already open on dbf.  Callers
+ * should call purge_pointers() and then dbtrigram_update() once they have
+ * updated every file, since both work on the whole database.
+ */
+void update_file (const char *manpath, const char *file)
+{
+	struct mandata info;
+	char *manpage;
+	struct stat st;
+	int vanished = (lstat (file, &st) != 0);
+
+	memset (&info, 0, sizeof (struct mandata));
+	manpage = filename_info (file, &info, "");
+	if (info.name) {
+		enum stats_phase previous = stats_enter (STATS_DBSTORE);
+		dbdelete (info.name, &info);
+		stats_leave (previous);
+		if (vanished) {
+			size_t len = strlen (info.name);
+
+			debug ("page \"%s\" vanished; purging pointers "
+			       "to it later\n", info.name);
+			if (!vanished_pages)
+				vanished_pages = hashtable_create
+					(&null_hashtable_free);
+			hashtable_install (vanished_pages, info.name, len,
+					   NULL);
+		}
+		free (info.name);
+	}
+	free (manpage);
+
+	/* If the file has gone, removing its entry is all we need do. */
+	if (!vanished)
+		test_manfile (file, manpath);
 }
 
 /* Count the number of exact extension matches returned from look_for_file()
@@ -858,40 +1899,20 @@ static int purge_whatis (const char *path, int cat, const char *name,
 	}
 }
 
-/* Check that multi keys are correctly constructed. */
-static int check_multi_key (const char *name, const char *content)
+/* Check that the names of pages sharing a key only differ from the key
+ * itself in their case, if at all.
+ */
+static int check_multi_names (const char *name, const struct mandata *list)
 {
-	const char *walk, *next;
-
-	if (!*content)
-		return 0;
+	const struct mandata *entry;
 
-	for (walk = content; walk && *walk; walk = next) {
-		/* The name in the multi key should only differ from the
-		 * name of the key itself in its case, if at all.
-		 */
-		int valid = 1;
-		++walk; /* skip over initial tab */
-		next = strchr (walk, '\t');
-		if (next) {
-			if (strncasecmp (name, walk, next - walk))
-				valid = 0;
-		} else {
-			if (strcasecmp (name, walk))
-				valid = 0;
-		}
-		if (!valid) {
-			debug ("%s: broken multi key \"%s\", "
-			       "forcing a rescan\n", name, content);
+	for (entry = list; entry; entry = entry->next) {
+		if (entry->name && strcasecmp (name, entry->name)) {
+			debug ("%s: broken entry for \"%s\", "
+			       "forcing a rescan\n", name, entry->name);
 			force_rescan = 1;
 			return 1;
 		}
-
-		/* If the name was valid, skip over the extension and
-		 * continue the scan.
-		 */
-		walk = next;
-		next = walk ? strchr (walk + 1, '\t') : NULL;
 	}
 
 	return 0;
@@ -919,6 +1940,11 @@ int purge_missing (const char *manpath, const char *catpath)
 		gripe_rwopen_failed ();
 		return 0;
 	}
+	if (dbver_outdated (dbf)) {
+		/* The database is about to be rebuilt anyway. */
+		MYDBM_CLOSE (dbf);
+		return 0;
+	}
 
 	/* Extract the database mtime. */
 	key = MYDBM_FIRSTKEY (dbf);
@@ -947,10 +1973,8 @@ int purge_missing (const char *manpath, const char *catpath)
 
 	while (MYDBM_DPTR (key) != NULL) {
 		datum content, nextkey;
-		struct mandata entry;
+		struct mandata *list, *entry;
 		char *nicekey, *tab;
-		int save_debug;
-		char **found;
 
 		/* Ignore db identifier keys. */
 		if (*MYDBM_DPTR (key) == '$') {
@@ -974,50 +1998,57 @@ int purge_missing (const char *manpath, const char *catpath)
 		if (tab)
 			*tab = '\0';
 
-		/* Deal with multi keys. */
 		if (*MYDBM_DPTR (content) == '\t') {
-			if (check_multi_key (nicekey, MYDBM_DPTR (content)))
-				MYDBM_DELETE (dbf, key);
-			free (nicekey);
+			/* the multi keys listed are checked in turn */
 			MYDBM_FREE (MYDBM_DPTR (content));
-			nextkey = MYDBM_NEXTKEY (dbf, key);
-			MYDBM_FREE (MYDBM_DPTR (key));
-			key = nextkey;
-			continue;
+			list = NULL;
+		} else
+			list = split_content_list (MYDBM_DPTR (content),
+						   MYDBM_DSIZE (content));
+
+		/* Deal with pages sharing a key. */
+		if (list && list->next && check_multi_names (nicekey, list)) {
+			MYDBM_DELETE (dbf, key);
+			free_mandata_struct (list);
+			list = NULL;
 		}
 
-		split_content (MYDBM_DPTR (content), &entry);
-
-		save_debug = debug_level;
-		debug_level = 0;	/* look_for_file() is quite noisy */
-		if (entry.id <= WHATIS_MAN)
-			found = look_for_file (manpath, entry.ext,
-					       entry.name ? entry.name
-							  : nicekey,
-					       0, LFF_MATCHCASE);
-		else
-			found = look_for_file (catpath, entry.ext,
-					       entry.name ? entry.name
-							  : nicekey,
-					       1, LFF_MATCHCASE);
-		debug_level = save_debug;
+		for (entry = list; entry; entry = entry->next) {
+			const char *entry_name = entry->name ? entry->name
+							     : nicekey;
+			int save_debug;
+			char **found;
+
+			save_debug = debug_level;
+			debug_level = 0;  /* look_for_file() is quite noisy */
+			if (entry->id <= WHATIS_MAN)
+				found = look_for_file (manpath, entry->ext,
+						       entry_name, 0,
+						       LFF_MATCHCASE);
+			else
+				found = look_for_file (catpath, entry->ext,
+						       entry_name, 1,
+						       LFF_MATCHCASE);
+			debug_level = save_debug;
 
-		/* Now actually decide whether to purge, depending on the
-		 * type of entry.
-		 */
-		if (entry.id == ULT_MAN || entry.id == SO_MAN ||
-		    entry.id == STRAY_CAT)
-			count += purge_normal (nicekey, &entry, found);
-		else if (entry.id == WHATIS_MAN)
-			count += purge_whatis (manpath, 0, nicekey,
-					       &entry, found, db_mtime);
-		else	/* entry.id == WHATIS_CAT */
-			count += purge_whatis (catpath, 1, nicekey,
-					       &entry, found, db_mtime);
+			/* Now actually decide whether to purge, depending
+			 * on the type of entry.
+			 */
+			if (entry->id == ULT_MAN || entry->id == SO_MAN ||
+			    entry->id == STRAY_CAT)
+				count += purge_normal (entry_name, entry,
+						       found);
+			else if (entry->id == WHATIS_MAN)
+				count += purge_whatis (manpath, 0, entry_name,
+						       entry, found, db_mtime);
+			else	/* entry->id == WHATIS_CAT */
+				count += purge_whatis (catpath, 1, entry_name,
+						       entry, found, db_mtime);
+		}
 
 		free (nicekey);
 
-		free_mandata_elements (&entry);
+		free_mandata_struct (list);
 		nextkey = MYDBM_NEXTKEY (dbf, key);
 		MYDBM_FREE (MYDBM_DPTR (key));
 		key = nextkey;
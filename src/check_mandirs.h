@@ -27,6 +27,11 @@ extern void test_manfile (const char *file, const char *path);
 extern void update_db_time (void);
 extern void reset_db_time (void);
 extern int create_db (const char *manpath, const char *catpath);
+extern void import_read (const char *file);
+extern void import_free (void);
+extern int import_db (const char *manpath, const char *catpath);
+extern int merge_db (const char *manpath, const char *catpath);
 extern int update_db (const char *manpath, const char *catpath);
-extern void purge_pointers (const char *name);
+extern void purge_pointers (void);
+extern void update_file (const char *manpath, const char *file);
 extern int purge_missing (const char *manpath, const char *catpath);
@@ -0,0 +1,322 @@
+/*
+ * col.c: built-in equivalent of "col -b" for formatted manual pages
+ *
+ * Copyright (C) 2013 Colin Watson.
+ *
+ * This file is part of man-db.
+ *
+ * man-db is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * man-db is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with man-db; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* Formatted pages use backspaces to embolden and underline text.  Stripping
+ * them only needs one line of output at a time, so rather than running
+ * col(1) for every page we do it ourselves in a pipeline function.  This
+ * handles what nroff produces for a terminal: backspaces, carriage
+ * returns, and tabs.  Reverse and half-line motions are ignored rather than
+ * applied; GNU nroff never emits them in the output we filter, and other
+ * formatters have their tbl output passed through col(1) earlier on.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "manconfig.h"
+
+#include "pipeline.h"
+#include "encodings.h"
+
+#include "col.h"
+
+#define CELL_MAX	16
+
+/* Widths of cells.  A cell that has not been written is printed as a
+ * space; the columns after the first one of a wide character print nothing.
+ */
+#define CELL_EMPTY	0
+#define CELL_TAIL	255
+
+struct col_cell {
+	char bytes[CELL_MAX];
+	unsigned char len;
+	unsigned char width;
+};
+
+struct col_filter {
+	int utf8;
+	int pass_controls;
+	struct col_cell *cells;
+	size_t size;		/* cells allocated */
+	size_t used;		/* cells up to the last one written */
+	size_t col;		/* current column */
+	size_t last_width;	/* width of the last character written */
+	char pending[CELL_MAX];	/* incomplete UTF-8 character */
+	size_t pending_len, pending_need;
+	int escape;		/* previous byte was ESC */
+};
+
+/* Approximate display width of a Unicode character, following Markus
+ * Kuhn's wcwidth(); we cannot rely on the locale's idea of it, since our
+ * output encoding need not match the locale.
+ */
+static int unicode_width (unsigned long c)
+{
+	if ((c >= 0x0300 && c <= 0x036F) || (c >= 0x1AB0 && c <= 0x1AFF) ||
+	    (c >= 0x1DC0 && c <= 0x1DFF) || (c >= 0x200B && c <= 0x200F) ||
+	    (c >= 0x20D0 && c <= 0x20FF) || (c >= 0xFE20 && c <= 0xFE2F))
+		return 0;
+	if ((c >= 0x1100 && c <= 0x115F) ||
+	    (c >= 0x2E80 && c <= 0xA4CF && c != 0x303F) ||
+	    (c >= 0xAC00 && c <= 0xD7A3) || (c >= 0xF900 && c <= 0xFAFF) ||
+	    (c >= 0xFE30 && c <= 0xFE4F) || (c >= 0xFF00 && c <= 0xFF60) ||
+	    (c >= 0xFFE0 && c <= 0xFFE6) || (c >= 0x20000 && c <= 0x3FFFD))
+		return 2;
+	return 1;
+}
+
+static void flush_line (struct col_filter *col)
+{
+	size_t i, covered = 0;
+
+	for (i = 0; i < col->used; ++i) {
+		struct col_cell *cell = &col->cells[i];
+
+		if (cell->width == CELL_EMPTY || cell->width == CELL_TAIL) {
+			/* Tails whose head was overwritten are blanks. */
+			if (i >= covered)
+				putchar (' ');
+			if (cell->len)
+				fwrite (cell->bytes, 1, cell->len, stdout);
+		} else {
+			fwrite (cell->bytes, 1, cell->len, stdout);
+			covered = i + cell->width;
+		}
+		cell->len = 0;
+		cell->width = CELL_EMPTY;
+	}
+	col->used = col->col = 0;
+	col->last_width = 1;
+}
+
+/* Attach zero-width output (combining characters, or controls we pass
+ * through) to the character before the cursor.
+ */
+static void put_zero_width (struct col_filter *col,
+			    const char *bytes, size_t len)
+{
+	struct col_cell *cell;
+
+	if (col->col == 0 || col->col > col->used) {
+		/* Nothing to attach it to; emit it in place. */
+		if (col->col == 0 && col->used == 0)
+			fwrite (bytes, 1, len, stdout);
+		return;
+	}
+	cell = &col->cells[col->col - 1];
+	if (cell->width == CELL_TAIL && col->col >= 2)
+		cell = &col->cells[col->col - 2];
+	if (cell->len + len <= CELL_MAX) {
+		memcpy (cell->bytes + cell->len, bytes, len);
+		cell->len += len;
+	}
+}
+
+static void put_char (struct col_filter *col, const char *bytes, size_t len,
+		      int width)
+{
+	size_t i;
+
+	if (width == 0) {
+		put_zero_width (col, bytes, len);
+		return;
+	}
+
+	if (col->col + width > col->size) {
+		size_t old_size = col->size;
+
+		col->size = (col->col + width) * 2;
+		col->cells = xnrealloc (col->cells, col->size,
+					sizeof *col->cells);
+		memset (col->cells + old_size, 0,
+			(col->size - old_size) * sizeof *col->cells);
+	}
+
+	/* Only the last character written to each column survives. */
+	if (col->cells[col->col].width == CELL_TAIL && col->col > 0) {
+		col->cells[col->col - 1].len = 0;
+		col->cells[col->col - 1].width = CELL_EMPTY;
+	}
+	memcpy (col->cells[col->col].bytes, bytes, len);
+	col->cells[col->col].len = len;
+	col->cells[col->col].width = width;
+	for (i = 1; i < (size_t) width; ++i) {
+		col->cells[col->col + i].len = 0;
+		col->cells[col->col + i].width = CELL_TAIL;
+	}
+
+	col->col += width;
+	if (col->col > col->used)
+		col->used = col->col;
+	col->last_width = width;
+}
+
+static void put_control (struct col_filter *col, char c)
+{
+	if (col->pass_controls)
+		put_zero_width (col, &c, 1);
+}
+
+static void col_byte (struct col_filter *col, unsigned char c)
+{
+	if (col->escape) {
+		col->escape = 0;
+		if (c == '7' || c == '8' || c == '9')
+			/* reverse or half-line motion */
+			return;
+		if (col->pass_controls) {
+			char seq[2];
+
+			seq[0] = '\033';
+			seq[1] = c;
+			put_zero_width (col, seq, 2);
+		}
+		return;
+	}
+
+	if (col->pending_need) {
+		if ((c & 0xC0) == 0x80) {
+			col->pending[col->pending_len++] = c;
+			if (col->pending_len == col->pending_need) {
+				unsigned long wc = col->pending[0] &
+					(0x7F >> col->pending_need);
+				size_t i;
+
+				for (i = 1; i < col->pending_len; ++i)
+					wc = (wc << 6) |
+					     (col->pending[i] & 0x3F);
+				put_char (col, col->pending, col->pending_len,
+					  unicode_width (wc));
+				col->pending_len = col->pending_need = 0;
+			}
+			return;
+		}
+		/* Invalid sequence; keep what we have as it stands. */
+		put_char (col, col->pending, col->pending_len, 1);
+		col->pending_len = col->pending_need = 0;
+	}
+
+	switch (c) {
+		case '\n':
+			flush_line (col);
+			putchar ('\n');
+			return;
+		case '\r':
+			col->col = 0;
+			return;
+		case '\b':
+			if (col->col >= col->last_width)
+				col->col -= col->last_width;
+			else
+				col->col = 0;
+			col->last_width = 1;
+			return;
+		case '\t':
+			col->col = (col->col | 7) + 1;
+			col->last_width = 1;
+			return;
+		case ' ':
+			++col->col;
+			col->last_width = 1;
+			return;
+		case '\033':
+			col->escape = 1;
+			return;
+		case '\v':
+			/* reverse line feed */
+			return;
+	}
+
+	if (c < 0x20 || c == 0x7F)
+		put_control (col, c);
+	else if (col->utf8 && c >= 0xC0 && c < 0xF8) {
+		col->pending[0] = c;
+		col->pending_len = 1;
+		col->pending_need = c >= 0xF0 ? 4 : c >= 0xE0 ? 3 : 2;
+	} else {
+		char byte = c;
+
+		put_char (col, &byte, 1, 1);
+	}
+}
+
+static void col_stdin (void *data)
+{
+	struct col_filter *col = data;
+	char buffer[4096];
+	size_t r, i;
+
+	while ((r = fread (buffer, 1, sizeof buffer, stdin)) > 0)
+		for (i = 0; i < r; ++i)
+			col_byte (col, (unsigned char) buffer[i]);
+
+	if (col->pending_len)
+		put_char (col, col->pending, col->pending_len, 1);
+	flush_line (col);
+	fflush (stdout);
+}
+
+static void free_col_filter (void *data)
+{
+	struct col_filter *col = data;
+
+	free (col->cells);
+	free (col);
+}
+
+/* Return a pipeline command that behaves like "col -b -x" (or "col -b -p
+ * -x" if PASS_CONTROLS is set) on text in CHARSET, or NULL if CHARSET is
+ * one we cannot handle ourselves and col(1) must be used instead.
+ */
+pipecmd *col_filter_new (const char *charset, int pass_controls)
+{
+	struct col_filter *col;
+	int utf8;
+
+	if (!charset)
+		return NULL;
+	charset = get_canonical_charset_name (charset);
+	if (STREQ (charset, "UTF-8"))
+		utf8 = 1;
+	else if (STREQ (charset, "ANSI_X3.4-1968") ||
+		 STRNEQ (charset, "ISO-8859-", 9) ||
+		 STRNEQ (charset, "KOI8-", 5) ||
+		 STRNEQ (charset, "CP125", 5))
+		utf8 = 0;
+	else
+		return NULL;
+
+	col = xzalloc (sizeof *col);
+	col->utf8 = utf8;
+	col->pass_controls = pass_controls;
+	col->last_width = 1;
+	/* informational only; no shell quoting concerns */
+	return pipecmd_new_function (pass_controls ? "col -b -p -x"
+						   : "col -b -x",
+				     &col_stdin, &free_col_filter, col);
+}
@@ -187,6 +187,37 @@ static struct dirent_hashent *update_directory_cache (const char *path)
 	return cache;
 }
 
+/* Return 1 if the directory DIR contains an entry called NAME, 0 if it
+ * does not, or -1 if DIR cannot be read.  This uses the same directory
+ * cache as look_for_file, so it costs at most one scan of each directory.
+ */
+int directory_has_entry (const char *dir, const char *name)
+{
+	struct dirent_hashent *cache = update_directory_cache (dir);
+	size_t lo = 0, hi;
+
+	if (!cache)
+		return -1;
+
+	/* The cache is sorted case-insensitively; find the first entry
+	 * that could match and check each case variant from there.
+	 */
+	hi = cache->names_len;
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (strcasecmp (cache->names[mid], name) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	for (; lo < cache->names_len &&
+	       strcasecmp (cache->names[lo], name) == 0; ++lo)
+		if (STREQ (cache->names[lo], name))
+			return 1;
+
+	return 0;
+}
+
 struct pattern_bsearch {
 	char *pattern;
 	size_t len;
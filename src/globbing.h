@@ -29,3 +29,4 @@ enum look_for_file_opts {
 /* globbing.c */
 extern char **look_for_file (const char *hier, const char *sec,
 			     const char *unesc_name, int cat, int opts);
+extern int directory_has_entry (const char *dir, const char *name);
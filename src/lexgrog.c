@@ -19,6 +19,25 @@
 #define FLEX_BETA
 #endif
 
+#define yy_create_buffer lexgrog__create_buffer
+#define yy_delete_buffer lexgrog__delete_buffer
+#define yy_flex_debug lexgrog__flex_debug
+#define yy_init_buffer lexgrog__init_buffer
+#define yy_flush_buffer lexgrog__flush_buffer
+#define yy_load_buffer_state lexgrog__load_buffer_state
+#define yy_switch_to_buffer lexgrog__switch_to_buffer
+#define yyin lexgrog_in
+#define yyleng lexgrog_leng
+#define yylex lexgrog_lex
+#define yylineno lexgrog_lineno
+#define yyout lexgrog_out
+#define yyrestart lexgrog_restart
+#define yytext lexgrog_text
+#define yywrap lexgrog_wrap
+#define yyalloc lexgrog_alloc
+#define yyrealloc lexgrog_realloc
+#define yyfree lexgrog_free
+
 /* First, we deal with  platform-specific or compiler-specific issues. */
 
 /* begin standard C headers. */
@@ -295,8 +314,8 @@ void yy_switch_to_buffer (YY_BUFFER_STATE new_buffer  );
 YY_BUFFER_STATE yy_create_buffer (FILE *file,int size  );
 void yy_delete_buffer (YY_BUFFER_STATE b  );
 void yy_flush_buffer (YY_BUFFER_STATE b  );
-void yypush_buffer_state (YY_BUFFER_STATE new_buffer  );
-void yypop_buffer_state (void );
+void lexgrog_push_buffer_state (YY_BUFFER_STATE new_buffer  );
+void lexgrog_pop_buffer_state (void );
 
 static void yyensure_buffer_stack (void );
 static void yy_load_buffer_state (void );
@@ -304,9 +323,9 @@ static void yy_init_buffer (YY_BUFFER_STATE b,FILE *file  );
 
 #define YY_FLUSH_BUFFER yy_flush_buffer(YY_CURRENT_BUFFER )
 
-YY_BUFFER_STATE yy_scan_buffer (char *base,yy_size_t size  );
-YY_BUFFER_STATE yy_scan_string (yyconst char *yy_str  );
-YY_BUFFER_STATE yy_scan_bytes (yyconst char *bytes,yy_size_t len  );
+YY_BUFFER_STATE lexgrog__scan_buffer (char *base,yy_size_t size  );
+YY_BUFFER_STATE lexgrog__scan_string (yyconst char *yy_str  );
+YY_BUFFER_STATE lexgrog__scan_bytes (yyconst char *bytes,yy_size_t len  );
 
 void *yyalloc (yy_size_t  );
 void *yyrealloc (void *,yy_size_t  );
@@ -2562,6 +2581,7 @@ char *yytext;
 #include "decompress.h"
 #include "security.h"
 #include "encodings.h"
+#include "stats.h"
 
 #include "manconv_client.h"
 
@@ -2736,10 +2756,25 @@ static int waiting_for_quote;
 
 static pipeline *decomp;
 
+/* Set by find_name_and_encoding to check the page's encoding as it is
+ * read.
+ */
+static struct encoding_check *encoding_check;
+static int encoding_check_lexed_ascii;
+
+static void read_block (const char *block, size_t size)
+{
+	if (pipeline_get_ncommands (decomp))
+		STATS_ADD (STATS_BYTES_DECOMPRESSED, size);
+	if (encoding_check)
+		encoding_check_feed (encoding_check, block, size);
+}
+
 #define YY_INPUT(buf,result,max_size) { \
 	size_t size = max_size; \
 	const char *block = pipeline_read (decomp, &size); \
 	if (block && size != 0) { \
+		read_block (block, size); \
 		memcpy (buf, block, size); \
 		buf[size] = '\0'; \
 		result = size; \
@@ -2769,7 +2804,7 @@ static pipeline *decomp;
 */
 /* NOME also works for gl, pt */
 /* eptgrv : eqn, pic, tbl, grap, refer, vgrind */
-#line 2773 "lexgrog.c"
+#line 2789 "lexgrog.c"
 
 #define INITIAL 0
 #define MAN_PRENAME 1
@@ -2806,31 +2841,31 @@ static int yy_init_globals (void );
 /* Accessor methods to globals.
    These are made visible to non-reentrant scanners for convenience. */
 
-int yylex_destroy (void );
+int lexgrog_lex_destroy (void );
 
-int yyget_debug (void );
+int lexgrog_get_debug (void );
 
-void yyset_debug (int debug_flag  );
+void lexgrog_set_debug (int debug_flag  );
 
-YY_EXTRA_TYPE yyget_extra (void );
+YY_EXTRA_TYPE lexgrog_get_extra (void );
 
-void yyset_extra (YY_EXTRA_TYPE user_defined  );
+void lexgrog_set_extra (YY_EXTRA_TYPE user_defined  );
 
-FILE *yyget_in (void );
+FILE *lexgrog_get_in (void );
 
-void yyset_in  (FILE * in_str  );
+void lexgrog_set_in  (FILE * in_str  );
 
-FILE *yyget_out (void );
+FILE *lexgrog_get_out (void );
 
-void yyset_out  (FILE * out_str  );
+void lexgrog_set_out  (FILE * out_str  );
 
-yy_size_t yyget_leng (void );
+yy_size_t lexgrog_get_leng (void );
 
-char *yyget_text (void );
+char *lexgrog_get_text (void );
 
-int yyget_lineno (void );
+int lexgrog_get_lineno (void );
 
-void yyset_lineno (int line_number  );
+void lexgrog_set_lineno (int line_number  );
 
 /* Macros after this point can all be overridden by user definitions in
  * section 1.
@@ -2992,11 +3027,11 @@ YY_DECL
 		}
 
 	{
-#line 328 "lexgrog.l"
+#line 344 "lexgrog.l"
 
 
  /* begin NAME section processing */
-#line 3000 "lexgrog.c"
+#line 3016 "lexgrog.c"
 
 	while ( 1 )		/* loops until end-of-file is reached */
 		{
@@ -3052,78 +3087,78 @@ do_action:	/* This label is used only to access EOF actions. */
 case 1:
 /* rule 1 can match eol */
 YY_RULE_SETUP
-#line 331 "lexgrog.l"
+#line 347 "lexgrog.l"
 BEGIN (MAN_PRENAME);
 	YY_BREAK
 case 2:
 /* rule 2 can match eol */
 YY_RULE_SETUP
-#line 332 "lexgrog.l"
+#line 348 "lexgrog.l"
 BEGIN (CAT_NAME);
 	YY_BREAK
 /* general text matching */
 case 3:
-#line 336 "lexgrog.l"
+#line 352 "lexgrog.l"
 case 4:
-#line 337 "lexgrog.l"
+#line 353 "lexgrog.l"
 case 5:
-#line 338 "lexgrog.l"
+#line 354 "lexgrog.l"
 case 6:
-#line 339 "lexgrog.l"
+#line 355 "lexgrog.l"
 case 7:
-#line 340 "lexgrog.l"
+#line 356 "lexgrog.l"
 case 8:
 /* rule 8 can match eol */
-#line 341 "lexgrog.l"
+#line 357 "lexgrog.l"
 case 9:
 /* rule 9 can match eol */
 YY_RULE_SETUP
-#line 341 "lexgrog.l"
+#line 357 "lexgrog.l"
 
 	YY_BREAK
 
 case 10:
 /* rule 10 can match eol */
 YY_RULE_SETUP
-#line 344 "lexgrog.l"
+#line 360 "lexgrog.l"
 filters[TBL_FILTER] = 't';
 	YY_BREAK
 case 11:
 /* rule 11 can match eol */
 YY_RULE_SETUP
-#line 345 "lexgrog.l"
+#line 361 "lexgrog.l"
 filters[EQN_FILTER] = 'e';
 	YY_BREAK
 case 12:
 /* rule 12 can match eol */
 YY_RULE_SETUP
-#line 346 "lexgrog.l"
+#line 362 "lexgrog.l"
 filters[PIC_FILTER] = 'p';
 	YY_BREAK
 case 13:
 /* rule 13 can match eol */
 YY_RULE_SETUP
-#line 347 "lexgrog.l"
+#line 363 "lexgrog.l"
 filters[GRAP_FILTER] = 'g';
 	YY_BREAK
 case 14:
 /* rule 14 can match eol */
-#line 349 "lexgrog.l"
+#line 365 "lexgrog.l"
 case 15:
 /* rule 15 can match eol */
 YY_RULE_SETUP
-#line 349 "lexgrog.l"
+#line 365 "lexgrog.l"
 filters[REF_FILTER] = 'r';
 	YY_BREAK
 case 16:
 /* rule 16 can match eol */
 YY_RULE_SETUP
-#line 350 "lexgrog.l"
+#line 366 "lexgrog.l"
 filters[VGRIND_FILTER] = 'v';
 	YY_BREAK
 
 case YY_STATE_EOF(MAN_REST):
-#line 352 "lexgrog.l"
+#line 368 "lexgrog.l"
 {	/* exit */
 					*p_name = '\0'; /* terminate the string */
 					yyterminate ();
@@ -3132,14 +3167,14 @@ case YY_STATE_EOF(MAN_REST):
 case 17:
 /* rule 17 can match eol */
 YY_RULE_SETUP
-#line 356 "lexgrog.l"
+#line 372 "lexgrog.l"
 
 	YY_BREAK
 /* rules to end NAME section processing */
 case 18:
 /* rule 18 can match eol */
 YY_RULE_SETUP
-#line 359 "lexgrog.l"
+#line 375 "lexgrog.l"
 {	/* forced exit */
 					*p_name = '\0'; /* terminate the string */
 					yyterminate ();
@@ -3147,10 +3182,10 @@ YY_RULE_SETUP
 	YY_BREAK
 case 19:
 /* rule 19 can match eol */
-#line 365 "lexgrog.l"
+#line 381 "lexgrog.l"
 YY_RULE_SETUP
 case YY_STATE_EOF(MAN_PRENAME):
-#line 365 "lexgrog.l"
+#line 381 "lexgrog.l"
 {	/* no NAME at all */
 					*p_name = '\0';
 					BEGIN (MAN_REST);
@@ -3161,23 +3196,23 @@ case YY_STATE_EOF(MAN_PRENAME):
 
 case 20:
 /* rule 20 can match eol */
-#line 374 "lexgrog.l"
+#line 390 "lexgrog.l"
 case 21:
 /* rule 21 can match eol */
-#line 375 "lexgrog.l"
+#line 391 "lexgrog.l"
 case 22:
 /* rule 22 can match eol */
-#line 376 "lexgrog.l"
+#line 392 "lexgrog.l"
 case 23:
 /* rule 23 can match eol */
-#line 377 "lexgrog.l"
+#line 393 "lexgrog.l"
 case 24:
 /* rule 24 can match eol */
-#line 378 "lexgrog.l"
+#line 394 "lexgrog.l"
 case 25:
 /* rule 25 can match eol */
 YY_RULE_SETUP
-#line 378 "lexgrog.l"
+#line 394 "lexgrog.l"
 {
 						yyless (0);
 						BEGIN (MAN_NAME);
@@ -3189,19 +3224,19 @@ YY_RULE_SETUP
 case 26:
 /* rule 26 can match eol */
 YY_RULE_SETUP
-#line 386 "lexgrog.l"
+#line 402 "lexgrog.l"
 
 	YY_BREAK
 case 27:
 /* rule 27 can match eol */
 YY_RULE_SETUP
-#line 388 "lexgrog.l"
+#line 404 "lexgrog.l"
 yyless (1);
 	YY_BREAK
 case 28:
 /* rule 28 can match eol */
 YY_RULE_SETUP
-#line 390 "lexgrog.l"
+#line 406 "lexgrog.l"
 {
 					yyless (0);
 					BEGIN (MAN_NAME);
@@ -3209,28 +3244,28 @@ YY_RULE_SETUP
 	YY_BREAK
 case 29:
 /* rule 29 can match eol */
-#line 396 "lexgrog.l"
+#line 412 "lexgrog.l"
 case 30:
 /* rule 30 can match eol */
-#line 397 "lexgrog.l"
+#line 413 "lexgrog.l"
 case 31:
 /* rule 31 can match eol */
-#line 398 "lexgrog.l"
+#line 414 "lexgrog.l"
 case 32:
 /* rule 32 can match eol */
-#line 399 "lexgrog.l"
+#line 415 "lexgrog.l"
 case 33:
 /* rule 33 can match eol */
-#line 400 "lexgrog.l"
+#line 416 "lexgrog.l"
 case 34:
 /* rule 34 can match eol */
-#line 401 "lexgrog.l"
+#line 417 "lexgrog.l"
 case 35:
 /* rule 35 can match eol */
-#line 402 "lexgrog.l"
+#line 418 "lexgrog.l"
 YY_RULE_SETUP
 case YY_STATE_EOF(MAN_NAME):
-#line 402 "lexgrog.l"
+#line 418 "lexgrog.l"
 {	/* terminate the string */
 					*p_name = '\0';
 					BEGIN (MAN_REST);
@@ -3238,14 +3273,14 @@ case YY_STATE_EOF(MAN_NAME):
 	YY_BREAK
 case 36:
 /* rule 36 can match eol */
-#line 408 "lexgrog.l"
+#line 424 "lexgrog.l"
 case 37:
 /* rule 37 can match eol */
-#line 409 "lexgrog.l"
+#line 425 "lexgrog.l"
 case 38:
 /* rule 38 can match eol */
 YY_RULE_SETUP
-#line 409 "lexgrog.l"
+#line 425 "lexgrog.l"
 {	/* terminate the string */
 					*p_name = '\0';
 					BEGIN (CAT_REST);
@@ -3258,7 +3293,7 @@ YY_RULE_SETUP
 case 39:
 /* rule 39 can match eol */
 YY_RULE_SETUP
-#line 418 "lexgrog.l"
+#line 434 "lexgrog.l"
 {
 						newline_found ();
 						waiting_for_quote = 1;
@@ -3266,32 +3301,32 @@ YY_RULE_SETUP
 	YY_BREAK
 case 40:
 /* rule 40 can match eol */
-#line 424 "lexgrog.l"
+#line 440 "lexgrog.l"
 case 41:
 /* rule 41 can match eol */
-#line 425 "lexgrog.l"
+#line 441 "lexgrog.l"
 case 42:
 /* rule 42 can match eol */
-#line 426 "lexgrog.l"
+#line 442 "lexgrog.l"
 case 43:
 /* rule 43 can match eol */
-#line 427 "lexgrog.l"
+#line 443 "lexgrog.l"
 case 44:
 /* rule 44 can match eol */
-#line 428 "lexgrog.l"
+#line 444 "lexgrog.l"
 case 45:
 /* rule 45 can match eol */
-#line 429 "lexgrog.l"
+#line 445 "lexgrog.l"
 case 46:
 /* rule 46 can match eol */
-#line 430 "lexgrog.l"
+#line 446 "lexgrog.l"
 case 47:
 /* rule 47 can match eol */
-#line 431 "lexgrog.l"
+#line 447 "lexgrog.l"
 case 48:
 /* rule 48 can match eol */
 YY_RULE_SETUP
-#line 431 "lexgrog.l"
+#line 447 "lexgrog.l"
 {	/* per line comments */
 						newline_found ();
 					}
@@ -3304,7 +3339,7 @@ case 49:
 (yy_c_buf_p) = yy_cp -= 1;
 YY_DO_BEFORE_ACTION; /* set up yytext again */
 YY_RULE_SETUP
-#line 437 "lexgrog.l"
+#line 453 "lexgrog.l"
 newline_found ();
 	YY_BREAK
 case 50:
@@ -3313,45 +3348,45 @@ case 50:
 (yy_c_buf_p) = yy_cp -= 1;
 YY_DO_BEFORE_ACTION; /* set up yytext again */
 YY_RULE_SETUP
-#line 438 "lexgrog.l"
+#line 454 "lexgrog.l"
 newline_found ();
 	YY_BREAK
 /* Toggle fill mode */
 case 51:
 /* rule 51 can match eol */
 YY_RULE_SETUP
-#line 441 "lexgrog.l"
+#line 457 "lexgrog.l"
 fill_mode = 0;
 	YY_BREAK
 case 52:
 /* rule 52 can match eol */
 YY_RULE_SETUP
-#line 442 "lexgrog.l"
+#line 458 "lexgrog.l"
 fill_mode = 1;
 	YY_BREAK
 case 53:
 /* rule 53 can match eol */
 YY_RULE_SETUP
-#line 444 "lexgrog.l"
+#line 460 "lexgrog.l"
 /* strip continuations */
 	YY_BREAK
 /* convert to DASH */
 case 54:
 /* rule 54 can match eol */
-#line 448 "lexgrog.l"
+#line 464 "lexgrog.l"
 case 55:
 /* rule 55 can match eol */
-#line 449 "lexgrog.l"
+#line 465 "lexgrog.l"
 case 56:
 /* rule 56 can match eol */
-#line 450 "lexgrog.l"
+#line 466 "lexgrog.l"
 case 57:
 /* rule 57 can match eol */
-#line 451 "lexgrog.l"
+#line 467 "lexgrog.l"
 case 58:
 /* rule 58 can match eol */
 YY_RULE_SETUP
-#line 451 "lexgrog.l"
+#line 467 "lexgrog.l"
 add_separator_to_whatis ();
 	YY_BREAK
 /* escape sequences and special characters */
@@ -3359,141 +3394,141 @@ add_separator_to_whatis ();
 case 59:
 /* rule 59 can match eol */
 YY_RULE_SETUP
-#line 455 "lexgrog.l"
+#line 471 "lexgrog.l"
 add_char_to_whatis ('\\');
 	YY_BREAK
 case 60:
 /* rule 60 can match eol */
 YY_RULE_SETUP
-#line 456 "lexgrog.l"
+#line 472 "lexgrog.l"
 add_char_to_whatis ('\'');
 	YY_BREAK
 case 61:
 /* rule 61 can match eol */
 YY_RULE_SETUP
-#line 457 "lexgrog.l"
+#line 473 "lexgrog.l"
 add_char_to_whatis ('`');
 	YY_BREAK
 case 62:
 /* rule 62 can match eol */
 YY_RULE_SETUP
-#line 458 "lexgrog.l"
+#line 474 "lexgrog.l"
 add_char_to_whatis ('-');
 	YY_BREAK
 case 63:
 /* rule 63 can match eol */
 YY_RULE_SETUP
-#line 459 "lexgrog.l"
+#line 475 "lexgrog.l"
 add_char_to_whatis ('.');
 	YY_BREAK
 case 64:
 /* rule 64 can match eol */
 YY_RULE_SETUP
-#line 460 "lexgrog.l"
+#line 476 "lexgrog.l"
 add_char_to_whatis (' ');
 	YY_BREAK
 case 65:
 /* rule 65 can match eol */
 YY_RULE_SETUP
-#line 461 "lexgrog.l"
+#line 477 "lexgrog.l"
 add_char_to_whatis ('_');
 	YY_BREAK
 case 66:
 /* rule 66 can match eol */
 YY_RULE_SETUP
-#line 462 "lexgrog.l"
+#line 478 "lexgrog.l"
 add_char_to_whatis ('\t');
 	YY_BREAK
 case 67:
 /* rule 67 can match eol */
 YY_RULE_SETUP
-#line 464 "lexgrog.l"
+#line 480 "lexgrog.l"
 /* various useless control chars */
 	YY_BREAK
 case 68:
 /* rule 68 can match eol */
 YY_RULE_SETUP
-#line 465 "lexgrog.l"
+#line 481 "lexgrog.l"
 /* various inline functions */
 	YY_BREAK
 case 69:
 /* rule 69 can match eol */
 YY_RULE_SETUP
-#line 467 "lexgrog.l"
+#line 483 "lexgrog.l"
 /* interpolate arg */
 	YY_BREAK
 /* roff named glyphs */
 case 70:
 /* rule 70 can match eol */
 YY_RULE_SETUP
-#line 470 "lexgrog.l"
+#line 486 "lexgrog.l"
 add_glyph_to_whatis (yytext + 2, 2);
 	YY_BREAK
 /* perldoc strings */
 case 71:
 /* rule 71 can match eol */
 YY_RULE_SETUP
-#line 472 "lexgrog.l"
+#line 488 "lexgrog.l"
 add_perldoc_to_whatis (yytext + 3, 2);
 	YY_BREAK
 case 72:
 /* rule 72 can match eol */
 YY_RULE_SETUP
-#line 473 "lexgrog.l"
+#line 489 "lexgrog.l"
 add_perldoc_to_whatis (yytext + 2, 1);
 	YY_BREAK
 case 73:
 /* rule 73 can match eol */
 YY_RULE_SETUP
-#line 475 "lexgrog.l"
+#line 491 "lexgrog.l"
 /* comment */
 	YY_BREAK
 case 74:
 /* rule 74 can match eol */
 YY_RULE_SETUP
-#line 477 "lexgrog.l"
+#line 493 "lexgrog.l"
 /* font changes */
 	YY_BREAK
 case 75:
 /* rule 75 can match eol */
 YY_RULE_SETUP
-#line 478 "lexgrog.l"
+#line 494 "lexgrog.l"
 /* mark input place in register */
 	YY_BREAK
 case 76:
 /* rule 76 can match eol */
 YY_RULE_SETUP
-#line 480 "lexgrog.l"
+#line 496 "lexgrog.l"
 /* interpolate number register */
 	YY_BREAK
 case 77:
 /* rule 77 can match eol */
 YY_RULE_SETUP
-#line 481 "lexgrog.l"
+#line 497 "lexgrog.l"
 /* overstrike chars */
 	YY_BREAK
 case 78:
 /* rule 78 can match eol */
 YY_RULE_SETUP
-#line 483 "lexgrog.l"
+#line 499 "lexgrog.l"
 /* size changes */
 	YY_BREAK
 case 79:
 /* rule 79 can match eol */
 YY_RULE_SETUP
-#line 484 "lexgrog.l"
+#line 500 "lexgrog.l"
 /* width of string */
 	YY_BREAK
 case 80:
 /* rule 80 can match eol */
 YY_RULE_SETUP
-#line 486 "lexgrog.l"
+#line 502 "lexgrog.l"
 /* catch all */
 	YY_BREAK
 case 81:
 /* rule 81 can match eol */
 YY_RULE_SETUP
-#line 488 "lexgrog.l"
+#line 504 "lexgrog.l"
 /* function() in hpux */
 	YY_BREAK
 
@@ -3504,49 +3539,49 @@ YY_RULE_SETUP
 case 82:
 /* rule 82 can match eol */
 YY_RULE_SETUP
-#line 495 "lexgrog.l"
+#line 511 "lexgrog.l"
 BEGIN (MAN_NAME_AT);
 	YY_BREAK
 case 83:
 /* rule 83 can match eol */
 YY_RULE_SETUP
-#line 496 "lexgrog.l"
+#line 512 "lexgrog.l"
 BEGIN (MAN_NAME_BSX);
 	YY_BREAK
 case 84:
 /* rule 84 can match eol */
 YY_RULE_SETUP
-#line 497 "lexgrog.l"
+#line 513 "lexgrog.l"
 BEGIN (MAN_NAME_BX);
 	YY_BREAK
 case 85:
 /* rule 85 can match eol */
 YY_RULE_SETUP
-#line 498 "lexgrog.l"
+#line 514 "lexgrog.l"
 BEGIN (MAN_NAME_FX);
 	YY_BREAK
 case 86:
 /* rule 86 can match eol */
 YY_RULE_SETUP
-#line 499 "lexgrog.l"
+#line 515 "lexgrog.l"
 BEGIN (MAN_NAME_NX);
 	YY_BREAK
 case 87:
 /* rule 87 can match eol */
 YY_RULE_SETUP
-#line 500 "lexgrog.l"
+#line 516 "lexgrog.l"
 BEGIN (MAN_NAME_OX);
 	YY_BREAK
 case 88:
 /* rule 88 can match eol */
 YY_RULE_SETUP
-#line 501 "lexgrog.l"
+#line 517 "lexgrog.l"
 add_word_to_whatis ("UNIX");
 	YY_BREAK
 case 89:
 /* rule 89 can match eol */
 YY_RULE_SETUP
-#line 503 "lexgrog.l"
+#line 519 "lexgrog.l"
 {
 					add_word_to_whatis ("\"");
 					BEGIN (MAN_NAME_DQ);
@@ -3556,73 +3591,73 @@ YY_RULE_SETUP
 
 case 90:
 YY_RULE_SETUP
-#line 510 "lexgrog.l"
+#line 526 "lexgrog.l"
 mdoc_text ("Version 32V AT&T UNIX");
 	YY_BREAK
 case 91:
 YY_RULE_SETUP
-#line 511 "lexgrog.l"
+#line 527 "lexgrog.l"
 mdoc_text ("Version 1 AT&T UNIX");
 	YY_BREAK
 case 92:
 YY_RULE_SETUP
-#line 512 "lexgrog.l"
+#line 528 "lexgrog.l"
 mdoc_text ("Version 2 AT&T UNIX");
 	YY_BREAK
 case 93:
 YY_RULE_SETUP
-#line 513 "lexgrog.l"
+#line 529 "lexgrog.l"
 mdoc_text ("Version 3 AT&T UNIX");
 	YY_BREAK
 case 94:
 YY_RULE_SETUP
-#line 514 "lexgrog.l"
+#line 530 "lexgrog.l"
 mdoc_text ("Version 4 AT&T UNIX");
 	YY_BREAK
 case 95:
 YY_RULE_SETUP
-#line 515 "lexgrog.l"
+#line 531 "lexgrog.l"
 mdoc_text ("Version 5 AT&T UNIX");
 	YY_BREAK
 case 96:
 YY_RULE_SETUP
-#line 516 "lexgrog.l"
+#line 532 "lexgrog.l"
 mdoc_text ("Version 6 AT&T UNIX");
 	YY_BREAK
 case 97:
 YY_RULE_SETUP
-#line 517 "lexgrog.l"
+#line 533 "lexgrog.l"
 mdoc_text ("Version 7 AT&T UNIX");
 	YY_BREAK
 case 98:
 YY_RULE_SETUP
-#line 518 "lexgrog.l"
+#line 534 "lexgrog.l"
 mdoc_text ("AT&T System V UNIX");
 	YY_BREAK
 case 99:
 YY_RULE_SETUP
-#line 519 "lexgrog.l"
+#line 535 "lexgrog.l"
 mdoc_text ("AT&T System V.1 UNIX");
 	YY_BREAK
 case 100:
 YY_RULE_SETUP
-#line 520 "lexgrog.l"
+#line 536 "lexgrog.l"
 mdoc_text ("AT&T System V.2 UNIX");
 	YY_BREAK
 case 101:
 YY_RULE_SETUP
-#line 521 "lexgrog.l"
+#line 537 "lexgrog.l"
 mdoc_text ("AT&T System V.3 UNIX");
 	YY_BREAK
 case 102:
 YY_RULE_SETUP
-#line 522 "lexgrog.l"
+#line 538 "lexgrog.l"
 mdoc_text ("AT&T System V.4 UNIX");
 	YY_BREAK
 case 103:
 /* rule 103 can match eol */
 YY_RULE_SETUP
-#line 523 "lexgrog.l"
+#line 539 "lexgrog.l"
 {
 				yyless (0);
 				mdoc_text ("AT&T UNIX");
@@ -3632,7 +3667,7 @@ YY_RULE_SETUP
 
 case 104:
 YY_RULE_SETUP
-#line 530 "lexgrog.l"
+#line 546 "lexgrog.l"
 {
 				add_word_to_whatis ("BSD/OS");
 				add_wordn_to_whatis (yytext, yyleng);
@@ -3642,7 +3677,7 @@ YY_RULE_SETUP
 case 105:
 /* rule 105 can match eol */
 YY_RULE_SETUP
-#line 535 "lexgrog.l"
+#line 551 "lexgrog.l"
 {
 				yyless (0);
 				mdoc_text ("BSD/OS");
@@ -3652,22 +3687,22 @@ YY_RULE_SETUP
 
 case 106:
 YY_RULE_SETUP
-#line 542 "lexgrog.l"
+#line 558 "lexgrog.l"
 mdoc_text ("BSD (currently in alpha test)");
 	YY_BREAK
 case 107:
 YY_RULE_SETUP
-#line 543 "lexgrog.l"
+#line 559 "lexgrog.l"
 mdoc_text ("BSD (currently in beta test)");
 	YY_BREAK
 case 108:
 YY_RULE_SETUP
-#line 544 "lexgrog.l"
+#line 560 "lexgrog.l"
 mdoc_text ("BSD (currently under development");
 	YY_BREAK
 case 109:
 YY_RULE_SETUP
-#line 545 "lexgrog.l"
+#line 561 "lexgrog.l"
 {
 				add_wordn_to_whatis (yytext, yyleng);
 				add_str_to_whatis ("BSD", 3);
@@ -3677,7 +3712,7 @@ YY_RULE_SETUP
 case 110:
 /* rule 110 can match eol */
 YY_RULE_SETUP
-#line 550 "lexgrog.l"
+#line 566 "lexgrog.l"
 {
 				yyless (0);
 				mdoc_text ("BSD");
@@ -3687,7 +3722,7 @@ YY_RULE_SETUP
 
 case 111:
 YY_RULE_SETUP
-#line 557 "lexgrog.l"
+#line 573 "lexgrog.l"
 {
 					add_str_to_whatis ("-Reno", 5);
 					BEGIN (MAN_NAME);
@@ -3695,7 +3730,7 @@ YY_RULE_SETUP
 	YY_BREAK
 case 112:
 YY_RULE_SETUP
-#line 561 "lexgrog.l"
+#line 577 "lexgrog.l"
 {
 					add_str_to_whatis ("-Tahoe", 6);
 					BEGIN (MAN_NAME);
@@ -3703,7 +3738,7 @@ YY_RULE_SETUP
 	YY_BREAK
 case 113:
 YY_RULE_SETUP
-#line 565 "lexgrog.l"
+#line 581 "lexgrog.l"
 {
 					add_str_to_whatis ("-Lite", 5);
 					BEGIN (MAN_NAME);
@@ -3711,7 +3746,7 @@ YY_RULE_SETUP
 	YY_BREAK
 case 114:
 YY_RULE_SETUP
-#line 569 "lexgrog.l"
+#line 585 "lexgrog.l"
 {
 					add_str_to_whatis ("-Lite2", 6);
 					BEGIN (MAN_NAME);
@@ -3720,7 +3755,7 @@ YY_RULE_SETUP
 case 115:
 /* rule 115 can match eol */
 YY_RULE_SETUP
-#line 573 "lexgrog.l"
+#line 589 "lexgrog.l"
 {
 					yyless (0);
 					BEGIN (MAN_NAME);
@@ -3729,7 +3764,7 @@ YY_RULE_SETUP
 
 case 116:
 YY_RULE_SETUP
-#line 579 "lexgrog.l"
+#line 595 "lexgrog.l"
 {
 				add_str_to_whatis (yytext, yyleng);
 				add_char_to_whatis ('"');
@@ -3739,7 +3774,7 @@ YY_RULE_SETUP
 
 case 117:
 YY_RULE_SETUP
-#line 586 "lexgrog.l"
+#line 602 "lexgrog.l"
 {
 				add_word_to_whatis ("FreeBSD");
 				add_wordn_to_whatis (yytext, yyleng);
@@ -3749,7 +3784,7 @@ YY_RULE_SETUP
 case 118:
 /* rule 118 can match eol */
 YY_RULE_SETUP
-#line 591 "lexgrog.l"
+#line 607 "lexgrog.l"
 {
 				yyless (0);
 				mdoc_text ("FreeBSD");
@@ -3759,7 +3794,7 @@ YY_RULE_SETUP
 
 case 119:
 YY_RULE_SETUP
-#line 598 "lexgrog.l"
+#line 614 "lexgrog.l"
 {
 				add_word_to_whatis ("NetBSD");
 				add_wordn_to_whatis (yytext, yyleng);
@@ -3769,7 +3804,7 @@ YY_RULE_SETUP
 case 120:
 /* rule 120 can match eol */
 YY_RULE_SETUP
-#line 603 "lexgrog.l"
+#line 619 "lexgrog.l"
 {
 				yyless (0);
 				mdoc_text ("NetBSD");
@@ -3779,7 +3814,7 @@ YY_RULE_SETUP
 
 case 121:
 YY_RULE_SETUP
-#line 610 "lexgrog.l"
+#line 626 "lexgrog.l"
 {
 				add_word_to_whatis ("OpenBSD");
 				add_wordn_to_whatis (yytext, yyleng);
@@ -3789,7 +3824,7 @@ YY_RULE_SETUP
 case 122:
 /* rule 122 can match eol */
 YY_RULE_SETUP
-#line 615 "lexgrog.l"
+#line 631 "lexgrog.l"
 {
 				yyless (0);
 				mdoc_text ("OpenBSD");
@@ -3800,7 +3835,7 @@ YY_RULE_SETUP
 case 123:
 /* rule 123 can match eol */
 YY_RULE_SETUP
-#line 622 "lexgrog.l"
+#line 638 "lexgrog.l"
 add_char_to_whatis (' ');
 	YY_BREAK
 /* a ROFF break request, a paragraph request, or an indentation change
@@ -3809,29 +3844,29 @@ add_char_to_whatis (' ');
 
 case 124:
 /* rule 124 can match eol */
-#line 629 "lexgrog.l"
+#line 645 "lexgrog.l"
 case 125:
 /* rule 125 can match eol */
-#line 630 "lexgrog.l"
+#line 646 "lexgrog.l"
 case 126:
 /* rule 126 can match eol */
-#line 631 "lexgrog.l"
+#line 647 "lexgrog.l"
 case 127:
 /* rule 127 can match eol */
-#line 632 "lexgrog.l"
+#line 648 "lexgrog.l"
 case 128:
 /* rule 128 can match eol */
-#line 633 "lexgrog.l"
+#line 649 "lexgrog.l"
 case 129:
 /* rule 129 can match eol */
-#line 634 "lexgrog.l"
+#line 650 "lexgrog.l"
 case 130:
 /* rule 130 can match eol */
-#line 635 "lexgrog.l"
+#line 651 "lexgrog.l"
 case 131:
 /* rule 131 can match eol */
 YY_RULE_SETUP
-#line 635 "lexgrog.l"
+#line 651 "lexgrog.l"
 add_char_to_whatis ((char) 0x11);
 	YY_BREAK
 
@@ -3839,7 +3874,7 @@ add_char_to_whatis ((char) 0x11);
 case 132:
 /* rule 132 can match eol */
 YY_RULE_SETUP
-#line 639 "lexgrog.l"
+#line 655 "lexgrog.l"
 {
 					*p_name = '\0';
 					BEGIN (MAN_REST);
@@ -3848,23 +3883,23 @@ YY_RULE_SETUP
 /* pass words as a chunk. speed optimization */
 case 133:
 YY_RULE_SETUP
-#line 645 "lexgrog.l"
+#line 661 "lexgrog.l"
 add_str_to_whatis (yytext, yyleng);
 	YY_BREAK
 /* normalise the period (,) separators */
 case 134:
 /* rule 134 can match eol */
-#line 649 "lexgrog.l"
+#line 665 "lexgrog.l"
 case 135:
 /* rule 135 can match eol */
 YY_RULE_SETUP
-#line 649 "lexgrog.l"
+#line 665 "lexgrog.l"
 add_str_to_whatis (", ", 2);
 	YY_BREAK
 case 136:
 /* rule 136 can match eol */
 YY_RULE_SETUP
-#line 651 "lexgrog.l"
+#line 667 "lexgrog.l"
 {
 					newline_found ();
 					add_char_to_whatis (yytext[yyleng - 1]);
@@ -3872,7 +3907,7 @@ YY_RULE_SETUP
 	YY_BREAK
 case 137:
 YY_RULE_SETUP
-#line 656 "lexgrog.l"
+#line 672 "lexgrog.l"
 add_char_to_whatis (*yytext);
 	YY_BREAK
 /* default EOF rule */
@@ -3890,15 +3925,15 @@ case YY_STATE_EOF(CAT_FILE):
 case YY_STATE_EOF(MAN_FILE):
 case YY_STATE_EOF(CAT_REST):
 case YY_STATE_EOF(FORCE_EXIT):
-#line 659 "lexgrog.l"
+#line 675 "lexgrog.l"
 return 1;
 	YY_BREAK
 case 138:
 YY_RULE_SETUP
-#line 661 "lexgrog.l"
+#line 677 "lexgrog.l"
 ECHO;
 	YY_BREAK
-#line 3902 "lexgrog.c"
+#line 3918 "lexgrog.c"
 
 	case YY_END_OF_BUFFER:
 		{
@@ -4328,8 +4363,8 @@ static int yy_get_next_buffer (void)
     
 	/* TODO. We should be able to replace this entire function body
 	 * with
-	 *		yypop_buffer_state();
-	 *		yypush_buffer_state(new_buffer);
+	 *		lexgrog_pop_buffer_state();
+	 *		lexgrog_push_buffer_state(new_buffer);
      */
 	yyensure_buffer_stack ();
 	if ( YY_CURRENT_BUFFER == new_buffer )
@@ -4472,7 +4507,7 @@ static void yy_load_buffer_state  (void)
  *  @param new_buffer The new state.
  *  
  */
-void yypush_buffer_state (YY_BUFFER_STATE new_buffer )
+void lexgrog_push_buffer_state (YY_BUFFER_STATE new_buffer )
 {
     	if (new_buffer == NULL)
 		return;
@@ -4502,7 +4537,7 @@ void yypush_buffer_state (YY_BUFFER_STATE new_buffer )
  *  The next element becomes the new top.
  *  
  */
-void yypop_buffer_state (void)
+void lexgrog_pop_buffer_state (void)
 {
     	if (!YY_CURRENT_BUFFER)
 		return;
@@ -4570,7 +4605,7 @@ static void yyensure_buffer_stack (void)
  * 
  * @return the newly allocated buffer state object. 
  */
-YY_BUFFER_STATE yy_scan_buffer  (char * base, yy_size_t  size )
+YY_BUFFER_STATE lexgrog__scan_buffer  (char * base, yy_size_t  size )
 {
 	YY_BUFFER_STATE b;
     
@@ -4582,7 +4617,7 @@ YY_BUFFER_STATE yy_scan_buffer  (char * base, yy_size_t  size )
 
 	b = (YY_BUFFER_STATE) yyalloc(sizeof( struct yy_buffer_state )  );
 	if ( ! b )
-		YY_FATAL_ERROR( "out of dynamic memory in yy_scan_buffer()" );
+		YY_FATAL_ERROR( "out of dynamic memory in lexgrog__scan_buffer()" );
 
 	b->yy_buf_size = size - 2;	/* "- 2" to take care of EOB's */
 	b->yy_buf_pos = b->yy_ch_buf = base;
@@ -4605,12 +4640,12 @@ YY_BUFFER_STATE yy_scan_buffer  (char * base, yy_size_t  size )
  * 
  * @return the newly allocated buffer state object.
  * @note If you want to scan bytes that may contain NUL values, then use
- *       yy_scan_bytes() instead.
+ *       lexgrog__scan_bytes() instead.
  */
-YY_BUFFER_STATE yy_scan_string (yyconst char * yystr )
+YY_BUFFER_STATE lexgrog__scan_string (yyconst char * yystr )
 {
     
-	return yy_scan_bytes(yystr,strlen(yystr) );
+	return lexgrog__scan_bytes(yystr,strlen(yystr) );
 }
 
 /** Setup the input buffer state to scan the given bytes. The next call to yylex() will
@@ -4620,7 +4655,7 @@ YY_BUFFER_STATE yy_scan_string (yyconst char * yystr )
  * 
  * @return the newly allocated buffer state object.
  */
-YY_BUFFER_STATE yy_scan_bytes  (yyconst char * yybytes, yy_size_t  _yybytes_len )
+YY_BUFFER_STATE lexgrog__scan_bytes  (yyconst char * yybytes, yy_size_t  _yybytes_len )
 {
 	YY_BUFFER_STATE b;
 	char *buf;
@@ -4631,16 +4666,16 @@ YY_BUFFER_STATE yy_scan_bytes  (yyconst char * yybytes, yy_size_t  _yybytes_len
 	n = _yybytes_len + 2;
 	buf = (char *) yyalloc(n  );
 	if ( ! buf )
-		YY_FATAL_ERROR( "out of dynamic memory in yy_scan_bytes()" );
+		YY_FATAL_ERROR( "out of dynamic memory in lexgrog__scan_bytes()" );
 
 	for ( i = 0; i < _yybytes_len; ++i )
 		buf[i] = yybytes[i];
 
 	buf[_yybytes_len] = buf[_yybytes_len+1] = YY_END_OF_BUFFER_CHAR;
 
-	b = yy_scan_buffer(buf,n );
+	b = lexgrog__scan_buffer(buf,n );
 	if ( ! b )
-		YY_FATAL_ERROR( "bad buffer in yy_scan_bytes()" );
+		YY_FATAL_ERROR( "bad buffer in lexgrog__scan_bytes()" );
 
 	/* It's okay to grow etc. this buffer, and we should throw it
 	 * away when we're done.
@@ -4682,7 +4717,7 @@ static void yy_fatal_error (yyconst char* msg )
 /** Get the current line number.
  * 
  */
-int yyget_lineno  (void)
+int lexgrog_get_lineno  (void)
 {
         
     return yylineno;
@@ -4691,7 +4726,7 @@ int yyget_lineno  (void)
 /** Get the input stream.
  * 
  */
-FILE *yyget_in  (void)
+FILE *lexgrog_get_in  (void)
 {
         return yyin;
 }
@@ -4699,7 +4734,7 @@ FILE *yyget_in  (void)
 /** Get the output stream.
  * 
  */
-FILE *yyget_out  (void)
+FILE *lexgrog_get_out  (void)
 {
         return yyout;
 }
@@ -4707,7 +4742,7 @@ FILE *yyget_out  (void)
 /** Get the length of the current token.
  * 
  */
-yy_size_t yyget_leng  (void)
+yy_size_t lexgrog_get_leng  (void)
 {
         return yyleng;
 }
@@ -4716,7 +4751,7 @@ yy_size_t yyget_leng  (void)
  * 
  */
 
-char *yyget_text  (void)
+char *lexgrog_get_text  (void)
 {
         return yytext;
 }
@@ -4725,7 +4760,7 @@ char *yyget_text  (void)
  * @param line_number
  * 
  */
-void yyset_lineno (int  line_number )
+void lexgrog_set_lineno (int  line_number )
 {
     
     yylineno = line_number;
@@ -4737,22 +4772,22 @@ void yyset_lineno (int  line_number )
  * 
  * @see yy_switch_to_buffer
  */
-void yyset_in (FILE *  in_str )
+void lexgrog_set_in (FILE *  in_str )
 {
         yyin = in_str ;
 }
 
-void yyset_out (FILE *  out_str )
+void lexgrog_set_out (FILE *  out_str )
 {
         yyout = out_str ;
 }
 
-int yyget_debug  (void)
+int lexgrog_get_debug  (void)
 {
         return yy_flex_debug;
 }
 
-void yyset_debug (int  bdebug )
+void lexgrog_set_debug (int  bdebug )
 {
         yy_flex_debug = bdebug ;
 }
@@ -4760,7 +4795,7 @@ void yyset_debug (int  bdebug )
 static int yy_init_globals (void)
 {
         /* Initialization is the same as for the non-reentrant scanner.
-     * This function is called from yylex_destroy(), so don't allocate here.
+     * This function is called from lexgrog_lex_destroy(), so don't allocate here.
      */
 
     (yy_buffer_stack) = 0;
@@ -4785,15 +4820,15 @@ static int yy_init_globals (void)
     return 0;
 }
 
-/* yylex_destroy is for both reentrant and non-reentrant scanners. */
-int yylex_destroy  (void)
+/* lexgrog_lex_destroy is for both reentrant and non-reentrant scanners. */
+int lexgrog_lex_destroy  (void)
 {
     
     /* Pop the buffer stack, destroying each element. */
 	while(YY_CURRENT_BUFFER){
 		yy_delete_buffer(YY_CURRENT_BUFFER  );
 		YY_CURRENT_BUFFER_LVALUE = NULL;
-		yypop_buffer_state();
+		lexgrog_pop_buffer_state();
 	}
 
 	/* Destroy the stack itself. */
@@ -4855,7 +4890,7 @@ void yyfree (void * ptr )
 
 #define YYTABLES_NAME "yytables"
 
-#line 661 "lexgrog.l"
+#line 677 "lexgrog.l"
 
 
 
@@ -5035,6 +5070,8 @@ int find_name (const char *file, const char *filename, lexgrog *p_lg,
 	if (page_encoding)
 		add_manconv (p, page_encoding, "UTF-8");
 	free (page_encoding);
+	if (pipeline_get_ncommands (p))
+		STATS_ADD (STATS_PIPELINES, 1);
 	pipeline_start (p);
 
 	ret = find_name_decompressed (p, filename, p_lg);
@@ -5042,6 +5079,39 @@ int find_name (const char *file, const char *filename, lexgrog *p_lg,
 	return ret;
 }
 
+/* As find_name, but also set *ENCODING to "ASCII" or "UTF-8" if the page
+ * can be displayed without any encoding conversion, or NULL otherwise (see
+ * encoding_check_result).  This reads the rest of the page once its NAME
+ * section has been parsed, rather than decompressing it a second time.
+ */
+int find_name_and_encoding (const char *file, const char *filename,
+			    lexgrog *p_lg, const char **encoding)
+{
+	struct encoding_check check;
+	int ret;
+
+	/* Parse the page as it stands.  That is what conversion would
+	 * produce if it turns out to be ASCII or UTF-8.
+	 */
+	encoding_check_init (&check);
+	encoding_check = &check;
+	ret = find_name (file, filename, p_lg, "UTF-8");
+	encoding_check = NULL;
+	*encoding = encoding_check_result (&check);
+
+	/* Otherwise, conversion only changes what we parsed if it had
+	 * 8-bit bytes in it; it rarely does, so parse it again in that case.
+	 */
+	if (!*encoding && !encoding_check_lexed_ascii) {
+		free (p_lg->whatis);
+		free (p_lg->filters);
+		p_lg->whatis = p_lg->filters = NULL;
+		ret = find_name (file, filename, p_lg, NULL);
+	}
+
+	return ret;
+}
+
 int find_name_decompressed (pipeline *p, const char *filename, lexgrog *p_lg)
 {
 	int ret;
@@ -5065,6 +5135,17 @@ int find_name_decompressed (pipeline *p, const char *filename, lexgrog *p_lg)
 	yyrestart (NULL);
 	ret = yylex ();
 
+	if (encoding_check) {
+		encoding_check_lexed_ascii = encoding_check->ascii;
+		while (!encoding_check_done (encoding_check)) {
+			size_t size = 4096;
+			const char *block = pipeline_read (decomp, &size);
+			if (!block || !size)
+				break;
+			read_block (block, size);
+		}
+	}
+
 	regain_effective_privs ();
 
 	pipeline_wait (decomp);
@@ -104,7 +104,9 @@ static char *cwd;
 #include "manp.h"
 #include "convert_name.h"
 #include "zsoelim.h"
+#include "col.h"
 #include "manconv_client.h"
+#include "whatis.h"
 #include "man.h"
 
 #ifdef SECURE_MAN_UID
@@ -194,6 +196,7 @@ extern const char *extension; /* for globbing.c */
 extern char *user_config_file;	/* defined in manp.c */
 extern int disable_cache;
 extern int min_cat_width, max_cat_width, cat_width;
+extern char *db_backend;
 
 /* locals */
 static const char *alt_system_name;
@@ -241,6 +244,24 @@ static int first_arg;
 
 static int found_a_stray;		/* found a straycat */
 
+/* With -a, the next candidate is formatted into a temporary file in the
+ * background while the current one is displayed.
+ */
+struct prefetch {
+	struct candidate *candp;
+	pipeline *p;		/* formatting process */
+	int fd;			/* formatted page, in locale charset */
+};
+static struct prefetch prefetch = { NULL, NULL, -1 };
+static struct prefetch *prefetched_page; /* for the page being displayed */
+static int prefetching;		/* set in the formatting process */
+
+/* Whether standard output is a terminal.  This is checked once at startup
+ * rather than as needed, since the formatting process writes to a
+ * temporary file but must format pages just as the foreground would.
+ */
+static int stdout_tty;
+
 #ifdef MAN_CATS
 static char *tmp_cat_file;	/* for open_cat_stream(), close_cat_stream() */
 static int created_tmp_cat;			/* dto. */
@@ -618,7 +639,7 @@ static void set_term (void)
 
 static void get_term (void)
 {
-	if (isatty (STDOUT_FILENO)) {
+	if (stdout_tty) {
 		debug ("is a tty\n");
 		tcgetattr (STDIN_FILENO, &tms);
 		if (!tms_set++)
@@ -730,34 +751,6 @@ static inline void gripe_no_man (const char *name, const char *sec)
 #endif
 }
 
-/* fire up the appropriate external program */
-static void do_extern (int argc, char *argv[])
-{
-	pipeline *p;
-	pipecmd *cmd;
-
-	cmd = pipecmd_new (external);
-	/* Please keep these in the same order as they are in whatis.c. */
-	if (debug_level)
-		pipecmd_arg (cmd, "-d");
-	if (colon_sep_section_list)
-		pipecmd_args (cmd, "-s", colon_sep_section_list, NULL);
-	if (alt_system_name)
-		pipecmd_args (cmd, "-m", alt_system_name, NULL);
-	if (manp)
-		pipecmd_args (cmd, "-M", manp, NULL);
-	if (locale)
-		pipecmd_args (cmd, "-L", locale, NULL);
-	if (user_config_file)
-		pipecmd_args (cmd, "-C", user_config_file, NULL);
-	while (first_arg < argc)
-		pipecmd_arg (cmd, argv[first_arg++]);
-	p = pipeline_new_commands (cmd, NULL);
-
-	/* privs are already dropped */
-	exit (pipeline_run (p));
-}
-
 /* lookup $MANOPT and if available, put in *argv[] format for argp */
 static inline char **manopt_to_env (int *argc)
 {
@@ -899,6 +892,45 @@ static char *locale_manpath (char *manpath)
 	return new_manpath;
 }
 
+/* Search the index databases for whatis or apropos.  This used to run
+ * the external program, but the search engine is linked in, so we can
+ * save an exec and a second round of configuration parsing.
+ */
+static void do_extern (int argc, char *argv[])
+{
+	struct whatis_options search_options;
+	int found;
+
+	if (first_arg == argc) {
+		/* Make sure that we have a keyword! */
+		char *name = base_name (external);
+		printf (_("%s what?\n"), name);
+		free (name);
+		exit (FAIL);
+	}
+
+	memset (&search_options, 0, sizeof search_options);
+	search_options.apropos = STREQ (external, APROPOS);
+	/* apropos defaults to --regex */
+	search_options.regex = search_options.apropos;
+	if (colon_sep_section_list)
+		search_options.sections =
+			whatis_split_sections (colon_sep_section_list);
+	search_options.multiple_locale = multiple_locale;
+	search_options.internal_locale = internal_locale;
+
+	if (manp == NULL)
+		manp = locale_manpath (get_manpath (alt_system_name));
+	else
+		free (get_manpath (NULL));
+	create_pathlist (manp, manpathlist);
+
+	/* privs are already dropped */
+	found = whatis_search (&search_options, manpathlist, argv + first_arg,
+			       argc - first_arg);
+	free_pathlist (manpathlist);
+	exit (found ? OK : NOT_FOUND);
+}
 
 /* man issued with `-l' option */
 static int local_man_loop (const char *argv)
@@ -909,7 +941,7 @@ static int local_man_loop (const char *argv)
 	drop_effective_privs ();
 	local_man_file = 1;
 	if (strcmp (argv, "-") == 0)
-		display (NULL, "", NULL, "(stdin)", NULL);
+		display (NULL, "", NULL, "(stdin)", NULL, NULL);
 	else {
 		struct stat st;
 
@@ -1001,7 +1033,7 @@ executable_out:
 			}
 			lang = lang_dir (argv_abs);
 			free (argv_abs);
-			if (!display (NULL, argv, NULL, argv_base, NULL)) {
+			if (!display (NULL, argv, NULL, argv_base, NULL, NULL)) {
 				if (local_mf)
 					error (0, errno, "%s", argv);
 				exit_status = NOT_FOUND;
@@ -1055,6 +1087,7 @@ int main (int argc, char *argv[])
 		    ((fstat (STDERR_FILENO, &buf) < 0) && (errno == EBADF)))
 			freopen ("/dev/null", "w", stderr);
 	}
+	stdout_tty = isatty (STDOUT_FILENO);
 
 	/* This will enable us to do some profiling and know
 	where gmon.out will end up. Must chdir(cwd) before we return */
@@ -1090,10 +1123,7 @@ int main (int argc, char *argv[])
 #endif /* SECURE_MAN_UID */
 
 	read_config_file (local_man_file || user_config_file);
-
-	/* if the user wants whatis or apropos, give it to them... */
-	if (external)
-		do_extern (argc, argv);
+	mydbm_select_backend (db_backend);
 
 	get_term (); /* stores terminal settings */
 #ifdef SECURE_MAN_UID
@@ -1119,6 +1149,10 @@ int main (int argc, char *argv[])
 		}
 	}
 
+	/* if the user wants whatis or apropos, give it to them... */
+	if (external)
+		do_extern (argc, argv);
+
 #ifdef TROFF_IS_GROFF
 	if (htmlout)
 		pager = html_pager;
@@ -1479,9 +1513,29 @@ static void add_col (pipeline *p, const char *locale_charset, ...)
 	pipeline_command (p, cmd);
 }
 
+/* Recode a page from page_encoding to target, unless dbencoding (as
+ * recorded by mandb) shows that there is nothing to do.  Plain ASCII
+ * needs no recoding; a page that is merely valid UTF-8 does unless
+ * page_encoding says that it is meant to be read as UTF-8.
+ */
+static void add_page_manconv (pipeline *p, const char *page_encoding,
+			      const char *dbencoding, const char *target)
+{
+	if (dbencoding && (STREQ (dbencoding, "ASCII") ||
+			   (STREQ (dbencoding, "UTF-8") &&
+			    STREQ (page_encoding, "UTF-8") &&
+			    STREQ (target, "UTF-8")))) {
+		debug ("page is %s; not recoding to %s\n",
+		       dbencoding, target);
+		return;
+	}
+	add_manconv (p, page_encoding, target);
+}
+
 /* Return pipeline to format file to stdout. */
 static pipeline *make_roff_command (const char *dir, const char *file,
 				    pipeline *decomp, const char *dbfilters,
+				    const char *dbencoding,
 				    char **result_encoding)
 {
 	const char *pp_string;
@@ -1565,6 +1619,8 @@ static pipeline *make_roff_command (const char *dir, const char *file,
 			source_encoding = get_source_encoding (lang);
 		debug ("page_encoding = %s\n", page_encoding);
 		debug ("source_encoding = %s\n", source_encoding);
+		if (dbencoding)
+			debug ("verified page encoding = %s\n", dbencoding);
 
 		/* Load the roff_device value dependent on the language dir
 		 * in the path.
@@ -1615,18 +1671,23 @@ static pipeline *make_roff_command (const char *dir, const char *file,
 		 * If we have preconv, then use it to recode the
 		 * input to a safe escaped form.
 		 * The --recode option overrides everything else.
+		 * mandb may already have checked that the page is ASCII,
+		 * which needs no recoding, or UTF-8.
 		 */
 		groff_preconv = get_groff_preconv ();
 		if (recode)
 			add_manconv (p, page_encoding, recode);
 		else if (groff_preconv) {
-			add_manconv (p, page_encoding, "UTF-8");
+			add_page_manconv (p, page_encoding, dbencoding,
+					  "UTF-8");
 			pipeline_command_args
 				(p, groff_preconv, "-e", "UTF-8", NULL);
 		} else if (roff_encoding)
-			add_manconv (p, page_encoding, roff_encoding);
+			add_page_manconv (p, page_encoding, dbencoding,
+					  roff_encoding);
 		else
-			add_manconv (p, page_encoding, page_encoding);
+			add_page_manconv (p, page_encoding, dbencoding,
+					  page_encoding);
 
 		if (!troff && !recode) {
 			output_encoding = get_output_encoding (roff_device);
@@ -1787,11 +1848,11 @@ static pipeline *make_roff_command (const char *dir, const char *file,
 				break;
 		} while (*pp_string++);
 
-		if (!troff && *COL) {
+		if (!troff) {
 			const char *man_keep_formatting =
 				getenv ("MAN_KEEP_FORMATTING");
 			if ((!man_keep_formatting || !*man_keep_formatting) &&
-			    !isatty (STDOUT_FILENO))
+			    !stdout_tty)
 				/* we'll run col later, but prepare for it */
 				setenv ("GROFF_NO_SGR", "1", 1);
 #ifndef GNU_NROFF
@@ -1946,18 +2007,24 @@ static pipeline *make_display_command (const char *encoding, const char *title)
 	if (!troff && (!want_encoding || !is_roff_device (want_encoding)))
 		add_output_iconv (p, encoding, locale_charset);
 
-	if (!troff && *COL) {
+	if (!troff) {
 		/* get rid of special characters if not writing to a
 		 * terminal
 		 */
 		const char *man_keep_formatting =
 			getenv ("MAN_KEEP_FORMATTING");
 		if ((!man_keep_formatting || !*man_keep_formatting) &&
-		    !isatty (STDOUT_FILENO))
-			add_col (p, locale_charset, "-b", "-p", "-x", NULL);
+		    !stdout_tty) {
+			pipecmd *cmd = col_filter_new (locale_charset, 1);
+			if (cmd)
+				pipeline_command (p, cmd);
+			else if (*COL)
+				add_col (p, locale_charset,
+					 "-b", "-p", "-x", NULL);
+		}
 	}
 
-	if (isatty (STDOUT_FILENO)) {
+	if (stdout_tty) {
 		if (ascii) {
 			pipeline_command_argstr
 				(p, get_def_user ("tr", TR TR_SET1 TR_SET2));
@@ -2099,7 +2166,7 @@ static void discard_stderr (pipeline *p)
 static void maybe_discard_stderr (pipeline *p)
 {
 	const char *man_keep_stderr = getenv ("MAN_KEEP_STDERR");
-	if ((!man_keep_stderr || !*man_keep_stderr) && isatty (STDOUT_FILENO))
+	if ((!man_keep_stderr || !*man_keep_stderr) && stdout_tty)
 		discard_stderr (p);
 }
 
@@ -2140,8 +2207,7 @@ static pipeline *open_cat_stream (const char *cat_file, const char *encoding)
 	cat_p = pipeline_new ();
 	add_output_iconv (cat_p, encoding, "UTF-8");
 #  ifdef COMP_CAT
-	/* fork the compressor */
-	comp_cmd = pipecmd_new_argstr (get_def ("compressor", COMPRESSOR));
+	comp_cmd = compress_command (get_def ("compressor", COMPRESSOR));
 	pipecmd_nice (comp_cmd, 10);
 	pipeline_command (cat_p, comp_cmd);
 #  endif
@@ -2347,8 +2413,9 @@ static void display_catman (const char *cat_file, pipeline *decomp,
 	add_output_iconv (format_cmd, encoding, "UTF-8");
 
 #ifdef COMP_CAT
-	pipeline_command_argstr (format_cmd,
-				 get_def ("compressor", COMPRESSOR));
+	pipeline_command (format_cmd,
+			  compress_command (get_def ("compressor",
+						     COMPRESSOR)));
 #endif /* COMP_CAT */
 
 	maybe_discard_stderr (format_cmd);
@@ -2427,9 +2494,52 @@ static void locale_macros (void *data)
  * If man_file is "" this is a special case -- we expect the man page
  * on standard input.
  */
+/* Format a page for later display, sending it to stdout. */
+static int prefetch_format (pipeline *decomp, pipeline *format_cmd,
+			    const char *formatted_encoding)
+{
+	add_output_iconv (format_cmd, formatted_encoding,
+			  my_locale_charset ());
+	discard_stderr (format_cmd);
+	pipeline_connect (decomp, format_cmd, NULL);
+	pipeline_pump (decomp, format_cmd, NULL);
+	pipeline_wait (decomp);
+	return pipeline_wait (format_cmd);
+}
+
+/* If the page about to be displayed was formatted in the background,
+ * return a pipeline reading the result; otherwise return NULL.
+ */
+static pipeline *take_prefetched_page (void)
+{
+	pipeline *page;
+	int status;
+
+	if (!prefetched_page || !prefetched_page->p)
+		return NULL;
+
+	status = pipeline_wait (prefetched_page->p);
+	pipeline_free (prefetched_page->p);
+	prefetched_page->p = NULL;
+	if (status) {
+		debug ("background formatting failed; formatting again\n");
+		return NULL;
+	}
+	if (lseek (prefetched_page->fd, 0, SEEK_SET) == (off_t) -1)
+		return NULL;
+
+	debug ("using page formatted in the background\n");
+	page = pipeline_new ();
+	pipeline_want_in (page, prefetched_page->fd);
+	pipeline_want_out (page, -1);
+	/* pipeline_start will close the file */
+	prefetched_page->fd = -1;
+	return page;
+}
+
 static int display (const char *dir, const char *man_file,
 		    const char *cat_file, const char *title,
-		    const char *dbfilters)
+		    const char *dbfilters, const char *dbencoding)
 {
 	int found;
 	static int prompt;
@@ -2520,7 +2630,7 @@ static int display (const char *dir, const char *man_file,
 	if (decomp) {
 		pipeline_start (decomp);
 		format_cmd = make_roff_command (dir, man_file, decomp,
-						dbfilters,
+						dbfilters, dbencoding,
 						&formatted_encoding);
 		debug ("formatted_encoding = %s\n", formatted_encoding);
 	} else {
@@ -2657,6 +2767,18 @@ static int display (const char *dir, const char *man_file,
 			return found;
 		}
 
+		if (prefetching) {
+			/* Leave anything other than formatting to the
+			 * foreground.
+			 */
+			if (format && prefetch_format (decomp, format_cmd,
+						       formatted_encoding))
+				format = 0;
+			pipeline_free (format_cmd);
+			pipeline_free (decomp);
+			return format;
+		}
+
 		if (print_where || print_where_cat) {
 			int printed = 0;
 			if (print_where && man_file) {
@@ -2686,6 +2808,7 @@ static int display (const char *dir, const char *man_file,
 		} else if (format) {
 			/* no cat or out of date */
 			pipeline *disp_cmd;
+			pipeline *prefetched;
 
 			if (prompt && do_prompt (title)) {
 				pipeline_free (format_cmd);
@@ -2696,6 +2819,18 @@ static int display (const char *dir, const char *man_file,
 					return 0;
 			}
 
+			prefetched = take_prefetched_page ();
+			if (prefetched) {
+				/* already formatted and recoded */
+				pipeline_free (format_cmd);
+				format_cmd = NULL;
+				pipeline_free (decomp);
+				decomp = prefetched;
+				free (formatted_encoding);
+				formatted_encoding = NULL;
+				save_cat = 0;
+			}
+
 			disp_cmd = make_display_command (formatted_encoding,
 							 title);
 
@@ -3305,6 +3440,48 @@ static int try_section (const char *path, const char *sec, const char *name,
 	return found;
 }
 
+/* Return the encoding that mandb recorded for a page, provided that the
+ * page has not changed since.
+ */
+static const char *recorded_encoding (const struct mandata *info,
+				      const char *man_file)
+{
+	struct stat st;
+
+	if (!info->encoding)
+		return NULL;
+	if (stat (man_file, &st) || st.st_mtime != info->_st_mtime)
+		return NULL;
+	return info->encoding;
+}
+
+/* A page found on the filesystem has usually been looked up in its
+ * hierarchy's database as well while searching other sections; if so, use
+ * any encoding recorded there.
+ */
+static const char *filesystem_encoding (const struct candidate *candp,
+					const char *man_file)
+{
+	const struct mandata *data, *loc;
+
+	if (!db_hash)
+		return NULL;
+	data = hashtable_lookup (db_hash, candp->path, strlen (candp->path));
+	if (!data || !data->addr)
+		return NULL;
+
+	for (loc = data; loc; loc = loc->next) {
+		const char *name = loc->name ? loc->name : candp->req_name;
+
+		if (STREQ (name, candp->source->name) &&
+		    STREQ (loc->sec, candp->source->sec) &&
+		    STREQ (loc->ext, candp->source->ext))
+			return recorded_encoding (loc, man_file);
+	}
+
+	return NULL;
+}
+
 static int display_filesystem (struct candidate *candp)
 {
 	char *filename = make_filename (candp->path, NULL, candp->source,
@@ -3315,7 +3492,8 @@ static int display_filesystem (struct candidate *candp)
 	if (candp->cat) {
 		if (troff || want_encoding || recode)
 			return 0;
-		return display (candp->path, NULL, filename, title, NULL);
+		return display (candp->path, NULL, filename, title, NULL,
+				NULL);
 	} else {
 		const char *man_file;
 		char *cat_file;
@@ -3332,7 +3510,8 @@ static int display_filesystem (struct candidate *candp)
 		lang = lang_dir (man_file);
 
 		cat_file = find_cat_file (candp->path, filename, man_file);
-		found = display (candp->path, man_file, cat_file, title, NULL);
+		found = display (candp->path, man_file, cat_file, title, NULL,
+				 filesystem_encoding (candp, man_file));
 		if (cat_file)
 			free (cat_file);
 		free (lang);
@@ -3344,17 +3523,48 @@ static int display_filesystem (struct candidate *candp)
 }
 
 #ifdef MAN_DB_UPDATES
-/* wrapper to dbdelete which deals with opening/closing the db */
+/* wrapper to dbdelete which deals with opening/closing the db; the
+ * published database is never changed in place, so work on a copy
+ */
 static void dbdelete_wrapper (const char *page, struct mandata *info)
 {
-	if (!catman) {
-		dbf = MYDBM_RWOPEN (database);
+	char *tmp;
+
+	if (catman)
+		return;
+
+	/* Copying and republishing the whole database is expensive, so
+	 * make sure there is something to delete first.
+	 */
+	dbf = MYDBM_RDOPEN (database);
+	if (dbf) {
+		struct mandata *found = dblookup_exact (page, info->ext, 1);
+
+		MYDBM_CLOSE (dbf);
+		dbf = NULL;
+		if (!found) {
+			debug ("%s(%s) not in db!\n", page, info->ext);
+			return;
+		}
+		free_mandata_struct (found);
+	}
+
+	tmp = xasprintf ("%s.%ld.tmp", database, (long) getpid ());
+	if (mydbm_copy (database, tmp) == 0) {
+		dbf = MYDBM_RWOPEN (tmp);
 		if (dbf) {
-			if (dbdelete (page, info) == 1)
+			int status = dbdelete (page, info);
+
+			MYDBM_CLOSE (dbf);
+			dbf = NULL;
+			if (status == 1)
 				debug ("%s(%s) not in db!\n", page, info->ext);
-			MYDBM_CLOSE(dbf);
+			else
+				mydbm_publish (database, tmp);
 		}
 	}
+	mydbm_unlink (tmp);
+	free (tmp);
 }
 #endif /* MAN_DB_UPDATES */
 
@@ -3410,7 +3620,8 @@ static int display_database (struct candidate *candp)
 
 			cat_file = find_cat_file (candp->path, file, man_file);
 			found += display (candp->path, man_file, cat_file,
-					  title, in->filter);
+					  title, in->filter,
+					  recorded_encoding (in, man_file));
 			if (cat_file)
 				free (cat_file);
 			free (lang);
@@ -3470,7 +3681,8 @@ static int display_database (struct candidate *candp)
 			}
 		}
 
-		found += display (candp->path, NULL, file, title, in->filter);
+		found += display (candp->path, NULL, file, title, in->filter,
+				  NULL);
 	}
 	free (title);
 	return found;
@@ -3498,16 +3710,18 @@ static void db_hashtable_free (void *defn)
 }
 
 #ifdef MAN_DB_UPDATES
-static int maybe_update_file (const char *manpath, const char *name,
-			      struct mandata *info)
+/* Return the name of the file that INFO describes if it has changed since
+ * it was recorded in the database, or NULL if it is up to date.
+ */
+static char *stale_file (const char *manpath, const char *name,
+			 struct mandata *info)
 {
 	const char *real_name;
 	char *file;
 	struct stat buf;
-	int status;
 
 	if (!update)
-		return 0;
+		return NULL;
 
 	/* If the pointer holds some data, then we need to look at that
 	 * name in the filesystem instead.
@@ -3520,19 +3734,71 @@ static int maybe_update_file (const char *manpath, const char *name,
 		real_name = name;
 
 	file = make_filename (manpath, real_name, info, "man");
-	if (lstat (file, &buf) != 0)
-		return 0;
-	if (buf.st_mtime == info->_st_mtime)
-		return 0;
+	if (lstat (file, &buf) != 0 || buf.st_mtime == info->_st_mtime) {
+		free (file);
+		return NULL;
+	}
 
 	debug ("%s needs to be recached: %ld %ld\n",
 	       file, (long) info->_st_mtime, (long) buf.st_mtime);
-	status = run_mandb (0, manpath, file);
-	if (status)
-		error (0, 0, _("mandb command failed with exit status %d"),
-		       status);
+	return file;
+}
+#endif /* MAN_DB_UPDATES */
 
-	return 1;
+/* Look NAME up in the database open on dbf. */
+static struct mandata *lookup_page (const char *name)
+{
+	/* if section is set, only return those that match, otherwise NULL
+	 * retrieves all available
+	 */
+	if (regex_opt || wildcard)
+		return dblookup_pattern (name, section, match_case,
+					 regex_opt, !names_only);
+	else
+		return dblookup_all (name, section, match_case);
+}
+
+#ifdef MAN_DB_UPDATES
+/* Bring the entries for the N_FILES pages in FILES up to date, as "mandb
+ * -f" would, and look NAME up again in the result.  Returns 0 if this
+ * could not be done, in which case the caller should run mandb instead.
+ */
+static int update_stale_files (const char *manpath, const char *name,
+			       char **files, size_t n_files,
+			       struct mandata **data)
+{
+	char *tmp;
+	size_t i;
+	int ret = 0;
+
+	*data = NULL;
+	tmp = xasprintf ("%s.%ld.tmp", database, (long) getpid ());
+	if (mydbm_copy (database, tmp) == 0) {
+		dbf = MYDBM_RWOPEN (tmp);
+		if (dbf && dbver_outdated (dbf)) {
+			/* mandb will need to rebuild it */
+			MYDBM_CLOSE (dbf);
+			dbf = NULL;
+		}
+		if (dbf) {
+			for (i = 0; i < n_files; ++i)
+				update_file (manpath, files[i]);
+			purge_pointers ();
+			dbtrigram_update ();
+			*data = lookup_page (name);
+			MYDBM_CLOSE (dbf);
+			dbf = NULL;
+			if (mydbm_publish (database, tmp) == 0)
+				ret = 1;
+			else {
+				free_mandata_struct (*data);
+				*data = NULL;
+			}
+		}
+	}
+	mydbm_unlink (tmp);
+	free (tmp);
+	return ret;
 }
 #endif /* MAN_DB_UPDATES */
 
@@ -3557,7 +3823,8 @@ static int try_db (const char *manpath, const char *sec, const char *name,
 	char *catpath;
 	int found = 0;
 #ifdef MAN_DB_UPDATES
-	int found_stale = 0;
+	char **stale = NULL;
+	size_t n_stale = 0;
 #endif /* MAN_DB_UPDATES */
 
 	/* find out where our db for this manpath should be */
@@ -3584,15 +3851,7 @@ static int try_db (const char *manpath, const char *sec, const char *name,
 		if (dbf) {
 			debug ("Succeeded in opening %s O_RDONLY\n", database);
 
-			/* if section is set, only return those that match,
-			   otherwise NULL retrieves all available */
-			if (regex_opt || wildcard)
-				data = dblookup_pattern
-					(name, section, match_case,
-					 regex_opt, !names_only);
-			else
-				data = dblookup_all (name, section,
-						     match_case);
+			data = lookup_page (name);
 			hashtable_install (db_hash, manpath, strlen (manpath),
 					   data);
 			MYDBM_CLOSE (dbf);
@@ -3631,19 +3890,50 @@ static int try_db (const char *manpath, const char *sec, const char *name,
 		return TRY_DATABASE_OPEN_FAILED;
 
 #ifdef MAN_DB_UPDATES
-	/* Check that all the entries found are up to date. If not, the
-	 * caller should try again.
+	/* Check that all the entries found are up to date, and refresh any
+	 * that are not.
 	 */
 	for (loc = data; loc; loc = loc->next)
 		if (STREQ (sec, loc->sec) &&
 		    (!extension || STREQ (extension, loc->ext)
-				|| STREQ (extension, loc->ext + strlen (sec))))
-			if (maybe_update_file (manpath, name, loc))
-				found_stale = 1;
+				|| STREQ (extension, loc->ext + strlen (sec)))) {
+			char *file = stale_file (manpath, name, loc);
+			if (file) {
+				stale = xnrealloc (stale, n_stale + 1,
+						   sizeof *stale);
+				stale[n_stale++] = file;
+			}
+		}
 
-	if (found_stale) {
-		hashtable_remove (db_hash, manpath, strlen (manpath));
-		return TRY_DATABASE_UPDATED;
+	if (n_stale) {
+		struct mandata *fresh;
+		int updated = update_stale_files (manpath, name,
+						  stale, n_stale, &fresh);
+		size_t i;
+
+		if (!updated) {
+			/* Let mandb do it, and have the caller try again. */
+			for (i = 0; i < n_stale; ++i) {
+				int status = run_mandb (0, manpath, stale[i]);
+				if (status)
+					error (0, 0, _("mandb command failed "
+						       "with exit status %d"),
+					       status);
+			}
+		}
+		for (i = 0; i < n_stale; ++i)
+			free (stale[i]);
+		free (stale);
+		if (!updated) {
+			hashtable_remove (db_hash, manpath, strlen (manpath));
+			return TRY_DATABASE_UPDATED;
+		}
+
+		/* This frees the stale entries. */
+		hashtable_install (db_hash, manpath, strlen (manpath), fresh);
+		data = fresh;
+		if (!data)
+			return 0;
 	}
 #endif /* MAN_DB_UPDATES */
 
@@ -3710,31 +4000,118 @@ static int locate_page (const char *manpath, const char *sec, const char *name,
 	return found;
 }
 
+static int display_candidate (struct candidate *candp, int check_db)
+{
+	int found = 0;
+
+	global_manpath = is_global_mandir (candp->path);
+	if (!global_manpath)
+		drop_effective_privs ();
+
+	switch (candp->from_db) {
+		case CANDIDATE_FILESYSTEM:
+			found = display_filesystem (candp);
+			break;
+		case CANDIDATE_DATABASE:
+			if (check_db)
+				found = display_database_check (candp);
+			else
+				found = display_database (candp);
+			break;
+		default:
+			error (0, 0,
+			       _("internal error: candidate type %d "
+				 "out of range"), candp->from_db);
+	}
+
+	if (!global_manpath)
+		regain_effective_privs ();
+
+	return found;
+}
+
+static void prefetch_page (void *data)
+{
+	struct candidate *candp = data;
+
+	prefetching = 1;
+	exit (display_candidate (candp, 0) ? OK : FAIL);
+}
+
+/* Start formatting CANDP in the background, unless it is to be shown in
+ * some way other than in the usual pager.
+ */
+static void start_prefetch (struct candidate *candp)
+{
+	FILE *tmp;
+	pipecmd *cmd;
+
+	if (troff || want_encoding || recode || catman ||
+	    print_where || print_where_cat)
+		return;
+#ifdef TROFF_IS_GROFF
+	if (htmlout)
+		return;
+#endif /* TROFF_IS_GROFF */
+
+	tmp = tmpfile ();
+	if (!tmp)
+		return;
+	prefetch.fd = dup (fileno (tmp));
+	fclose (tmp);
+	if (prefetch.fd == -1)
+		return;
+
+	/* The formatting process writes to a file, so find the terminal's
+	 * width for it here.
+	 */
+	get_line_length ();
+
+	debug ("formatting %s in the background\n", candp->req_name);
+	cmd = pipecmd_new_function ("prefetch", &prefetch_page, NULL, candp);
+	pipecmd_discard_err (cmd, 1);
+	prefetch.candp = candp;
+	prefetch.p = pipeline_new_commands (cmd, NULL);
+	/* pipeline_start will close the duplicate */
+	pipeline_want_out (prefetch.p, dup (prefetch.fd));
+	pipeline_start (prefetch.p);
+}
+
+static void finish_prefetch (struct prefetch *pf)
+{
+	if (pf->p) {
+		pipeline_wait (pf->p);
+		pipeline_free (pf->p);
+		pf->p = NULL;
+	}
+	if (pf->fd != -1) {
+		close (pf->fd);
+		pf->fd = -1;
+	}
+	pf->candp = NULL;
+}
+
 static int display_pages (struct candidate *candidates)
 {
 	struct candidate *candp;
 	int found = 0;
 
 	for (candp = candidates; candp; candp = candp->next) {
-		global_manpath = is_global_mandir (candp->path);
-		if (!global_manpath)
-			drop_effective_privs ();
+		struct prefetch current = { NULL, NULL, -1 };
 
-		switch (candp->from_db) {
-			case CANDIDATE_FILESYSTEM:
-				found += display_filesystem (candp);
-				break;
-			case CANDIDATE_DATABASE:
-				found += display_database_check (candp);
-				break;
-			default:
-				error (0, 0,
-				       _("internal error: candidate type %d "
-					 "out of range"), candp->from_db);
+		if (prefetch.candp == candp) {
+			current = prefetch;
+			prefetch.candp = NULL;
+			prefetch.p = NULL;
+			prefetch.fd = -1;
 		}
+		if (findall && candp->next)
+			start_prefetch (candp->next);
 
-		if (!global_manpath)
-			regain_effective_privs ();
+		prefetched_page = &current;
+		found += display_candidate (candp, 1);
+		prefetched_page = NULL;
+		finish_prefetch (&current);
 
 		if (found && !findall)
 			return found;
@@ -3839,7 +4216,7 @@ static int do_global_apropos_section (const char *path, const char *sec,
 			goto next;
 		lang = lang_dir (man_file);
 		cat_file = find_cat_file (path, *np, man_file);
-		if (display (path, man_file, cat_file, title, NULL))
+		if (display (path, man_file, cat_file, title, NULL, NULL))
 			found = 1;
 		free (lang);
 		lang = NULL;
@@ -3991,7 +4368,7 @@ static inline int do_prompt (const char *name)
 	int ch;
 
 	skip = 0;
-	if (!isatty (STDOUT_FILENO) || !isatty (STDIN_FILENO))
+	if (!stdout_tty || !isatty (STDIN_FILENO))
 		return 0;
 
 	fprintf (stderr, _( 
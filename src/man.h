@@ -28,5 +28,5 @@ static int do_global_apropos (const char *name, int *found);
 static int man (const char *name, int *found);
 static int display (const char *dir, const char *man_file,
 		    const char *cat_file, const char *title,
-		    const char *dbfilters);
+		    const char *dbfilters, const char *dbencoding);
 static inline int do_prompt (const char *name);
@@ -41,6 +41,11 @@
 #include <unistd.h>
 #include <signal.h>
 
+#ifdef HAVE_SYS_INOTIFY_H
+#  include <poll.h>
+#  include <sys/inotify.h>
+#endif /* HAVE_SYS_INOTIFY_H */
+
 #ifdef SECURE_MAN_UID
 #  include <pwd.h>
 #endif /* SECURE_MAN_UID */
@@ -61,11 +66,12 @@
 #include "hashtable.h"
 #include "pipeline.h"
 #include "security.h"
+#include "stats.h"
 
 #include "mydbm.h"
+#include "db_storage.h"
 
 #include "check_mandirs.h"
-#include "filenames.h"
 #include "manp.h"
 
 char *program_name;
@@ -77,7 +83,11 @@ char *database = NULL;
 extern char *extension;		/* for globbing.c */
 extern int force_rescan;	/* for check_mandirs.c */
 static char *single_filename = NULL;
+static const char *single_filename_list[2];
+static char *import_filename = NULL;
+static int merge_shards = 0;
 extern char *user_config_file;	/* for manp.c */
+extern char *db_backend;	/* for manp.c */
 #ifdef SECURE_MAN_UID
 struct passwd *man_owner;
 #endif
@@ -88,7 +98,12 @@ static int check_for_strays = 1;
 static int purge = 1;
 static int user;
 static int create;
+static int watch;
+static int want_stats;
+static int stats_json;
 static const char *arg_manp;
+/* files to update in the database being processed, if not all of them */
+static const char * const *update_filenames;
 
 struct tried_catdirs_entry {
 	char *manpath;
@@ -101,6 +116,12 @@ error_t argp_err_exit_status = FAIL;
 
 static const char args_doc[] = N_("[MANPATH]");
 
+enum opts {
+	OPT_WATCH = 256,
+	OPT_STATS,
+	OPT_MAX
+};
+
 static struct argp_option options[] = {
 	{ "debug",		'd',	0,		0,	N_("emit debugging messages") },
 	{ "quiet",		'q',	0,		0,	N_("work quietly, except for 'bogus' warning") },
@@ -110,6 +131,10 @@ static struct argp_option options[] = {
 	{ "create",		'c',	0,		0,	N_("create dbs from scratch, rather than updating") },
 	{ "test",		't',	0,		0,	N_("check manual pages for correctness") },
 	{ "filename",		'f',	N_("FILENAME"),	0,	N_("update just the entry for this filename") },
+	{ "import",		'i',	N_("FILE"),	0,	N_("create dbs from pre-extracted page data in FILE") },
+	{ "merge-shards",	'm',	0,		0,	N_("create dbs by merging index shards where available") },
+	{ "watch",		OPT_WATCH, 0,		0,	N_("keep the dbs up to date as manual pages change") },
+	{ "stats",		OPT_STATS, N_("FORMAT"), OPTION_ARG_OPTIONAL, N_("report where the time went, as text or json") },
 	{ "config-file",	'C',	N_("FILE"),	0,	N_("use this user configuration file") },
 	{ 0, 'h', 0, OPTION_HIDDEN, 0 }, /* compatibility for --help */
 	{ 0 }
@@ -144,13 +169,39 @@ static error_t parse_opt (int key, char *arg, struct argp_state *state)
 			return 0;
 		case 'f':
 			single_filename = arg;
+			single_filename_list[0] = arg;
+			update_filenames = single_filename_list;
 			create = 0;
 			purge = 0;
 			check_for_strays = 0;
 			return 0;
+		case 'i':
+			import_filename = arg;
+			create = 1;
+			purge = 0;
+			return 0;
+		case 'm':
+			merge_shards = 1;
+			create = 1;
+			purge = 0;
+			return 0;
 		case 'C':
 			user_config_file = arg;
 			return 0;
+		case OPT_WATCH:
+			watch = 1;
+			return 0;
+		case OPT_STATS:
+			want_stats = 1;
+			if (!arg || STREQ (arg, "text"))
+				stats_json = 0;
+			else if (STREQ (arg, "json"))
+				stats_json = 1;
+			else
+				argp_error (state,
+					    _("statistics format must be "
+					      "'text' or 'json'"));
+			return 0;
 		case 'h':
 			argp_state_help (state, state->out_stream,
 					 ARGP_HELP_STD_HELP);
@@ -161,6 +212,27 @@ static error_t parse_opt (int key, char *arg, struct argp_state *state)
 			arg_manp = arg;
 			return 0;
 		case ARGP_KEY_SUCCESS:
+			if (import_filename && single_filename)
+				argp_error (state,
+					    _("--import and --filename are "
+					      "mutually exclusive"));
+			if (merge_shards && (import_filename ||
+					     single_filename))
+				argp_error (state,
+					    _("--merge-shards may not be used "
+					      "with --import or --filename"));
+			if (watch && (import_filename || single_filename ||
+				      merge_shards || opt_test))
+				argp_error (state,
+					    _("--watch may not be used with "
+					      "--import, --filename, "
+					      "--merge-shards or --test"));
+#ifndef HAVE_SYS_INOTIFY_H
+			if (watch)
+				argp_error (state,
+					    _("--watch is not supported on "
+					      "this system"));
+#endif /* !HAVE_SYS_INOTIFY_H */
 			if (opt_test && !debug_level)
 				quiet = 1;
 			else if (quiet_temp == 1)
@@ -174,20 +246,11 @@ static error_t parse_opt (int key, char *arg, struct argp_state *state)
 
 static struct argp argp = { options, parse_opt, args_doc };
 
-#ifdef NDBM
-#  ifdef BERKELEY_DB
-static char *dbfile;
-static char *tmpdbfile;
-#  else /* !BERKELEY_DB NDBM */
-static char *dirfile;
-static char *pagfile;
-static char *tmpdirfile;
-static char *tmppagfile;
-#  endif /* BERKELEY_DB */
-#else /* !NDBM */
-static char *xfile;
-static const char *xtmpfile;
-#endif /* NDBM */
+/* The name of the database being updated, and the files making up the
+ * private copy being built; how many there are depends on the backend.
+ */
+static char *dbname;
+static char **tmpdbfiles;
 
 #ifdef SECURE_MAN_UID
 extern uid_t ruid;
@@ -205,98 +268,40 @@ static inline void xremove (const char *path)
 		error (0, errno, _("can't remove %s"), path);
 }
 
-/* rename() with error checking */
-static inline void xrename (const char *from, const char *to)
+/* Return the names of the files making up the database called BASE. */
+static char **db_file_names (const char *base)
 {
-	if (rename (from, to) == -1 && errno != ENOENT) {
-		error (0, errno, _("can't rename %s to %s"), from, to);
-		xremove (from);
-	}
-}
-
-/* chmod() with error checking */
-static inline void xchmod (const char *path, mode_t mode)
-{
-	if (chmod (path, mode) == -1) {
-		error (0, errno, _("can't chmod %s"), path);
-		xremove (path);
-	}
+	const char * const *suffix;
+	char **names;
+	size_t n = 0;
+
+	for (suffix = mydbm_backend->files; *suffix; ++suffix)
+		++n;
+	names = XNMALLOC (n + 1, char *);
+	for (n = 0, suffix = mydbm_backend->files; *suffix; ++suffix)
+		names[n++] = appendstr (NULL, base, *suffix, NULL);
+	names[n] = NULL;
+
+	return names;
 }
 
-/* CPhipps 2000/02/24 - Copy a file. */
-static int xcopy (const char *from, const char *to)
+static void free_file_names (char **names)
 {
-	FILE *ifp, *ofp;
-	int ret = 0;
-
-	ifp = fopen (from, "r");
-	if (!ifp) {
-		ret = -errno;
-		if (errno == ENOENT)
-			return 0;
-		perror ("fopen");
-		return ret;
-	}
-
-	ofp = fopen (to, "w");
-	if (!ofp) {
-		ret = -errno;
-		perror ("fopen");
-		fclose (ifp);
-		return ret;
-	}
-
-	while (!feof (ifp) && !ferror (ifp)) {
-		char buf[32 * 1024];
-		size_t in = fread (buf, 1, sizeof (buf), ifp);
-		if (in > 0) {
-			if (fwrite (buf, 1, in, ofp) == 0 && ferror (ofp)) {
-				ret = -errno;
-				error (0, errno, _("can't write to %s"), to);
-				break;
-			}
-		} else if (ferror (ifp)) {
-			ret = -errno;
-			error (0, errno, _("can't read from %s"), from);
-			break;
-		}
-	}
-
-	fclose (ifp);
-	fclose (ofp);
-
-	if (ret < 0)
-		xremove (to);
-	else
-		xchmod (to, DBMODE);
+	char **name;
 
-	return ret;
+	if (!names)
+		return;
+	for (name = names; *name; ++name)
+		free (*name);
+	free (names);
 }
 
-/* rename and chmod the database */
+/* publish the new database */
 static inline void finish_up (void)
 {
-#ifdef NDBM
-#  ifdef BERKELEY_DB
-	xrename (tmpdbfile, dbfile);
-	xchmod (dbfile, DBMODE);
-	free (tmpdbfile);
-	tmpdbfile = NULL;
-#  else /* not BERKELEY_DB */
-	xrename (tmpdirfile, dirfile);
-	xchmod (dirfile, DBMODE);
-	xrename (tmppagfile, pagfile);
-	xchmod (pagfile, DBMODE);
-	free (tmpdirfile);
-	free (tmppagfile);
-	tmpdirfile = tmppagfile = NULL;
-#  endif /* BERKELEY_DB */
-#else /* not NDBM */
-	xrename (xtmpfile, xfile);
-	xchmod (xfile, DBMODE);
-	/* xtmpfile == database, so freed elsewhere */
-	xtmpfile = NULL;
-#endif /* NDBM */
+	mydbm_publish (dbname, database);
+	free_file_names (tmpdbfiles);
+	tmpdbfiles = NULL;
 }
 
 #ifdef SECURE_MAN_UID
@@ -309,40 +314,34 @@ static inline void xchown (const char *path, uid_t owner, uid_t group)
 	}
 }
 
-/* change the owner of global man databases */
+/* change the owner of global man databases before they are published */
 static inline void do_chown (uid_t uid)
 {
-#  ifdef NDBM
-#    ifdef BERKELEY_DB
-	xchown (dbfile, uid, -1);
-#    else /* not BERKELEY_DB */
-	xchown (dirfile, uid, -1);
-	xchown (pagfile, uid, -1);
-#    endif /* BERKELEY_DB */
-#  else /* not NDBM */
-	xchown (xfile, uid, -1);
-#  endif /* NDBM */
+	char **name;
+
+	for (name = tmpdbfiles; *name; ++name)
+		xchown (*name, uid, -1);
 }
 #endif /* SECURE_MAN_UID */
 
-/* Update a single file in an existing database. */
-static int update_one_file (const char *manpath, const char *filename)
+/* Update some files in an existing database. */
+static int update_files (const char *manpath, const char *catpath,
+			 const char * const *filenames)
 {
 	dbf = MYDBM_RWOPEN (database);
+	if (dbf && dbver_outdated (dbf)) {
+		/* Pages can only be added to a database with the current
+		 * record format, so rebuild it instead.
+		 */
+		MYDBM_CLOSE (dbf);
+		dbf = NULL;
+		return create_db (manpath, catpath);
+	}
 	if (dbf) {
-		struct mandata info;
-		char *manpage;
-
-		memset (&info, 0, sizeof (struct mandata));
-		manpage = filename_info (filename, &info, "");
-		if (info.name) {
-			dbdelete (info.name, &info);
-			purge_pointers (info.name);
-			free (info.name);
-		}
-		free (manpage);
-
-		test_manfile (filename, manpath);
+		for (; *filenames; ++filenames)
+			update_file (manpath, *filenames);
+		purge_pointers ();
+		dbtrigram_update ();
 	}
 	MYDBM_CLOSE (dbf);
 
@@ -354,8 +353,8 @@ static inline int update_db_wrapper (const char *manpath, const char *catpath)
 {
 	int amount;
 
-	if (single_filename)
-		return update_one_file (manpath, single_filename);
+	if (update_filenames)
+		return update_files (manpath, catpath, update_filenames);
 
 	amount = update_db (manpath, catpath);
 	if (amount != EOF)
@@ -364,52 +363,46 @@ static inline int update_db_wrapper (const char *manpath, const char *catpath)
 	return create_db (manpath, catpath);
 }
 
+/* create the db from scratch, by importing, by merging shards, or by
+   scanning */
+static inline int create_db_wrapper (const char *manpath, const char *catpath)
+{
+	if (import_filename)
+		return import_db (manpath, catpath);
+
+	if (merge_shards) {
+		int amount = merge_db (manpath, catpath);
+		if (amount < 0)
+			return amount;
+		if (amount) {
+			/* pick up any pages not covered by the shards */
+			int ret = update_db (manpath, catpath);
+			if (ret < 0 && ret != EOF)
+				return ret;
+			return ret > 0 ? amount + ret : amount;
+		}
+	}
+
+	return create_db (manpath, catpath);
+}
+
 /* remove incomplete databases */
 static void cleanup_sigsafe (void *dummy ATTRIBUTE_UNUSED)
 {
-#ifdef NDBM
-#  ifdef BERKELEY_DB
-	if (tmpdbfile)
-		unlink (tmpdbfile);
-#  else /* !BERKELEY_DB NDBM */
-	if (tmpdirfile)
-		unlink (tmpdirfile);
-	if (tmppagfile)
-		unlink (tmppagfile);
-#  endif /* BERKELEY_DB NDBM */
-#else /* !NDBM */
-	if (xtmpfile)
-		unlink (xtmpfile);
-#endif /* NDBM */
+	char **name;
+
+	if (tmpdbfiles)
+		for (name = tmpdbfiles; *name; ++name)
+			unlink (*name);
 }
 
 /* remove incomplete databases */
 static void cleanup (void *dummy ATTRIBUTE_UNUSED)
 {
-#ifdef NDBM
-#  ifdef BERKELEY_DB
-	if (tmpdbfile) {
-		free (tmpdbfile);
-		tmpdbfile = NULL;
-	}
-#  else /* !BERKELEY_DB NDBM */
-	if (tmpdirfile) {
-		free (tmpdirfile);
-		tmpdirfile = NULL;
-	}
-	if (tmppagfile) {
-		free (tmppagfile);
-		tmppagfile = NULL;
-	}
-#  endif /* BERKELEY_DB NDBM */
-#else /* !NDBM */
-	if (xtmpfile) {
-		/* xtmpfile == database, so freed elsewhere */
-		xtmpfile = NULL;
-	}
-	free (xfile);
-	xfile = NULL;
-#endif /* NDBM */
+	free_file_names (tmpdbfiles);
+	tmpdbfiles = NULL;
+	free (dbname);
+	dbname = NULL;
 }
 
 /* sort out the database names */
@@ -417,13 +410,32 @@ static int mandb (const char *catpath, const char *manpath)
 {
 	char pid[23];
 	int ret, amount;
-	char *dbname;
+	int rebuild = create || force_rescan || opt_test;
 	char *cachedir_tag;
 	struct stat st;
+	enum stats_phase previous;
 
 	dbname = mkdbname (catpath);
 	sprintf (pid, "%d", getpid ());
 	database = appendstr (NULL, catpath, "/", pid, NULL);
+	tmpdbfiles = db_file_names (database);
+
+	/* Updates work on a private copy of the database. */
+	if (rebuild) {
+		char **name;
+
+		for (name = tmpdbfiles; *name; ++name)
+			xremove (*name);
+	} else {
+		ret = mydbm_copy (dbname, database);
+		if (ret < 0)
+			return ret;
+		if (purge) {
+			previous = stats_enter (STATS_PURGE);
+			purged += purge_missing (manpath, catpath);
+			stats_leave (previous);
+		}
+	}
 	
 	if (!quiet) 
 		printf (_("Processing manual pages under %s...\n"), manpath);
@@ -446,73 +458,163 @@ static int mandb (const char *catpath, const char *manpath)
 	}
 	free (cachedir_tag);
 
-#ifdef NDBM
-#  ifdef BERKELEY_DB
-	dbfile = appendstr (NULL, dbname, ".db", NULL);
-	free (dbname);
-	tmpdbfile = appendstr (NULL, database, ".db", NULL);
-	if (create || force_rescan || opt_test) {
-		xremove (tmpdbfile);
-		ret = create_db (manpath, catpath);
-		if (ret < 0)
-			return ret;
-		amount = ret;
-	} else {
-		ret = xcopy (dbfile, tmpdbfile);
-		if (ret < 0)
-			return ret;
+	previous = stats_enter (STATS_SCAN);
+	if (rebuild)
+		ret = create_db_wrapper (manpath, catpath);
+	else
 		ret = update_db_wrapper (manpath, catpath);
-		if (ret < 0)
-			return ret;
-		amount = ret;
+	stats_leave (previous);
+	if (ret < 0)
+		return ret;
+	amount = ret;
+
+	return amount;
+}
+
+/* What processing each manual hierarchy cost, for --stats. */
+struct manpath_stats {
+	char *manpath;
+	struct stats stats;
+};
+
+static struct manpath_stats *manpath_stats;
+static size_t n_manpath_stats;
+
+static void record_stats (const char *manpath, const struct stats *before)
+{
+	struct manpath_stats *record;
+
+	manpath_stats = xnrealloc (manpath_stats, n_manpath_stats + 1,
+				   sizeof *manpath_stats);
+	record = &manpath_stats[n_manpath_stats++];
+	record->manpath = xstrdup (manpath);
+	stats_get (&record->stats);
+	stats_sub (&record->stats, before);
+}
+
+static double stats_total (const double *times)
+{
+	double total = 0;
+	int i;
+
+	for (i = 0; i < STATS_PHASES; ++i)
+		total += times[i];
+	return total;
+}
+
+static double stats_files_per_sec (const struct stats *stats)
+{
+	double wall = stats_total (stats->wall);
+
+	return wall > 0 ? stats->count[STATS_FILES] / wall : 0;
+}
+
+/* Return the percentage of whatis lookups answered from the cache. */
+static double stats_hit_rate (const struct stats *stats)
+{
+	unsigned long lookups = stats->count[STATS_WHATIS_HITS] +
+				stats->count[STATS_WHATIS_MISSES];
+
+	return lookups ? 100.0 * stats->count[STATS_WHATIS_HITS] / lookups
+		       : 0;
+}
+
+static void print_stats_text (const struct stats *stats)
+{
+	int i;
+
+	printf ("  %-12s %10s %10s\n", _("phase"), _("wall (s)"),
+		_("CPU (s)"));
+	for (i = 0; i < STATS_PHASES; ++i)
+		printf ("  %-12s %10.3f %10.3f\n", stats_phase_name (i),
+			stats->wall[i], stats->cpu[i]);
+	printf ("  %-12s %10.3f %10.3f\n", _("total"),
+		stats_total (stats->wall), stats_total (stats->cpu));
+	printf (_("  files examined: %lu (%.1f per second)\n"),
+		stats->count[STATS_FILES], stats_files_per_sec (stats));
+	printf (_("  whatis cache: %lu hits, %lu misses (%.1f%% hit rate)\n"),
+		stats->count[STATS_WHATIS_HITS],
+		stats->count[STATS_WHATIS_MISSES], stats_hit_rate (stats));
+	printf (_("  pipelines started: %lu\n"),
+		stats->count[STATS_PIPELINES]);
+	printf (_("  bytes decompressed: %lu\n"),
+		stats->count[STATS_BYTES_DECOMPRESSED]);
+	printf (_("  database fetches: %lu, stores: %lu\n"),
+		stats->count[STATS_DB_FETCHES], stats->count[STATS_DB_STORES]);
+}
+
+static void print_json_string (const char *str)
+{
+	putchar ('"');
+	for (; *str; ++str) {
+		unsigned char c = (unsigned char) *str;
+
+		if (c == '"' || c == '\\')
+			printf ("\\%c", c);
+		else if (c < 0x20)
+			printf ("\\u%04x", c);
+		else
+			putchar (c);
 	}
-#  else /* !BERKELEY_DB NDBM */
-	dirfile = appendstr (NULL, dbname, ".dir", NULL);
-	pagfile = appendstr (NULL, dbname, ".pag", NULL);
-	free (dbname);
-	tmpdirfile = appendstr (NULL, database, ".dir", NULL);
-	tmppagfile = appendstr (NULL, database, ".pag", NULL);
-	if (create || force_rescan || opt_test) {
-		xremove (tmpdirfile);
-		xremove (tmppagfile);
-		ret = create_db (manpath, catpath);
-		if (ret < 0)
-			return ret;
-		amount = ret;
-	} else {
-		ret = xcopy (dirfile, tmpdirfile);
-		if (ret < 0)
-			return ret;
-		ret = xcopy (pagfile, tmppagfile);
-		if (ret < 0)
-			return ret;
-		ret = update_db_wrapper (manpath, catpath);
-		if (ret < 0)
-			return ret;
-		amount = ret;
-	}
-#  endif /* BERKELEY_DB NDBM */
-#else /* !NDBM */
-	xfile = dbname; /* steal memory */
-	xtmpfile = database;
-	if (create || force_rescan || opt_test) {
-		xremove (xtmpfile);
-		ret = create_db (manpath, catpath);
-		if (ret < 0)
-			return ret;
-		amount = ret;
+	putchar ('"');
+}
+
+static void print_stats_json (const struct stats *stats, const char *indent)
+{
+	int i;
+
+	printf ("%s\"wall\": %.6f,\n", indent, stats_total (stats->wall));
+	printf ("%s\"cpu\": %.6f,\n", indent, stats_total (stats->cpu));
+	printf ("%s\"files_per_sec\": %.3f,\n", indent,
+		stats_files_per_sec (stats));
+	printf ("%s\"whatis_hit_rate\": %.3f,\n", indent,
+		stats_hit_rate (stats));
+	printf ("%s\"phases\": {\n", indent);
+	for (i = 0; i < STATS_PHASES; ++i)
+		printf ("%s  \"%s\": { \"wall\": %.6f, \"cpu\": %.6f }%s\n",
+			indent, stats_phase_name (i), stats->wall[i],
+			stats->cpu[i], i + 1 < STATS_PHASES ? "," : "");
+	printf ("%s},\n", indent);
+	printf ("%s\"counters\": {\n", indent);
+	for (i = 0; i < STATS_COUNTERS; ++i)
+		printf ("%s  \"%s\": %lu%s\n", indent, stats_counter_name (i),
+			stats->count[i], i + 1 < STATS_COUNTERS ? "," : "");
+	printf ("%s}\n", indent);
+}
+
+/* Report what each hierarchy, and the whole run, cost. */
+static void print_stats (const struct stats *total)
+{
+	size_t i;
+
+	if (stats_json) {
+		printf ("{\n  \"manpaths\": [\n");
+		for (i = 0; i < n_manpath_stats; ++i) {
+			printf ("    {\n      \"manpath\": ");
+			print_json_string (manpath_stats[i].manpath);
+			printf (",\n");
+			print_stats_json (&manpath_stats[i].stats, "      ");
+			printf ("    }%s\n",
+				i + 1 < n_manpath_stats ? "," : "");
+		}
+		printf ("  ],\n  \"total\": {\n");
+		print_stats_json (total, "    ");
+		printf ("  }\n}\n");
 	} else {
-		ret = xcopy (xfile, xtmpfile);
-		if (ret < 0)
-			return ret;
-		ret = update_db_wrapper (manpath, catpath);
-		if (ret < 0)
-			return ret;
-		amount = ret;
+		for (i = 0; i < n_manpath_stats; ++i) {
+			printf (_("Statistics for %s:\n"),
+				manpath_stats[i].manpath);
+			print_stats_text (&manpath_stats[i].stats);
+		}
+		printf (_("Total statistics:\n"));
+		print_stats_text (total);
 	}
-#endif /* NDBM */
 
-	return amount;
+	for (i = 0; i < n_manpath_stats; ++i)
+		free (manpath_stats[i].manpath);
+	free (manpath_stats);
+	manpath_stats = NULL;
+	n_manpath_stats = 0;
 }
 
 static int process_manpath (const char *manpath, int global_manpath,
@@ -522,6 +624,8 @@ static int process_manpath (const char *manpath, int global_manpath,
 	struct tried_catdirs_entry *tried;
 	struct stat st;
 	int amount = 0;
+	int old_purged = purged;
+	struct stats before;
 
 	if (global_manpath) { 	/* system db */
 		catpath = get_catpath (manpath, SYSTEM_CAT);
@@ -540,13 +644,10 @@ static int process_manpath (const char *manpath, int global_manpath,
 		return 0;
 	tried->seen = 1;
 
+	if (want_stats)
+		stats_get (&before);
+
 	force_rescan = 0;
-	if (purge) {
-		database = mkdbname (catpath);
-		purged += purge_missing (manpath, catpath);
-		free (database);
-		database = NULL;
-	}
 
 	push_cleanup (cleanup, NULL, 0);
 	push_cleanup (cleanup_sigsafe, NULL, 1);
@@ -575,15 +676,33 @@ static int process_manpath (const char *manpath, int global_manpath,
 		amount += ret;
 	}
 
-	if (!opt_test && amount) {
-		finish_up ();
+	if (check_for_strays && amount > 0) {
+		enum stats_phase previous = stats_enter (STATS_STRAYCATS);
+		strays += straycats (manpath);
+		stats_leave (previous);
+	}
+
+	/* Published databases are never modified in place, so purging
+	 * stale entries also calls for a new generation.
+	 */
+	if (!opt_test && (amount || purged > old_purged)) {
 #ifdef SECURE_MAN_UID
 		if (global_manpath && euid == 0)
 			do_chown (man_owner->pw_uid);
 #endif /* SECURE_MAN_UID */
+		finish_up ();
 	}
 
 out:
+	/* Only report on directories that turned out to be hierarchies. */
+	if (want_stats && dbname) {
+		char **names = db_file_names (dbname);
+
+		if (stat (names[0], &st) == 0)
+			record_stats (manpath, &before);
+		free_file_names (names);
+	}
+
 	cleanup_sigsafe (NULL);
 	pop_cleanup ();
 	cleanup (NULL);
@@ -591,13 +710,6 @@ out:
 	free (database);
 	database = NULL;
 
-	if (check_for_strays && amount > 0) {
-		database = mkdbname (catpath);
-		strays += straycats (manpath);
-		free (database);
-		database = NULL;
-	}
-
 	free (catpath);
 
 	return amount;
@@ -734,6 +846,403 @@ void purge_catdirs (const struct hashtable *tried_catdirs)
 	}
 }
 
+/* Is NAME, in an element of the manpath, a per-locale hierarchy? */
+static int is_locale_subdir (const char *name)
+{
+	return !STREQ (name, ".") && !STREQ (name, "..") &&
+	       !STRNEQ (name, "man", 3);
+}
+
+#ifdef HAVE_SYS_INOTIFY_H
+
+/* How long a burst of changes must have been quiet before we act on it. */
+#define WATCH_SETTLE	1000	/* milliseconds */
+
+#define WATCH_EVENTS	(IN_CREATE | IN_CLOSE_WRITE | IN_ATTRIB | \
+			 IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE | IN_ONLYDIR)
+
+enum watch_type {
+	WATCH_ROOT,		/* hierarchy root: look for new subdirs */
+	WATCH_MAN,		/* manN: update pages individually */
+	WATCH_CAT		/* catN: look for stray cats */
+};
+
+struct watched_dir {
+	char *dir;		/* NULL if no longer watched */
+	char *manpath;		/* the hierarchy it belongs to */
+	int global_manpath;
+	enum watch_type type;
+	int locales;		/* look for new per-locale hierarchies */
+};
+
+struct pending_manpath {
+	int global_manpath;
+	int rescan;		/* check everything, not just files */
+	struct hashtable *files;
+};
+
+static int watch_fd = -1;
+static struct watched_dir *watched;	/* indexed by watch descriptor */
+static size_t n_watched;
+static struct hashtable *pending;	/* manpath -> pending_manpath */
+
+static void pending_manpath_free (void *defn)
+{
+	struct pending_manpath *pm = defn;
+
+	hashtable_free (pm->files);
+	free (pm);
+}
+
+/* Note that FILE (or, if it is NULL, the whole of MANPATH) needs to be
+ * checked.
+ */
+static void pending_add (const char *manpath, int global_manpath,
+			 const char *file)
+{
+	struct pending_manpath *pm;
+
+	pm = hashtable_lookup (pending, manpath, strlen (manpath));
+	if (!pm) {
+		pm = XMALLOC (struct pending_manpath);
+		pm->global_manpath = global_manpath;
+		pm->rescan = 0;
+		pm->files = hashtable_create (&null_hashtable_free);
+		hashtable_install (pending, manpath, strlen (manpath), pm);
+	}
+
+	if (file) {
+		if (!hashtable_lookup_structure (pm->files, file,
+						 strlen (file))) {
+			debug ("pending update: %s\n", file);
+			hashtable_install (pm->files, file, strlen (file),
+					   NULL);
+		}
+	} else
+		pm->rescan = 1;
+}
+
+/* Watch DIR, returning the watch descriptor or -1 on failure. */
+static int add_watch (const char *dir, const char *manpath,
+		      int global_manpath, enum watch_type type)
+{
+	int wd;
+
+	wd = inotify_add_watch (watch_fd, dir, WATCH_EVENTS);
+	if (wd < 0) {
+		error (0, errno, _("can't watch %s for changes"), dir);
+		return -1;
+	}
+
+	if ((size_t) wd >= n_watched) {
+		size_t old = n_watched;
+
+		n_watched = wd + 1;
+		watched = xnrealloc (watched, n_watched, sizeof *watched);
+		memset (watched + old, 0, (n_watched - old) * sizeof *watched);
+	} else if (watched[wd].dir)
+		return wd;	/* already watched */
+
+	debug ("watching %s\n", dir);
+	watched[wd].dir = xstrdup (dir);
+	watched[wd].manpath = xstrdup (manpath);
+	watched[wd].global_manpath = global_manpath;
+	watched[wd].type = type;
+	watched[wd].locales = 0;
+	return wd;
+}
+
+/* Return the kind of watch needed for NAME under a hierarchy root, or
+ * WATCH_ROOT if it isn't worth watching.
+ */
+static enum watch_type subdir_watch_type (const char *name)
+{
+	if (STRNEQ (name, "man", 3))
+		return WATCH_MAN;
+	else if (STRNEQ (name, "cat", 3) && check_for_strays)
+		return WATCH_CAT;
+	else
+		return WATCH_ROOT;
+}
+
+/* Watch the man and cat subdirectories of DIR.  If NEW, they may already
+ * have some contents that we haven't seen yet.
+ */
+static void watch_subdirs (const char *dir, const char *manpath,
+			   int global_manpath, int new)
+{
+	DIR *dirp;
+	struct dirent *entry;
+
+	dirp = opendir (dir);
+	if (!dirp)
+		return;
+
+	while ((entry = readdir (dirp)) != NULL) {
+		enum watch_type type = subdir_watch_type (entry->d_name);
+		char *path;
+
+		if (type == WATCH_ROOT)
+			continue;
+		path = appendstr (NULL, dir, "/", entry->d_name, NULL);
+		if (is_directory (path) == 1) {
+			add_watch (path, manpath, global_manpath, type);
+			if (new)
+				pending_add (manpath, global_manpath, NULL);
+		}
+		free (path);
+	}
+
+	closedir (dirp);
+}
+
+/* Start watching the hierarchy MANPATH, and its cat directories if they
+ * are elsewhere.  If LOCALES, MANPATH is an element of the manpath, which
+ * may gain per-locale hierarchies.
+ */
+static void watch_manpath (const char *manpath, int global_manpath,
+			   int locales)
+{
+	char *catpath;
+	int wd;
+
+	if (is_directory (manpath) != 1)
+		return;
+
+	wd = add_watch (manpath, manpath, global_manpath, WATCH_ROOT);
+	if (wd >= 0 && locales)
+		watched[wd].locales = 1;
+	watch_subdirs (manpath, manpath, global_manpath, 0);
+
+	if (!check_for_strays)
+		return;
+	catpath = get_catpath (manpath,
+			       global_manpath ? SYSTEM_CAT : USER_CAT);
+	if (catpath && !STREQ (catpath, manpath) &&
+	    is_directory (catpath) == 1) {
+		add_watch (catpath, manpath, global_manpath, WATCH_ROOT);
+		watch_subdirs (catpath, manpath, global_manpath, 0);
+	}
+	free (catpath);
+}
+
+static void handle_event (const struct inotify_event *event)
+{
+	struct watched_dir *w;
+	char *path;
+
+	if (event->mask & IN_Q_OVERFLOW) {
+		size_t i;
+
+		/* We've lost track, so check everything. */
+		debug ("inotify queue overflowed\n");
+		for (i = 0; i < n_watched; ++i)
+			if (watched[i].dir && watched[i].type == WATCH_ROOT)
+				pending_add (watched[i].manpath,
+					     watched[i].global_manpath, NULL);
+		return;
+	}
+
+	if (event->wd < 0 || (size_t) event->wd >= n_watched)
+		return;
+	w = &watched[event->wd];
+	if (!w->dir)
+		return;
+
+	if (event->mask & IN_IGNORED) {
+		/* The directory went away. */
+		debug ("no longer watching %s\n", w->dir);
+		free (w->dir);
+		w->dir = NULL;
+		free (w->manpath);
+		w->manpath = NULL;
+		return;
+	}
+
+	if (!event->len)
+		return;
+
+	if (event->mask & IN_ISDIR) {
+		char *manpath;
+		int global_manpath = w->global_manpath;
+		enum watch_type type;
+
+		if (w->type != WATCH_ROOT ||
+		    !(event->mask & (IN_CREATE | IN_MOVED_TO)))
+			return;
+		type = subdir_watch_type (event->name);
+		path = appendstr (NULL, w->dir, "/", event->name, NULL);
+		if (type == WATCH_ROOT) {
+			/* Process a new per-locale hierarchy as main()
+			 * would have done at startup.
+			 */
+			if (w->locales && is_locale_subdir (event->name)) {
+				watch_manpath (path, global_manpath, 0);
+				pending_add (path, global_manpath, NULL);
+			}
+			free (path);
+			return;
+		}
+
+		/* add_watch may move w */
+		manpath = xstrdup (w->manpath);
+		add_watch (path, manpath, global_manpath, type);
+		pending_add (manpath, global_manpath, NULL);
+		free (path);
+		free (manpath);
+		return;
+	}
+
+	switch (w->type) {
+		case WATCH_ROOT:
+			break;
+		case WATCH_MAN:
+			path = appendstr (NULL, w->dir, "/", event->name,
+					  NULL);
+			pending_add (w->manpath, w->global_manpath, path);
+			free (path);
+			break;
+		case WATCH_CAT:
+			pending_add (w->manpath, w->global_manpath, NULL);
+			break;
+	}
+}
+
+static void read_events (void)
+{
+	union {
+		struct inotify_event event;
+		char buf[4096];
+	} events;
+	ssize_t len;
+	char *p;
+
+	len = read (watch_fd, &events, sizeof events);
+	if (len < 0) {
+		if (errno == EINTR || errno == EAGAIN)
+			return;
+		error (FATAL, errno, _("can't read changes"));
+	}
+
+	for (p = events.buf; p < events.buf + len; ) {
+		const struct inotify_event *event =
+			(const struct inotify_event *) p;
+
+		handle_event (event);
+		p += sizeof (struct inotify_event) + event->len;
+	}
+}
+
+/* Update the database for MANPATH: just FILENAMES if non-NULL, otherwise
+ * everything.
+ */
+static void update_pending (const char *manpath, int global_manpath,
+			    const char **filenames)
+{
+	struct hashtable *tried_catdirs;
+
+	update_filenames = filenames;
+	if (!global_manpath)
+		drop_effective_privs ();
+	tried_catdirs = hashtable_create (&tried_catdirs_free);
+	if (process_manpath (manpath, global_manpath, tried_catdirs) < 0)
+		error (0, 0, _("can't update the database for %s"), manpath);
+	hashtable_free (tried_catdirs);
+	if (!global_manpath)
+		regain_effective_privs ();
+	update_filenames = NULL;
+}
+
+/* Bring the databases up to date with everything that has changed. */
+static void flush_pending (void)
+{
+	int saved_purge = purge, saved_strays = check_for_strays;
+	struct hashtable_iter *iter = NULL;
+	const struct nlist *elt;
+
+	while ((elt = hashtable_iterate (pending, &iter)) != NULL) {
+		struct pending_manpath *pm = elt->defn;
+		struct hashtable_iter *file_iter = NULL;
+		const struct nlist *file;
+		const char **filenames;
+		size_t n = 0;
+
+		while (hashtable_iterate (pm->files, &file_iter))
+			++n;
+		if (n) {
+			filenames = XNMALLOC (n + 1, const char *);
+			n = 0;
+			while ((file = hashtable_iterate (pm->files,
+							  &file_iter)) != NULL)
+				filenames[n++] = file->name;
+			filenames[n] = NULL;
+
+			purge = check_for_strays = 0;
+			update_pending (elt->name, pm->global_manpath,
+					filenames);
+			free (filenames);
+		}
+
+		/* A full check is only needed for stray cats or new
+		 * directories, or if we lost track of what changed.  It
+		 * relies on modification times, so the files we know about
+		 * were dealt with individually above.
+		 */
+		if (pm->rescan) {
+			purge = saved_purge;
+			check_for_strays = saved_strays;
+			update_pending (elt->name, pm->global_manpath, NULL);
+		}
+	}
+
+	purge = saved_purge;
+	check_for_strays = saved_strays;
+	hashtable_free (pending);
+	pending = hashtable_create (&pending_manpath_free);
+}
+
+static void start_watching (void)
+{
+	watch_fd = inotify_init ();
+	if (watch_fd < 0)
+		error (FATAL, errno, _("can't watch for changes"));
+	pending = hashtable_create (&pending_manpath_free);
+}
+
+/* Wait for changes, and apply each burst of them as it settles. */
+static void watch_for_changes (void)
+{
+	struct pollfd pfd;
+
+	pfd.fd = watch_fd;
+	pfd.events = POLLIN;
+
+	for (;;) {
+		/* Changes made while the last batch was being processed
+		 * are already waiting.
+		 */
+		if (poll (&pfd, 1, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			error (FATAL, errno, _("can't watch for changes"));
+		}
+		read_events ();
+
+		for (;;) {
+			int ret = poll (&pfd, 1, WATCH_SETTLE);
+			if (ret > 0)
+				read_events ();
+			else if (ret == 0 || errno != EINTR)
+				break;
+		}
+
+		flush_pending ();
+		fflush (stdout);
+	}
+}
+
+#endif /* HAVE_SYS_INOTIFY_H */
+
 int main (int argc, char *argv[])
 {
 	char *sys_manp;
@@ -770,6 +1279,9 @@ int main (int argc, char *argv[])
 	if (argp_parse (&argp, argc, argv, 0, 0, 0))
 		exit (FAIL);
 
+	if (want_stats)
+		stats_start ();
+
 #ifdef __profile__
 	cwd = xgetcwd ();
 	if (!cwd) {
@@ -791,9 +1303,18 @@ int main (int argc, char *argv[])
 		       MAN_OWNER);
 	if (!user && euid != 0 && euid != man_owner->pw_uid)
 		user = 1;
+	/* Imported records and shards are taken on trust, so don't let
+	 * just anyone put them into the system databases.
+	 */
+	if ((import_filename || merge_shards) && !user &&
+	    running_setuid () && ruid != 0)
+		error (FAIL, 0,
+		       _("only root may use --import or --merge-shards on "
+			 "the system databases"));
 #endif /* SECURE_MAN_UID */
 
 	read_config_file (user);
+	mydbm_select_backend (db_backend);
 
 	/* This is required for get_catpath(), regardless */
 	manp = get_manpath (NULL);	/* also calls read_config_file() */
@@ -819,11 +1340,23 @@ int main (int argc, char *argv[])
 	/* get the manpath as an array of pointers */
 	create_pathlist (manp, manpathlist); 
 
+	/* read the import file with the invoking user's privileges */
+	if (import_filename)
+		import_read (import_filename);
+
 	/* finished manpath processing, regain privs */
 	regain_effective_privs ();
 
 	tried_catdirs = hashtable_create (tried_catdirs_free);
 
+#ifdef HAVE_SYS_INOTIFY_H
+	/* Start watching before the first pass, so that nothing changed
+	 * during it is missed.
+	 */
+	if (watch)
+		start_watching ();
+#endif /* HAVE_SYS_INOTIFY_H */
+
 	for (mp = manpathlist; *mp; mp++) {
 		int global_manpath = is_global_mandir (*mp);
 		int ret;
@@ -837,6 +1370,10 @@ int main (int argc, char *argv[])
 			drop_effective_privs ();
 		}
 
+#ifdef HAVE_SYS_INOTIFY_H
+		if (watch)
+			watch_manpath (*mp, global_manpath, 1);
+#endif /* HAVE_SYS_INOTIFY_H */
 		ret = process_manpath (*mp, global_manpath, tried_catdirs);
 		if (ret < 0)
 			exit (FATAL);
@@ -852,14 +1389,15 @@ int main (int argc, char *argv[])
 			char *subdirpath;
 
 			/* Look for per-locale subdirectories. */
-			if (STREQ (subdirent->d_name, ".") ||
-			    STREQ (subdirent->d_name, ".."))
-				continue;
-			if (STRNEQ (subdirent->d_name, "man", 3))
+			if (!is_locale_subdir (subdirent->d_name))
 				continue;
 
 			subdirpath = appendstr (NULL, *mp, "/",
 						subdirent->d_name, NULL);
+#ifdef HAVE_SYS_INOTIFY_H
+			if (watch)
+				watch_manpath (subdirpath, global_manpath, 0);
+#endif /* HAVE_SYS_INOTIFY_H */
 			ret = process_manpath (subdirpath, global_manpath,
 					       tried_catdirs);
 			if (ret < 0)
@@ -880,6 +1418,9 @@ next_manpath:
 	purge_catdirs (tried_catdirs);
 	hashtable_free (tried_catdirs);
 
+	if (import_filename)
+		import_free ();
+
 	if (!quiet) {
 		printf (ngettext ("%d man subdirectory contained newer "
 				  "manual pages.\n",
@@ -902,12 +1443,28 @@ next_manpath:
 				purged);
 	}
 
+	if (want_stats) {
+		struct stats total;
+
+		stats_get (&total);
+		print_stats (&total);
+		/* Changes handled by --watch are not reported. */
+		want_stats = 0;
+	}
+
 #ifdef __profile__
 	/* For profiling */
 	if (cwd[0])
 		chdir (cwd);
 #endif /* __profile__ */
 
+#ifdef HAVE_SYS_INOTIFY_H
+	if (watch) {
+		fflush (stdout);
+		watch_for_changes ();
+	}
+#endif /* HAVE_SYS_INOTIFY_H */
+
 	free_pathlist (manpathlist);
 	free (manp);
 	if (create && !amount) {
@@ -100,6 +100,7 @@ static char *tmplist[MAXDIRS];
 char *user_config_file = NULL;
 int disable_cache;
 int min_cat_width = 80, max_cat_width = 80, cat_width = 0;
+char *db_backend = NULL;
 
 static inline char *has_mandir (const char *p);
 static inline char *fsstnd (const char *path);
@@ -806,6 +807,11 @@ static void add_to_dirlist (FILE *config, int user)
 			max_cat_width = val;
 		else if (sscanf (bp, "CATWIDTH %d", &val) == 1)
 			cat_width = val;
+		else if (sscanf (bp, "DB_BACKEND %49s", key) == 1) {
+			/* The user's configuration is read first. */
+			if (!db_backend)
+				db_backend = xstrdup (key);
+		}
 	 	else {
 			error (0, 0, _("can't parse directory list `%s'"), bp);
 			gripe_reading_mp_config (CONFIG_FILE);
@@ -830,6 +836,9 @@ static void free_config_file (void *unused ATTRIBUTE_UNUSED)
 	}
 
 	namestore = tailstore = NULL;
+
+	free (db_backend);
+	db_backend = NULL;
 }
 
 void read_config_file (int optional)
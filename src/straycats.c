@@ -65,12 +65,14 @@
 #include "decompress.h"
 #include "encodings.h"
 #include "security.h"
+#include "stats.h"
 
 #include "mydbm.h"
 #include "db_storage.h"
 
 #include "descriptions.h"
 #include "manp.h"
+#include "col.h"
 #include "manconv_client.h"
 #include "ult_src.h"
 
@@ -224,14 +226,20 @@ static int check_for_stray (void)
 			free (page_encoding);
 			free (lang);
 
-			col_cmd = pipecmd_new_argstr
-				(get_def_user ("col", COL));
-			pipecmd_arg (col_cmd, "-bx");
-			col_locale = find_charset_locale ("UTF-8");
-			if (col_locale) {
-				pipecmd_setenv (col_cmd, "LC_CTYPE",
-						col_locale);
-				free (col_locale);
+			if (get_def_user ("col", NULL))
+				col_cmd = NULL;
+			else
+				col_cmd = col_filter_new ("UTF-8", 0);
+			if (!col_cmd) {
+				col_cmd = pipecmd_new_argstr
+					(get_def_user ("col", COL));
+				pipecmd_arg (col_cmd, "-bx");
+				col_locale = find_charset_locale ("UTF-8");
+				if (col_locale) {
+					pipecmd_setenv (col_cmd, "LC_CTYPE",
+							col_locale);
+					free (col_locale);
+				}
 			}
 			pipeline_command (decomp, col_cmd);
 
@@ -249,6 +257,7 @@ static int check_for_stray (void)
 				char *catdir_base;
 
 				free (fullpath);
+				STATS_ADD (STATS_PIPELINES, 1);
 				drop_effective_privs ();
 				pipeline_start (decomp);
 				regain_effective_privs ();
@@ -375,6 +384,8 @@ int straycats (const char *manpath)
 	if (catpath)
 		free (catpath);
 
+	if (strays)
+		dbtrigram_update ();
 	MYDBM_CLOSE (dbf);
 	return strays;
 }
@@ -47,6 +47,7 @@ EOF
 		Z)	compress -c ;;
 		bz2)	bzip2 -9c ;;
 		lzma)	lzma -9c ;;
+		zst)	zstd -19cq ;;
 	esac <"$3.tmp2" >"$3"
 	rm -f "$3.tmp1" "$3.tmp2"
 }
@@ -68,9 +68,58 @@
 #include "error.h"
 #include "pipeline.h"
 #include "decompress.h"
+#include "hashtable.h"
+#include "stats.h"
 
 #include "ult_src.h"
 
+/* The smallest name for each inode in one directory, recorded by a caller
+ * that reads the whole directory anyway, so that ult_hardlink() need not
+ * read it again for every hard link it finds there.
+ */
+static char *hardlink_dir;
+static struct hashtable *hardlink_names;
+
+static void hardlink_key (ino_t inode, char *key)
+{
+	sprintf (key, "%llu", (unsigned long long) inode);
+}
+
+/* Start recording the entries of DIR, forgetting any previous directory. */
+void ult_hardlinks_begin (const char *dir)
+{
+	ult_hardlinks_end ();
+	hardlink_dir = xstrdup (dir);
+	hardlink_names = hashtable_create (&plain_hashtable_free);
+}
+
+/* Record that NAME, in the directory passed to ult_hardlinks_begin(), has
+ * inode number INODE.
+ */
+void ult_hardlinks_add (ino_t inode, const char *name)
+{
+	char key[32];
+	const char *smallest;
+
+	if (!hardlink_names)
+		return;
+	hardlink_key (inode, key);
+	smallest = hashtable_lookup (hardlink_names, key, strlen (key));
+	if (!smallest || strcmp (name, smallest) < 0)
+		hashtable_install (hardlink_names, key, strlen (key),
+				   xstrdup (name));
+}
+
+void ult_hardlinks_end (void)
+{
+	if (hardlink_names) {
+		hashtable_free (hardlink_names);
+		hardlink_names = NULL;
+	}
+	free (hardlink_dir);
+	hardlink_dir = NULL;
+}
+
 /* Find minimum value hard link filename for given file and inode.
  * Returns a newly allocated string.
  */
@@ -86,6 +135,21 @@ static char *ult_hardlink (const char *fullpath, ino_t inode)
 	dir = xstrndup (fullpath, slash - fullpath);
 	base = xstrdup (++slash);
 
+	if (hardlink_dir && STREQ (dir, hardlink_dir)) {
+		char key[32];
+		const char *smallest;
+
+		hardlink_key (inode, key);
+		smallest = hashtable_lookup (hardlink_names, key,
+					     strlen (key));
+		if (smallest && strcmp (base, smallest) > 0) {
+			free (base);
+			base = xstrdup (smallest);
+			debug ("ult_hardlink: (%s)\n", base);
+		}
+		goto found;
+	}
+
 	mdir = opendir (dir);
 	if (mdir == NULL) {
 		if (quiet < 2)
@@ -105,6 +169,7 @@ static char *ult_hardlink (const char *fullpath, ino_t inode)
 	}
 	closedir (mdir);
 
+found:
 	/* If we already are the link with the smallest name value */
 	/* return NULL */
 
@@ -324,6 +389,8 @@ const char *ult_src (const char *name, const char *path,
 			free (decomp_base);
 			return NULL;
 		}
+		if (pipeline_get_ncommands (decomp))
+			STATS_ADD (STATS_PIPELINES, 1);
 		pipeline_start (decomp);
 
 		/* make sure that we skip over any comments */
@@ -41,3 +41,6 @@ extern const char *ult_src (const char *name, const char *path,
 			    struct stat *buf, int flags,
 			    struct ult_trace *trace);
 extern void free_ult_trace (struct ult_trace *trace);
+extern void ult_hardlinks_begin (const char *dir);
+extern void ult_hardlinks_add (ino_t inode, const char *name);
+extern void ult_hardlinks_end (void);
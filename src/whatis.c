@@ -42,9 +42,7 @@
 #include <unistd.h>
 
 #include "gettext.h"
-#include <locale.h>
 #define _(String) gettext (String)
-#define N_(String) gettext_noop (String)
 
 #ifdef HAVE_ICONV
 #  include <iconv.h>
@@ -54,14 +52,12 @@
 #include <sys/stat.h>
 #include "regex.h"
 
-#include "argp.h"
 #include "dirname.h"
 #include "fnmatch.h"
 #include "xvasprintf.h"
 
 #include "manconfig.h"
 
-#include "cleanup.h"
 #include "error.h"
 #include "pipeline.h"
 #include "pathsearch.h"
@@ -76,21 +72,12 @@
 #include "db_storage.h"
 
 #include "manp.h"
+#include "whatis.h"
 
-static char *manpathlist[MAXDIRS];
-
-extern char *user_config_file;
-static char **keywords;
-static int num_keywords;
-
-char *program_name;
-int am_apropos;
-char *database;
-MYDBM_FILE dbf;
-int quiet = 1;
+static int am_apropos;
 
 #ifdef HAVE_ICONV
-iconv_t conv_to_locale;
+static iconv_t conv_to_locale;
 #endif /* HAVE_ICONV */
 
 static regex_t *preg;  
@@ -103,44 +90,21 @@ static int require_all;
 
 static int long_output;
 
-static char **sections;
+static char * const *sections;
 
-static char *manp = NULL;
-static const char *alt_systems = "";
-static const char *locale = NULL;
-static char *multiple_locale = NULL, *internal_locale;
+static const char *multiple_locale, *internal_locale;
 
 static struct hashtable *apropos_seen = NULL;
 static struct hashtable *display_seen = NULL;
 
-const char *argp_program_version; /* initialised in main */
-const char *argp_program_bug_address = PACKAGE_BUGREPORT;
-error_t argp_err_exit_status = FAIL;
-
-static const char args_doc[] = N_("KEYWORD...");
-static const char apropos_doc[] = "\v" N_("The --regex option is enabled by default.");
-
-static struct argp_option options[] = {
-	{ "debug",		'd',	0,		0,	N_("emit debugging messages") },
-	{ "verbose",		'v',	0,		0,	N_("print verbose warning messages") },
-	{ "regex",		'r',	0,		0,	N_("interpret each keyword as a regex"),	10 },
-	{ "exact",		'e',	0,		0,	N_("search each keyword for exact match") }, /* apropos only */
-	{ "wildcard",		'w',	0,		0,	N_("the keyword(s) contain wildcards") },
-	{ "and",		'a',	0,		0,	N_("require all keywords to match"),			20 }, /* apropos only */
-	{ "long",		'l',	0,		0,	N_("do not trim output to terminal width"),		30 },
-	{ "sections",		's',	N_("LIST"),	0,	N_("search only these sections (colon-separated)"),	40 },
-	{ "section",		0,	0,		OPTION_ALIAS },
-	{ "systems",		'm',	N_("SYSTEM"),	0,	N_("use manual pages from other systems") },
-	{ "manpath",		'M',	N_("PATH"),	0,	N_("set search path for manual pages to PATH") },
-	{ "locale",		'L',	N_("LOCALE"),	0,	N_("define the locale for this search") },
-	{ "config-file",	'C',	N_("FILE"),	0,	N_("use this user configuration file") },
-	{ "whatis",		'f',	0,		OPTION_HIDDEN,	0 },
-	{ "apropos",		'k',	0,		OPTION_HIDDEN,	0 },
-	{ 0, 'h', 0, OPTION_HIDDEN, 0 }, /* compatibility for --help */
-	{ 0 }
-};
-
-static char **split_sections (const char *sections_str)
+/* Per-database caches of lookup results, so that each name or pointer is
+ * fetched at most once however many times it is asked for.  Entries may
+ * be NULL to record that a lookup failed.
+ */
+static struct hashtable *lookup_cache = NULL;
+static struct hashtable *pointer_cache = NULL;
+
+char **whatis_split_sections (const char *sections_str)
 {
 	int i = 0;
 	char *str = xstrdup (sections_str);
@@ -163,85 +127,6 @@ static char **split_sections (const char *sections_str)
 	return out;
 }
 
-static error_t parse_opt (int key, char *arg, struct argp_state *state)
-{
-	switch (key) {
-		case 'd':
-			debug_level = 1;
-			return 0;
-		case 'v':
-			quiet = 0;
-			return 0;
-		case 'r':
-			regex_opt = 1;
-			return 0;
-		case 'e':
-			/* Only makes sense for apropos, but has
-			 * historically been accepted by whatis anyway.
-			 */
-			regex_opt = 0;
-			exact = 1;
-			return 0;
-		case 'w':
-			regex_opt = 0;
-			wildcard = 1;
-			return 0;
-		case 'a':
-			if (am_apropos)
-				require_all = 1;
-			else
-				argp_usage (state);
-			return 0;
-		case 'l':
-			long_output = 1;
-			return 0;
-		case 's':
-			sections = split_sections (arg);
-			return 0;
-		case 'm':
-			alt_systems = arg;
-			return 0;
-		case 'M':
-			manp = xstrdup (arg);
-			return 0;
-		case 'L':
-			locale = arg;
-			return 0;
-		case 'C':
-			user_config_file = arg;
-			return 0;
-		case 'f':
-			/* helpful override if program name detection fails */
-			am_apropos = 0;
-			return 0;
-		case 'k':
-			/* helpful override if program name detection fails */
-			am_apropos = 1;
-			return 0;
-		case 'h':
-			argp_state_help (state, state->out_stream,
-					 ARGP_HELP_STD_HELP &
-					 ~ARGP_HELP_PRE_DOC);
-			break;
-		case ARGP_KEY_ARGS:
-			keywords = state->argv + state->next;
-			num_keywords = state->argc - state->next;
-			return 0;
-		case ARGP_KEY_NO_ARGS:
-			/* Make sure that we have a keyword! */
-			printf (_("%s what?\n"), program_name);
-			exit (FAIL);
-		case ARGP_KEY_SUCCESS:
-			if (am_apropos && !exact && !wildcard)
-				regex_opt = 1;
-			return 0;
-	}
-	return ARGP_ERR_UNKNOWN;
-}
-
-static struct argp apropos_argp = { options, parse_opt, args_doc, apropos_doc };
-static struct argp whatis_argp = { options, parse_opt, args_doc };
-
 static char *locale_manpath (char *manpath)
 {
 	char *all_locales;
@@ -356,6 +241,50 @@ static void use_grep (const char * const *pages, int num_pages, char *manpath,
 	free (whatis_file);
 }
 
+static void mandata_hashtable_free (void *defn)
+{
+	free_mandata_struct (defn);
+}
+
+/* Return the cached result of dblookup_exact (page, ext, 1).  The caller
+ * must not free it.
+ */
+static struct mandata *lookup_pointer (const char *page, const char *ext)
+{
+	char *key = xasprintf ("%s\t%s", page, ext);
+	struct nlist *cached;
+	struct mandata *info;
+
+	cached = hashtable_lookup_structure (pointer_cache, key, strlen (key));
+	if (cached)
+		info = cached->defn;
+	else {
+		info = dblookup_exact (page, ext, 1);
+		hashtable_install (pointer_cache, key, strlen (key), info);
+	}
+	free (key);
+	return info;
+}
+
+/* Return the cached result of dblookup_all (page, NULL, 0).  The caller
+ * must not free it.
+ */
+static struct mandata *lookup_page (const char *page)
+{
+	struct nlist *cached;
+	struct mandata *info;
+
+	cached = hashtable_lookup_structure (lookup_cache, page, strlen (page));
+	if (cached)
+		return cached->defn;
+	info = dblookup_all (page, NULL, 0);
+	hashtable_install (lookup_cache, page, strlen (page), info);
+	return info;
+}
+
+/* The result is either info itself or owned by pointer_cache; either way,
+ * the caller must not free it.
+ */
 static struct mandata *resolve_pointers (struct mandata *info,
 					 const char *page)
 {
@@ -371,10 +300,8 @@ static struct mandata *resolve_pointers (struct mandata *info,
 	 * arbitrary: it's just there to avoid an infinite loop.
 	 */
 	newpage = info->pointer;
-	info = dblookup_exact (newpage, info->ext, 1);
+	info = lookup_pointer (newpage, info->ext);
 	for (rounds = 0; rounds < 10; rounds++) {
-		struct mandata *newinfo;
-
 		/* If the pointer lookup fails, do nothing. */
 		if (!info)
 			return NULL;
@@ -384,9 +311,7 @@ static struct mandata *resolve_pointers (struct mandata *info,
 		     STREQ (info->pointer, newpage)))
 			return info;
 
-		newinfo = dblookup_exact (info->pointer, info->ext, 1);
-		free_mandata_struct (info);
-		info = newinfo;
+		info = lookup_pointer (info->pointer, info->ext);
 	}
 
 	if (!quiet)
@@ -475,8 +400,6 @@ static void display (struct mandata *info, const char *page)
 out:
 	free (key);
 	free (whatis);
-	if (newinfo != info)
-		free_mandata_struct (newinfo);
 }
 
 /* lookup the page and display the results */
@@ -485,20 +408,43 @@ static inline int do_whatis_section (const char *page, const char *section)
 	struct mandata *info;
 	int count = 0;
 
-	info = dblookup_all (page, section, 0);
-	while (info) {
-		struct mandata *pinfo;
-			
+	/* This is the same section filter that dblookup_all() applies. */
+	for (info = lookup_page (page); info; info = info->next) {
+		if (section && !STRNEQ (section, info->ext, strlen (section)))
+			continue;
 		display (info, page);
 		count++;
-		pinfo = info->next;	/* go on to next structure */
-		free_mandata_elements (info);
-	 	free (info);
-		info = pinfo;
 	}
 	return count;
 }
 
+static int page_compare (const void *a, const void *b)
+{
+	const char * const *left = a;
+	const char * const *right = b;
+
+	return strcmp (*left, *right);
+}
+
+/* Fetch all the requested pages in key order before displaying any of
+ * them.  This gives ordered backends sequential access, and means that
+ * each distinct name is fetched only once however many sections it is
+ * wanted in.
+ */
+static void prefetch_pages (char * const *pages, int num_pages)
+{
+	const char **sorted = XNMALLOC (num_pages, const char *);
+	int i, count = 0;
+
+	for (i = 0; i < num_pages; ++i)
+		if (pages[i])
+			sorted[count++] = pages[i];
+	qsort (sorted, count, sizeof *sorted, &page_compare);
+	for (i = 0; i < count; ++i)
+		lookup_page (sorted[i]);
+	free (sorted);
+}
+
 static int suitable_manpath (const char *manpath, const char *page_dir)
 {
 	char *page_manp;
@@ -530,6 +476,7 @@ static int suitable_manpath (const char *manpath, const char *page_dir)
 static void do_whatis (const char * const *pages, int num_pages,
 		       const char *manpath, int *found)
 {
+	char **names = XCALLOC (num_pages, char *);
 	int i;
 
 	for (i = 0; i < num_pages; ++i) {
@@ -554,26 +501,37 @@ static void do_whatis (const char * const *pages, int num_pages,
 					debug ("%s not on manpath for %s\n",
 					       manpath, page);
 					free (page_dir);
+					free (page);
 					continue;
 				}
 			}
 			free (page_dir);
 		}
 
+		names[i] = page;
+	}
+
+	prefetch_pages (names, num_pages);
+
+	for (i = 0; i < num_pages; ++i) {
+		if (!names[i])
+			continue;
+
 		if (sections) {
 			char * const *section;
 
 			for (section = sections; *section; ++section) {
-				if (do_whatis_section (page, *section))
+				if (do_whatis_section (names[i], *section))
 					found[i] = 1;
 			}
 		} else {
-			if (do_whatis_section (page, NULL))
+			if (do_whatis_section (names[i], NULL))
 				found[i] = 1;
 		}
 
-		free (page);
+		free (names[i]);
 	}
+	free (names);
 }
 
 /* return 1 if any of pages matches name, else 0 */
@@ -672,22 +630,14 @@ static int parse_whatis (const char * const *pages, char * const *lowpages,
 	return ret;
 }
 
-/* cjwatson: Optimized functions don't seem to be correct in some
- * circumstances; disabled for now.
- */
-#undef BTREE
-
 /* scan for the page, print any matches */
 static void do_apropos (const char * const *pages, int num_pages, int *found)
 {
 	datum key, cont;
+	struct mydbm_cursor *cursor = NULL;
+	char **candidates = NULL, **candidate;
 	char **lowpages;
 	int i;
-#ifndef BTREE
-	datum nextkey;
-#else /* BTREE */
-	int end;
-#endif /* !BTREE */
 
 	lowpages = XNMALLOC (num_pages, char *);
 	for (i = 0; i < num_pages; ++i) {
@@ -695,19 +645,31 @@ static void do_apropos (const char * const *pages, int num_pages, int *found)
 		debug ("lower(%s) = \"%s\"\n", pages[i], lowpages[i]);
 	}
 
-#ifndef BTREE
-	key = MYDBM_FIRSTKEY (dbf);
-	while (MYDBM_DPTR (key)) {
-		cont = MYDBM_FETCH (dbf, key);
-#else /* BTREE */
-	end = btree_nextkeydata (dbf, &key, &cont);
-	while (!end) {
-#endif /* !BTREE */
+	/* apropos also searches descriptions, which the trigram index
+	 * doesn't cover; but whatis --regex and --wildcard only look at
+	 * names.
+	 */
+	if (!am_apropos && (regex_opt || wildcard))
+		candidates = dbtrigram_candidates (pages, num_pages,
+						   regex_opt);
+	candidate = candidates;
+	if (!candidates)
+		cursor = MYDBM_CURSOR_OPEN (dbf);
+
+	for (;;) {
+		struct mandata *list, *info, *next;
 		char *tab;
-		int got_match;
-		struct mandata info;
 
-		memset (&info, 0, sizeof (info));
+		if (candidates) {
+			key = dbtrigram_nextkey (&candidate);
+			if (!MYDBM_DPTR (key))
+				break;
+			cont = MYDBM_FETCH (dbf, key);
+			/* Candidates may be stale. */
+			if (!MYDBM_DPTR (cont))
+				goto nextpage;
+		} else if (MYDBM_CURSOR_NEXT (cursor, &key, &cont))
+			break;
 
 		/* bug#4372, NULL pointer dereference in MYDBM_DPTR (cont),
 		 * fix by dassen@wi.leidenuniv.nl (J.H.M.Dassen), thanx Ray.
@@ -729,108 +691,119 @@ static void do_apropos (const char * const *pages, int num_pages, int *found)
 		if (*MYDBM_DPTR (cont) == '\t')
 			goto nextpage;
 
-		/* a real page */
+		/* real pages */
 
-		split_content (MYDBM_DPTR (cont), &info);
+		list = split_content_list (MYDBM_DPTR (cont),
+					   MYDBM_DSIZE (cont));
+		MYDBM_SET_DPTR (cont, NULL); /* owned by list */
 
-		/* If there are sections given, does any of them match
-		 * either the section or extension of this page?
-		 */
-		if (sections) {
-			char * const *section;
-			int matched = 0;
+		tab = strrchr (MYDBM_DPTR (key), '\t');
+		if (tab) 
+			 *tab = '\0';
 
-			for (section = sections; *section; ++section) {
-				if (STREQ (*section, info.sec) ||
-				    STREQ (*section, info.ext)) {
-					matched = 1;
-					break;
+		for (info = list; info; info = next) {
+			const char *name;
+			int got_match;
+
+			next = info->next;
+
+			/* If there are sections given, does any of them
+			 * match either the section or extension of this
+			 * page?
+			 */
+			if (sections) {
+				char * const *section;
+				int matched = 0;
+
+				for (section = sections; *section; ++section) {
+					if (STREQ (*section, info->sec) ||
+					    STREQ (*section, info->ext)) {
+						matched = 1;
+						break;
+					}
 				}
-			}
 
-			if (!matched)
-				goto nextpage;
-		}
+				if (!matched)
+					continue;
+			}
 
-		tab = strrchr (MYDBM_DPTR (key), '\t');
-		if (tab) 
-			 *tab = '\0';
+			name = info->name ? info->name : MYDBM_DPTR (key);
 
-		if (am_apropos) {
-			char *whatis;
-			char *seen_key;
-			int *seen_count;
+			if (am_apropos) {
+				char *whatis;
+				char *seen_key;
+				int *seen_count;
 
-			if (info.name)
-				seen_key = xstrdup (info.name);
-			else
-				seen_key = xstrdup (MYDBM_DPTR (key));
-			seen_key = appendstr (seen_key, " (", info.ext, ")",
-					      NULL);
-			seen_count = hashtable_lookup (apropos_seen, seen_key,
-						       strlen (seen_key));
-			if (seen_count && !require_all)
-				goto nextpage_tab;
-			got_match = parse_name ((const char **) lowpages,
-						num_pages, MYDBM_DPTR (key),
-						found);
-			whatis = info.whatis ? xstrdup (info.whatis) : NULL;
-			if (!got_match && whatis)
-				got_match = parse_whatis (pages, lowpages,
-							  num_pages, whatis,
-							  found);
-			free (whatis);
-			if (got_match) {
-				if (!seen_count) {
-					seen_count = xmalloc
-						(sizeof *seen_count);
-					*seen_count = 0;
-					hashtable_install (apropos_seen,
-							   seen_key,
-							   strlen (seen_key),
-							   seen_count);
+				seen_key = xasprintf ("%s (%s)",
+						      name, info->ext);
+				seen_count = hashtable_lookup
+					(apropos_seen, seen_key,
+					 strlen (seen_key));
+				if (seen_count && !require_all) {
+					free (seen_key);
+					continue;
+				}
+				got_match = parse_name
+					((const char **) lowpages, num_pages,
+					 MYDBM_DPTR (key), found);
+				whatis = info->whatis ? xstrdup (info->whatis)
+						      : NULL;
+				if (!got_match && whatis)
+					got_match = parse_whatis
+						(pages, lowpages, num_pages,
+						 whatis, found);
+				free (whatis);
+				if (got_match) {
+					if (!seen_count) {
+						seen_count = xmalloc
+							(sizeof *seen_count);
+						*seen_count = 0;
+						hashtable_install
+							(apropos_seen,
+							 seen_key,
+							 strlen (seen_key),
+							 seen_count);
+					}
+					++(*seen_count);
+					if (!require_all ||
+					    *seen_count == num_pages)
+						display (info,
+							 MYDBM_DPTR (key));
 				}
-				++(*seen_count);
-				if (!require_all ||
-				    *seen_count == num_keywords)
-					display (&info, MYDBM_DPTR (key));
+				free (seen_key);
+			} else {
+				got_match = parse_name (pages, num_pages,
+							MYDBM_DPTR (key),
+							found);
+				if (got_match)
+					display (info, MYDBM_DPTR (key));
 			}
-			free (seen_key);
-		} else {
-			got_match = parse_name (pages, num_pages,
-						MYDBM_DPTR (key), found);
-			if (got_match)
-				display (&info, MYDBM_DPTR (key));
 		}
 
-nextpage_tab:
 		if (tab)
 			*tab = '\t';
+		free_mandata_struct (list);
 nextpage:
-#ifndef BTREE
-		nextkey = MYDBM_NEXTKEY (dbf, key);
-		MYDBM_FREE (MYDBM_DPTR (cont));
-		MYDBM_FREE (MYDBM_DPTR (key));
-		key = nextkey; 
-#else /* BTREE */
 		MYDBM_FREE (MYDBM_DPTR (cont));
 		MYDBM_FREE (MYDBM_DPTR (key));
-		end = btree_nextkeydata (dbf, &key, &cont);
-#endif /* !BTREE */
-		info.addr = NULL; /* == MYDBM_DPTR (cont), freed above */
-		free_mandata_elements (&info);
 	}
 
+	if (cursor)
+		MYDBM_CURSOR_CLOSE (cursor);
+	dbtrigram_free_candidates (candidates);
+
 	for (i = 0; i < num_pages; ++i)
 		free (lowpages[i]);
 	free (lowpages);
 }
 
 /* loop through the man paths, searching for a match */
-static int search (const char * const *pages, int num_pages)
+static int search (char * const *manpathlist,
+		   const char * const *pages, int num_pages)
 {
 	int *found = XCALLOC (num_pages, int);
-	char *catpath, **mp;
+	char *catpath;
+	char * const *mp;
 	int any_found, i;
 
 	for (mp = manpathlist; *mp; mp++) {
@@ -854,6 +827,8 @@ static int search (const char * const *pages, int num_pages)
 			continue;
 		}
 
+		lookup_cache = hashtable_create (&mandata_hashtable_free);
+		pointer_cache = hashtable_create (&mandata_hashtable_free);
 		if (am_apropos)
 			do_apropos (pages, num_pages, found);
 		else {
@@ -862,6 +837,10 @@ static int search (const char * const *pages, int num_pages)
 			else
 				do_whatis (pages, num_pages, *mp, found);
 		}
+		hashtable_free (pointer_cache);
+		pointer_cache = NULL;
+		hashtable_free (lookup_cache);
+		lookup_cache = NULL;
 		free (database);
 		database = NULL;
 		MYDBM_CLOSE (dbf);
@@ -882,77 +861,28 @@ static int search (const char * const *pages, int num_pages)
 	return any_found;
 }
 
-int main (int argc, char *argv[])
+/* Search the databases for the manual page hierarchies in MANPATHLIST for
+ * KEYWORDS, and print any matches.  Returns nonzero if any keyword
+ * matched.
+ */
+int whatis_search (const struct whatis_options *options,
+		   char * const *manpathlist,
+		   char * const *keywords, int num_keywords)
 {
 #ifdef HAVE_ICONV
 	char *locale_charset;
-#endif
-	int status = OK;
-
-	program_name = base_name (argv[0]);
-	if (STREQ (program_name, APROPOS_NAME)) {
-		am_apropos = 1;
-		argp_program_version = "apropos " PACKAGE_VERSION;
-	} else {
-		struct argp_option *optionp;
-		am_apropos = 0;
-		argp_program_version = "whatis " PACKAGE_VERSION;
-		for (optionp = (struct argp_option *) whatis_argp.options;
-		     optionp->name || optionp->key || optionp->arg ||
-		     optionp->flags || optionp->doc || optionp->group;
-		     ++optionp) {
-			if (!optionp->name)
-				continue;
-			if (STREQ (optionp->name, "exact") ||
-			    STREQ (optionp->name, "and"))
-				optionp->flags |= OPTION_HIDDEN;
-		}
-	}
-
-	init_debug ();
-	pipeline_install_post_fork (pop_all_cleanups);
-	init_locale ();
-
-	internal_locale = setlocale (LC_MESSAGES, NULL);
-	/* Use LANGUAGE only when LC_MESSAGES locale category is
-	 * neither "C" nor "POSIX". */
-	if (internal_locale && strcmp (internal_locale, "C") &&
-	    strcmp (internal_locale, "POSIX"))
-		multiple_locale = getenv ("LANGUAGE");
-	internal_locale = xstrdup (internal_locale ? internal_locale : "C");
-
-	if (argp_parse (am_apropos ? &apropos_argp : &whatis_argp, argc, argv,
-			0, 0, 0))
-		exit (FAIL);
-
-	read_config_file (user_config_file != NULL);
-
-	/* close this locale and reinitialise if a new locale was 
-	   issued as an argument or in $MANOPT */
-	if (locale) {
-		free (internal_locale);
-		internal_locale = setlocale (LC_ALL, locale);
-		if (internal_locale)
-			internal_locale = xstrdup (internal_locale);
-		else
-			internal_locale = xstrdup (locale);
-
-		debug ("main(): locale = %s, internal_locale = %s\n",
-		       locale, internal_locale);
-		if (internal_locale) {
-			setenv ("LANGUAGE", internal_locale, 1);
-			locale_changed ();
-			multiple_locale = NULL;
-		}
-	}
-
-	/* sort out the internal manpath */
-	if (manp == NULL)
-		manp = locale_manpath (get_manpath (alt_systems));
-	else
-		free (get_manpath (NULL));
-
-	create_pathlist (manp, manpathlist);
+#endif /* HAVE_ICONV */
+	int any_found;
+
+	am_apropos = options->apropos;
+	regex_opt = options->regex;
+	exact = options->exact;
+	wildcard = options->wildcard;
+	require_all = options->require_all;
+	long_output = options->long_output;
+	sections = options->sections;
+	multiple_locale = options->multiple_locale;
+	internal_locale = options->internal_locale;
 
 	apropos_seen = hashtable_create (&plain_hashtable_free);
 	display_seen = hashtable_create (&null_hashtable_free);
@@ -972,14 +902,15 @@ int main (int argc, char *argv[])
 				  REG_EXTENDED | REG_NOSUB | REG_ICASE);
 	}
 
-	if (!search ((const char **) keywords, num_keywords))
-		status = NOT_FOUND;
+	any_found = search (manpathlist, (const char **) keywords,
+			    num_keywords);
 
 	if (regex_opt) {
 		int i;
 		for (i = 0; i < num_keywords; ++i)
 			regfree (&preg[i]);
 		free (preg);
+		preg = NULL;
 	}
 
 #ifdef HAVE_ICONV
@@ -987,10 +918,8 @@ int main (int argc, char *argv[])
 		iconv_close (conv_to_locale);
 #endif /* HAVE_ICONV */
 	hashtable_free (display_seen);
+	display_seen = NULL;
 	hashtable_free (apropos_seen);
-	free_pathlist (manpathlist);
-	free (manp);
-	free (internal_locale);
-	free (program_name);
-	exit (status);
+	apropos_seen = NULL;
+	return any_found;
 }
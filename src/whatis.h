@@ -0,0 +1,39 @@
+/*
+ * whatis.h: interface to searching the index databases for words
+ *
+ * Copyright (C) 2013 Colin Watson.
+ *
+ * This file is part of man-db.
+ *
+ * man-db is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * man-db is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with man-db; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+struct whatis_options {
+	int apropos;		/* search descriptions as well as names */
+	int regex;		/* keywords are extended regexes */
+	int exact;		/* match descriptions exactly */
+	int wildcard;		/* keywords contain wildcards */
+	int require_all;	/* all keywords must match (apropos only) */
+	int long_output;	/* do not trim output to terminal width */
+	char **sections;	/* NULL-terminated, or NULL for all */
+	/* used to find the manual hierarchies for executables */
+	const char *multiple_locale;
+	const char *internal_locale;
+};
+
+extern char **whatis_split_sections (const char *sections_str);
+extern int whatis_search (const struct whatis_options *options,
+			  char * const *manpathlist,
+			  char * const *keywords, int num_keywords);
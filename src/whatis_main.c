@@ -0,0 +1,284 @@
+/*
+ * whatis_main.c: command-line interface to searching the index or whatis
+ * database(s) for words.
+ *
+ * Copyright (C) 1994, 1995 Graeme W. Wilford. (Wilf.)
+ * Copyright (C) 2001, 2002, 2003, 2004, 2006, 2007, 2008, 2009, 2010, 2011,
+ *               2012, 2013 Colin Watson.
+ *
+ * This file is part of man-db.
+ *
+ * man-db is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * man-db is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with man-db; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "gettext.h"
+#include <locale.h>
+#define _(String) gettext (String)
+#define N_(String) gettext_noop (String)
+
+#include "argp.h"
+#include "dirname.h"
+#include "xvasprintf.h"
+
+#include "manconfig.h"
+
+#include "cleanup.h"
+#include "pipeline.h"
+
+#include "mydbm.h"
+
+#include "manp.h"
+#include "whatis.h"
+
+static char *manpathlist[MAXDIRS];
+
+extern char *user_config_file;
+extern char *db_backend;
+static char **keywords;
+static int num_keywords;
+
+char *program_name;
+char *database;
+MYDBM_FILE dbf;
+int quiet = 1;
+
+static struct whatis_options options;
+
+static char *manp = NULL;
+static const char *alt_systems = "";
+static const char *locale = NULL;
+static char *multiple_locale = NULL, *internal_locale;
+
+const char *argp_program_version; /* initialised in main */
+const char *argp_program_bug_address = PACKAGE_BUGREPORT;
+error_t argp_err_exit_status = FAIL;
+
+static const char args_doc[] = N_("KEYWORD...");
+static const char apropos_doc[] = "\v" N_("The --regex option is enabled by default.");
+
+static struct argp_option argp_options[] = {
+	{ "debug",		'd',	0,		0,	N_("emit debugging messages") },
+	{ "verbose",		'v',	0,		0,	N_("print verbose warning messages") },
+	{ "regex",		'r',	0,		0,	N_("interpret each keyword as a regex"),	10 },
+	{ "exact",		'e',	0,		0,	N_("search each keyword for exact match") }, /* apropos only */
+	{ "wildcard",		'w',	0,		0,	N_("the keyword(s) contain wildcards") },
+	{ "and",		'a',	0,		0,	N_("require all keywords to match"),			20 }, /* apropos only */
+	{ "long",		'l',	0,		0,	N_("do not trim output to terminal width"),		30 },
+	{ "sections",		's',	N_("LIST"),	0,	N_("search only these sections (colon-separated)"),	40 },
+	{ "section",		0,	0,		OPTION_ALIAS },
+	{ "systems",		'm',	N_("SYSTEM"),	0,	N_("use manual pages from other systems") },
+	{ "manpath",		'M',	N_("PATH"),	0,	N_("set search path for manual pages to PATH") },
+	{ "locale",		'L',	N_("LOCALE"),	0,	N_("define the locale for this search") },
+	{ "config-file",	'C',	N_("FILE"),	0,	N_("use this user configuration file") },
+	{ "whatis",		'f',	0,		OPTION_HIDDEN,	0 },
+	{ "apropos",		'k',	0,		OPTION_HIDDEN,	0 },
+	{ 0, 'h', 0, OPTION_HIDDEN, 0 }, /* compatibility for --help */
+	{ 0 }
+};
+
+static error_t parse_opt (int key, char *arg, struct argp_state *state)
+{
+	switch (key) {
+		case 'd':
+			debug_level = 1;
+			return 0;
+		case 'v':
+			quiet = 0;
+			return 0;
+		case 'r':
+			options.regex = 1;
+			return 0;
+		case 'e':
+			/* Only makes sense for apropos, but has
+			 * historically been accepted by whatis anyway.
+			 */
+			options.regex = 0;
+			options.exact = 1;
+			return 0;
+		case 'w':
+			options.regex = 0;
+			options.wildcard = 1;
+			return 0;
+		case 'a':
+			if (options.apropos)
+				options.require_all = 1;
+			else
+				argp_usage (state);
+			return 0;
+		case 'l':
+			options.long_output = 1;
+			return 0;
+		case 's':
+			options.sections = whatis_split_sections (arg);
+			return 0;
+		case 'm':
+			alt_systems = arg;
+			return 0;
+		case 'M':
+			manp = xstrdup (arg);
+			return 0;
+		case 'L':
+			locale = arg;
+			return 0;
+		case 'C':
+			user_config_file = arg;
+			return 0;
+		case 'f':
+			/* helpful override if program name detection fails */
+			options.apropos = 0;
+			return 0;
+		case 'k':
+			/* helpful override if program name detection fails */
+			options.apropos = 1;
+			return 0;
+		case 'h':
+			argp_state_help (state, state->out_stream,
+					 ARGP_HELP_STD_HELP &
+					 ~ARGP_HELP_PRE_DOC);
+			break;
+		case ARGP_KEY_ARGS:
+			keywords = state->argv + state->next;
+			num_keywords = state->argc - state->next;
+			return 0;
+		case ARGP_KEY_NO_ARGS:
+			/* Make sure that we have a keyword! */
+			printf (_("%s what?\n"), program_name);
+			exit (FAIL);
+		case ARGP_KEY_SUCCESS:
+			if (options.apropos && !options.exact &&
+			    !options.wildcard)
+				options.regex = 1;
+			return 0;
+	}
+	return ARGP_ERR_UNKNOWN;
+}
+
+static struct argp apropos_argp = { argp_options, parse_opt, args_doc,
+				    apropos_doc };
+static struct argp whatis_argp = { argp_options, parse_opt, args_doc };
+
+static char *locale_manpath (char *manpath)
+{
+	char *all_locales;
+	char *new_manpath;
+
+	if (multiple_locale && *multiple_locale) {
+		if (internal_locale && *internal_locale)
+			all_locales = xasprintf ("%s:%s", multiple_locale,
+						 internal_locale);
+		else
+			all_locales = xstrdup (multiple_locale);
+	} else {
+		if (internal_locale && *internal_locale)
+			all_locales = xstrdup (internal_locale);
+		else
+			all_locales = NULL;
+	}
+
+	new_manpath = add_nls_manpaths (manpath, all_locales);
+	free (all_locales);
+
+	return new_manpath;
+}
+
+int main (int argc, char *argv[])
+{
+	int status = OK;
+
+	program_name = base_name (argv[0]);
+	if (STREQ (program_name, APROPOS_NAME)) {
+		options.apropos = 1;
+		argp_program_version = "apropos " PACKAGE_VERSION;
+	} else {
+		struct argp_option *optionp;
+		options.apropos = 0;
+		argp_program_version = "whatis " PACKAGE_VERSION;
+		for (optionp = (struct argp_option *) whatis_argp.options;
+		     optionp->name || optionp->key || optionp->arg ||
+		     optionp->flags || optionp->doc || optionp->group;
+		     ++optionp) {
+			if (!optionp->name)
+				continue;
+			if (STREQ (optionp->name, "exact") ||
+			    STREQ (optionp->name, "and"))
+				optionp->flags |= OPTION_HIDDEN;
+		}
+	}
+
+	init_debug ();
+	pipeline_install_post_fork (pop_all_cleanups);
+	init_locale ();
+
+	internal_locale = setlocale (LC_MESSAGES, NULL);
+	/* Use LANGUAGE only when LC_MESSAGES locale category is
+	 * neither "C" nor "POSIX". */
+	if (internal_locale && strcmp (internal_locale, "C") &&
+	    strcmp (internal_locale, "POSIX"))
+		multiple_locale = getenv ("LANGUAGE");
+	internal_locale = xstrdup (internal_locale ? internal_locale : "C");
+
+	if (argp_parse (options.apropos ? &apropos_argp : &whatis_argp,
+			argc, argv, 0, 0, 0))
+		exit (FAIL);
+
+	read_config_file (user_config_file != NULL);
+	mydbm_select_backend (db_backend);
+
+	/* close this locale and reinitialise if a new locale was
+	   issued as an argument or in $MANOPT */
+	if (locale) {
+		free (internal_locale);
+		internal_locale = setlocale (LC_ALL, locale);
+		if (internal_locale)
+			internal_locale = xstrdup (internal_locale);
+		else
+			internal_locale = xstrdup (locale);
+
+		debug ("main(): locale = %s, internal_locale = %s\n",
+		       locale, internal_locale);
+		if (internal_locale) {
+			setenv ("LANGUAGE", internal_locale, 1);
+			locale_changed ();
+			multiple_locale = NULL;
+		}
+	}
+
+	/* sort out the internal manpath */
+	if (manp == NULL)
+		manp = locale_manpath (get_manpath (alt_systems));
+	else
+		free (get_manpath (NULL));
+
+	create_pathlist (manp, manpathlist);
+
+	options.multiple_locale = multiple_locale;
+	options.internal_locale = internal_locale;
+	if (!whatis_search (&options, manpathlist, keywords, num_keywords))
+		status = NOT_FOUND;
+
+	free_pathlist (manpathlist);
+	free (manp);
+	free (internal_locale);
+	free (program_name);
+	exit (status);
+}
@@ -808,6 +808,7 @@ char *yytext;
  */
 
 #define MAX_SO_DEPTH 	10		/* max .so recursion depth */
+#define PASSTHROUGH_BLOCK	65536	/* bytes to read at once before .so */
 #undef ACCEPT_QUOTES			/* accept quoted roff requests */
 
 #include <string.h>
@@ -834,6 +835,7 @@ char *yytext;
 #include "error.h"
 #include "pipeline.h"
 #include "decompress.h"
+#include "hashtable.h"
 
 #include "globbing.h"
 #include "zsoelim.h"
@@ -854,6 +856,11 @@ static int no_newline;
 static char * const *so_manpathlist;
 static const char *so_parent_path;
 
+/* Input already read by passthrough() that the scanner has yet to see. */
+static char *so_pending;
+static size_t so_pending_len, so_pending_pos;
+static pipeline *so_pending_pipe;
+
 struct zsoelim_stdin_data {
 	char *path;
 	char * const *manpathlist;
@@ -861,24 +868,39 @@ struct zsoelim_stdin_data {
 
 /* The flex documentation says that yyin is only used by YY_INPUT, so we
  * should safely be able to abuse it as a handy way to keep track of the
- * current 'pipeline *' rather than the usual 'FILE *'.
+ * current 'pipeline *' rather than the usual 'FILE *'.  Anything left over
+ * from passthrough() is returned before reading more from the pipeline.
  */
 #define YY_INPUT(buf,result,max_size) { \
-	size_t size = max_size; \
-	const char *block = pipeline_read ((pipeline *) yyin, &size); \
-	if (block && size != 0) { \
-		memcpy (buf, block, size); \
+	if (so_pending && (pipeline *) yyin == so_pending_pipe) { \
+		size_t size = so_pending_len - so_pending_pos; \
+		if (size > max_size) \
+			size = max_size; \
+		memcpy (buf, so_pending + so_pending_pos, size); \
 		buf[size] = '\0'; \
 		result = size; \
-	} else \
-		result = YY_NULL; \
+		so_pending_pos += size; \
+		if (so_pending_pos == so_pending_len) { \
+			free (so_pending); \
+			so_pending = NULL; \
+		} \
+	} else { \
+		size_t size = max_size; \
+		const char *block = pipeline_read ((pipeline *) yyin, &size); \
+		if (block && size != 0) { \
+			memcpy (buf, block, size); \
+			buf[size] = '\0'; \
+			result = size; \
+		} else \
+			result = YY_NULL; \
+	} \
 }
 
 
 
 
 
-#line 882 "zsoelim.c"
+#line 904 "zsoelim.c"
 
 #define INITIAL 0
 #define so 1
@@ -1093,10 +1115,10 @@ YY_DECL
 		}
 
 	{
-#line 126 "zsoelim.l"
+#line 148 "zsoelim.l"
 
 
-#line 1100 "zsoelim.c"
+#line 1122 "zsoelim.c"
 
 	while ( 1 )		/* loops until end-of-file is reached */
 		{
@@ -1144,7 +1166,7 @@ do_action:	/* This label is used only to access EOF actions. */
 
 case 1:
 YY_RULE_SETUP
-#line 128 "zsoelim.l"
+#line 150 "zsoelim.l"
 {	
 			no_newline = 1;
 			ECHO;
@@ -1153,7 +1175,7 @@ YY_RULE_SETUP
 	YY_BREAK
 case 2:
 YY_RULE_SETUP
-#line 134 "zsoelim.l"
+#line 156 "zsoelim.l"
 {	
 			no_newline = 1;
 			BEGIN (so);	/* Now we're in the .so environment */
@@ -1161,7 +1183,7 @@ YY_RULE_SETUP
 	YY_BREAK
 case 3:
 YY_RULE_SETUP
-#line 139 "zsoelim.l"
+#line 161 "zsoelim.l"
 {
 			no_newline = 1;
 			ECHO;		/* Now we're in the .lf environment */
@@ -1169,26 +1191,26 @@ YY_RULE_SETUP
 		}
 	YY_BREAK
 case 4:
-#line 146 "zsoelim.l"
+#line 168 "zsoelim.l"
 case 5:
 /* rule 5 can match eol */
-#line 147 "zsoelim.l"
+#line 169 "zsoelim.l"
 case 6:
 /* rule 6 can match eol */
-#line 148 "zsoelim.l"
+#line 170 "zsoelim.l"
 case 7:
 /* rule 7 can match eol */
-#line 149 "zsoelim.l"
+#line 171 "zsoelim.l"
 case 8:
 /* rule 8 can match eol */
-#line 150 "zsoelim.l"
+#line 172 "zsoelim.l"
 case 9:
 /* rule 9 can match eol */
-#line 151 "zsoelim.l"
+#line 173 "zsoelim.l"
 case 10:
 /* rule 10 can match eol */
 YY_RULE_SETUP
-#line 151 "zsoelim.l"
+#line 173 "zsoelim.l"
 {
 				no_newline = 1;
 				ECHO;
@@ -1197,7 +1219,7 @@ YY_RULE_SETUP
 case 11:
 /* rule 11 can match eol */
 YY_RULE_SETUP
-#line 156 "zsoelim.l"
+#line 178 "zsoelim.l"
 {
 			no_newline = 0;
 			putchar ('\n');
@@ -1206,7 +1228,7 @@ YY_RULE_SETUP
 	YY_BREAK
 case 12:
 YY_RULE_SETUP
-#line 163 "zsoelim.l"
+#line 185 "zsoelim.l"
 { 	/* file names including whitespace ?  */
 			if (so_stack_ptr == MAX_SO_DEPTH - 1) 
 				error (FATAL, 0, 
@@ -1242,7 +1264,7 @@ YY_RULE_SETUP
 case 13:
 /* rule 13 can match eol */
 YY_RULE_SETUP
-#line 195 "zsoelim.l"
+#line 217 "zsoelim.l"
 {
 			no_newline = 0;
 			BEGIN (INITIAL);
@@ -1251,7 +1273,7 @@ YY_RULE_SETUP
 case 14:
 /* rule 14 can match eol */
 YY_RULE_SETUP
-#line 200 "zsoelim.l"
+#line 222 "zsoelim.l"
 {
 			no_newline = 0;
 			error (OK, 0,
@@ -1265,7 +1287,7 @@ YY_RULE_SETUP
 	YY_BREAK
 case 15:
 YY_RULE_SETUP
-#line 211 "zsoelim.l"
+#line 233 "zsoelim.l"
 {
 			no_newline = 1;
 			ECHO;
@@ -1274,7 +1296,7 @@ YY_RULE_SETUP
 	YY_BREAK
 case 16:
 YY_RULE_SETUP
-#line 217 "zsoelim.l"
+#line 239 "zsoelim.l"
 {
 			no_newline = 1;
 			ECHO;
@@ -1283,7 +1305,7 @@ YY_RULE_SETUP
 case 17:
 /* rule 17 can match eol */
 YY_RULE_SETUP
-#line 222 "zsoelim.l"
+#line 244 "zsoelim.l"
 {
 			no_newline = 0;
 			putchar ('\n');
@@ -1292,7 +1314,7 @@ YY_RULE_SETUP
 	YY_BREAK
 case 18:
 YY_RULE_SETUP
-#line 229 "zsoelim.l"
+#line 251 "zsoelim.l"
 {
 			no_newline = 1;
 			ECHO;
@@ -1303,7 +1325,7 @@ YY_RULE_SETUP
 	YY_BREAK
 case 19:
 YY_RULE_SETUP
-#line 237 "zsoelim.l"
+#line 259 "zsoelim.l"
 {	/* file names including whitespace ?? */
 			no_newline = 1;
 			ECHO;
@@ -1317,7 +1339,7 @@ YY_RULE_SETUP
 	YY_BREAK
 case 20:
 YY_RULE_SETUP
-#line 248 "zsoelim.l"
+#line 270 "zsoelim.l"
 {
 			no_newline = 1;
 			ECHO;
@@ -1325,7 +1347,7 @@ YY_RULE_SETUP
 	YY_BREAK
 case 21:
 YY_RULE_SETUP
-#line 253 "zsoelim.l"
+#line 275 "zsoelim.l"
 {
 			no_newline = 1;
 			error (OK, 0,
@@ -1339,7 +1361,7 @@ YY_RULE_SETUP
 case 22:
 /* rule 22 can match eol */
 YY_RULE_SETUP
-#line 263 "zsoelim.l"
+#line 285 "zsoelim.l"
 {
 			no_newline = 0;
 			error (OK, 0,
@@ -1357,7 +1379,7 @@ case YY_STATE_EOF(de):
 case YY_STATE_EOF(end_request):
 case YY_STATE_EOF(lfnumber):
 case YY_STATE_EOF(lfname):
-#line 274 "zsoelim.l"
+#line 296 "zsoelim.l"
 {
 		pipeline_wait (PIPE);
 		pipeline_free (PIPE);
@@ -1382,10 +1404,10 @@ case YY_STATE_EOF(lfname):
 	YY_BREAK
 case 23:
 YY_RULE_SETUP
-#line 295 "zsoelim.l"
+#line 317 "zsoelim.l"
 ECHO;
 	YY_BREAK
-#line 1389 "zsoelim.c"
+#line 1411 "zsoelim.c"
 
 	case YY_END_OF_BUFFER:
 		{
@@ -2334,7 +2356,7 @@ void yyfree (void * ptr )
 
 #define YYTABLES_NAME "yytables"
 
-#line 295 "zsoelim.l"
+#line 317 "zsoelim.l"
 
 
 
@@ -2354,6 +2376,151 @@ static void zap_quotes (void)
 }
 #endif
 
+/* Decide whether the LEN-byte line at LINE (excluding its newline) needs
+ * the scanner, following the scanner's rules.  *IN_DE tracks macro
+ * definitions as the "de" start condition does.  *JOINED is set after a
+ * line consisting of ".", ".s", or ".l", whose pattern also matches the
+ * newline and swallows the next line whole.
+ */
+static int needs_scanner (const char *line, size_t len,
+			  int *in_de, int *joined)
+{
+	if (*joined) {
+		*joined = 0;
+		return 0;
+	}
+	if (*in_de) {
+		if (len >= 2 && line[0] == '.' && line[1] == '.')
+			*in_de = 0;
+		return 0;
+	}
+	if (len == 0 || line[0] != '.')
+		return 0;
+	if (len == 1 || (len == 2 && (line[1] == 's' || line[1] == 'l'))) {
+		*joined = 1;
+		return 0;
+	}
+	if (len < 3)
+		return 0;
+	if ((line[1] == 's' && line[2] == 'o') ||
+	    (line[1] == 'l' && line[2] == 'f'))
+		return 1;
+	if (line[1] == 'd' && line[2] == 'e' && len > 3)
+		*in_de = 1;
+	return 0;
+}
+
+/* Keep HEAD and TAIL for YY_INPUT to return to the scanner. */
+static void hand_to_scanner (pipeline *p, const char *head, size_t head_len,
+			     const char *tail, size_t tail_len)
+{
+	so_pending_len = head_len + tail_len;
+	so_pending_pos = 0;
+	so_pending_pipe = p;
+	if (!so_pending_len)
+		return;
+	so_pending = xmalloc (so_pending_len);
+	memcpy (so_pending, head, head_len);
+	memcpy (so_pending + head_len, tail, tail_len);
+}
+
+/* Most pages have no .so or .lf requests at all, so running every byte
+ * through the scanner just to copy it to stdout is wasted effort.  Write
+ * complete lines straight through in large spans until the first line
+ * that the scanner needs to see, and leave that line and everything after
+ * it for YY_INPUT.
+ */
+static void passthrough (pipeline *p)
+{
+	char *carry = NULL;
+	size_t carry_len = 0, carry_max = 0;
+	int in_de = (YY_START == de), joined = 0;
+
+	if (YY_START != INITIAL && !in_de)
+		return;
+
+	for (;;) {
+		size_t size = PASSTHROUGH_BLOCK;
+		const char *block = pipeline_read (p, &size);
+		const char *start, *line, *end, *nl;
+
+		if (!block || !size) {
+			if (!carry_len) {
+				if (joined)
+					no_newline = 1;
+				goto out;
+			}
+			/* The last line has no trailing newline. */
+			if (needs_scanner (carry, carry_len, &in_de, &joined))
+				hand_to_scanner (p, carry, carry_len, NULL, 0);
+			else {
+				fwrite (carry, 1, carry_len, stdout);
+				no_newline = 1;
+			}
+			goto out;
+		}
+
+		line = block;
+		end = block + size;
+		if (carry_len) {
+			/* Finish the line left over from the last block. */
+			size_t more;
+
+			nl = memchr (block, '\n', size);
+			more = nl ? (size_t) (nl - block) : size;
+			if (carry_len + more + 1 > carry_max) {
+				carry_max = (carry_len + more + 1) * 2;
+				carry = xrealloc (carry, carry_max);
+			}
+			memcpy (carry + carry_len, block, more);
+			carry_len += more;
+			if (!nl)
+				continue;
+			if (needs_scanner (carry, carry_len,
+					   &in_de, &joined)) {
+				hand_to_scanner (p, carry, carry_len,
+						 nl, end - nl);
+				goto out;
+			}
+			carry[carry_len++] = '\n';
+			fwrite (carry, 1, carry_len, stdout);
+			carry_len = 0;
+			if (!joined)
+				++LINE;
+			line = nl + 1;
+		}
+
+		start = line;
+		while (line < end) {
+			nl = memchr (line, '\n', end - line);
+			if (!nl)
+				break;
+			if (needs_scanner (line, nl - line, &in_de, &joined)) {
+				fwrite (start, 1, line - start, stdout);
+				hand_to_scanner (p, NULL, 0, line, end - line);
+				goto out;
+			}
+			if (!joined)
+				++LINE;
+			line = nl + 1;
+		}
+		fwrite (start, 1, line - start, stdout);
+
+		/* Keep any incomplete line until the next block. */
+		if (line < end) {
+			carry_len = end - line;
+			if (carry_len > carry_max) {
+				carry_max = carry_len * 2;
+				carry = xrealloc (carry, carry_max);
+			}
+			memcpy (carry, line, carry_len);
+		}
+	}
+
+out:
+	free (carry);
+}
+
 /* initialise the stack and call the parser */
 void zsoelim_parse_file (char * const *manpathlist, const char *parent_path)
 {
@@ -2381,33 +2548,73 @@ void zsoelim_parse_file (char * const *manpathlist, const char *parent_path)
 
 	printf (".lf %d %s\n", linenum, NAME);
 	LINE = 1;
+	passthrough ((pipeline *) yyin);
 	yylex ();
 }
 
+/* Consult a cached listing of DIR to see whether FILENAME, which must be
+ * in DIR, might exist, so that we need not stat every candidate name.
+ */
+static int may_exist (const char *dir, const char *filename)
+{
+	if (!dir)
+		return 1;
+	return directory_has_entry (dir, last_component (filename)) != 0;
+}
+
 pipeline *try_compressed (char **filename)
 {
 	struct compression *comp;
 	size_t len = strlen (*filename);
-	pipeline *decomp;
+	pipeline *decomp = NULL;
+	char *dir = mdir_name (*filename);
 
 	/* Try the uncompressed name first. */
 	(*filename)[len - 1] = '\0';
-	debug ("trying %s\n", *filename);
-	decomp = decompress_open (*filename);
-	if (decomp)
-		return decomp;
+	if (may_exist (dir, *filename)) {
+		debug ("trying %s\n", *filename);
+		decomp = decompress_open (*filename);
+		if (decomp)
+			goto out;
+	} else
+		errno = ENOENT;
 	(*filename)[len - 1] = '.';
 
 	for (comp = comp_list; comp->ext; ++comp) {
 		*filename = appendstr (*filename, comp->ext, NULL);
-		debug ("trying %s\n", *filename);
-		decomp = decompress_open (*filename);
-		if (decomp)
-			return decomp;
+		if (may_exist (dir, *filename)) {
+			debug ("trying %s\n", *filename);
+			decomp = decompress_open (*filename);
+			if (decomp)
+				goto out;
+		} else
+			errno = ENOENT;
 		(*filename)[len] = '\0';
 	}
 
-	return NULL;
+out:
+	free (dir);
+	return decomp;
+}
+
+/* Record where FILENAME included from PARENT_PATH was found (RESOLVED), or
+ * that it was not found (NULL), so that later requests for it need not
+ * search again.
+ */
+static struct hashtable *so_cache;
+
+static char *so_cache_key (const char *filename, const char *parent_path)
+{
+	return appendstr (NULL, parent_path ? parent_path : "", "\n",
+			  filename, NULL);
+}
+
+static void so_cache_store (const char *key, const char *resolved)
+{
+	if (!so_cache)
+		so_cache = hashtable_create (&plain_hashtable_free);
+	hashtable_install (so_cache, key, strlen (key),
+			   resolved ? xstrdup (resolved) : NULL);
 }
 
 /* This routine is used to open the specified file or uncompress a compressed
@@ -2429,6 +2636,26 @@ int zsoelim_open_file (const char *filename, char * const *manpathlist,
 		NAME = xstrdup (filename);
 	} else {
 		char *compfile;
+		char *key = so_cache_key (filename, parent_path);
+		struct nlist *cached = NULL;
+
+		if (so_cache)
+			cached = hashtable_lookup_structure (so_cache, key,
+							     strlen (key));
+		if (cached && cached->defn) {
+			decomp = decompress_open (cached->defn);
+			if (decomp) {
+				NAME = xstrdup (cached->defn);
+				goto out;
+			}
+			/* It has gone away since; search again. */
+			cached = NULL;
+		} else if (cached) {
+			debug ("%s previously not found\n", filename);
+			decomp = NULL;
+			errno = ENOENT;
+			goto out;
+		}
 
 		/* If there is no parent path, try opening directly first. */
 		if (!parent_path) {
@@ -2537,6 +2764,9 @@ int zsoelim_open_file (const char *filename, char * const *manpathlist,
 		}
 
 out:
+		if (!cached)
+			so_cache_store (key, decomp ? NAME : NULL);
+		free (key);
 		if (!decomp) {
 			error (0, errno, _("can't open %s"), filename);
 			return 1;